@@ -0,0 +1,96 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+// 单调（只增不减）内存池：顺序分配、整体释放
+// 用于 BVH 节点、叶子图元列表、构建期临时数组以及场景对象，
+// 让相关数据在内存中相邻，并避免构建时大量小块 new/delete 的锁竞争。
+// 非线程安全：每个构建者（BLAS / TLAS / Engine）各持有一个。
+class Arena {
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size = 0, used = 0;
+    };
+    std::vector<Block> blocks;
+    size_t current = 0;        // 当前分配所在块
+    size_t blockSize;
+    std::vector<std::pair<void*, void(*)(void*)>> destructors; // 非平凡析构对象，reset 时逆序调用
+public:
+    explicit Arena(size_t __blockSize = size_t(64) << 10) : blockSize(__blockSize) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) noexcept = default;
+    Arena& operator=(Arena&& o) noexcept {
+        if (this != &o) {
+            reset();
+            blocks = std::move(o.blocks); current = o.current; blockSize = o.blockSize;
+            destructors = std::move(o.destructors);
+            o.current = 0;
+        }
+        return *this;
+    }
+    ~Arena() { reset(); }
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        if (bytes == 0) bytes = 1;
+        for (; current < blocks.size(); ++current) {
+            Block& b = blocks[current];
+            const uintptr_t base = reinterpret_cast<uintptr_t>(b.data.get());
+            const size_t offset = ((base + b.used + align - 1) & ~uintptr_t(align - 1)) - base;
+            if (offset + bytes <= b.size) {
+                b.used = offset + bytes;
+                return b.data.get() + offset;
+            }
+        }
+        // 已有块都放不下，新开一块（超大请求单独成块）
+        Block b;
+        b.size = std::max(blockSize, bytes + align);
+        b.data.reset(new std::byte[b.size]);
+        blocks.push_back(std::move(b));
+        current = blocks.size() - 1;
+        return allocate(bytes, align);
+    }
+    // 未初始化数组（仅用于平凡类型）
+    template<typename U>
+    U* allocateArray(size_t n) {
+        static_assert(std::is_trivially_destructible_v<U>, "arena arrays must be trivially destructible.");
+        return static_cast<U*>(allocate(sizeof(U) * n, alignof(U)));
+    }
+    template<typename U, typename... Args>
+    U* create(Args&&... args) {
+        U* p = new (allocate(sizeof(U), alignof(U))) U(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<U>)
+            destructors.emplace_back(p, [](void* q) { static_cast<U*>(q)->~U(); });
+        return p;
+    }
+    // 整体释放：析构已登记对象，保留已申请的块供下次构建复用
+    void reset() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) it->second(it->first);
+        destructors.clear();
+        for (auto& b : blocks) b.used = 0;
+        current = 0;
+    }
+    // 彻底归还内存
+    void release() {
+        reset();
+        blocks.clear();
+    }
+    size_t bytesUsed() const {
+        size_t n = 0;
+        for (const auto& b : blocks) n += b.used;
+        return n;
+    }
+    size_t bytesReserved() const {
+        size_t n = 0;
+        for (const auto& b : blocks) n += b.size;
+        return n;
+    }
+};
+#endif
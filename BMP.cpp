@@ -1,7 +1,12 @@
+#ifndef BMP_H
+#define BMP_H
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include "Profiler.hpp"
 namespace BMP {
 #pragma pack(push, 1)  // 确保按字节对齐
 
@@ -42,7 +47,8 @@ struct Pixel {
 #pragma pack(pop) // 恢复对齐方式
 
 // 保存 BMP 文件
-void saveBMP(const std::string& filename, const std::vector<std::vector<Pixel>>& image) {
+inline void saveBMP(const std::string& filename, const std::vector<std::vector<Pixel>>& image) {
+    QE_PROFILE_SCOPE("BMP::saveBMP");
     int width = image[0].size();   // 假设每行宽度相同
     int height = image.size();
 
@@ -78,18 +84,11 @@ void saveBMP(const std::string& filename, const std::vector<std::vector<Pixel>>&
     // 写信息头
     file.write(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
 
-    // 写像素数据
+    // 写像素数据：整行拼好后一次写出（Pixel 已按 BGR 紧凑排列），行尾对齐字节保持为 0
+    std::vector<char> row(rowSize, 0);
     for (int i = height - 1; i >= 0; --i) {
-        for (int j = 0; j < width; ++j) {
-            // 获取像素的 RGB 数据
-            const Pixel& p = image[i][j];
-            file.put(p.blue).put(p.green).put(p.red);
-        }
-
-        // 填充每行的对齐字节
-        for (int j = 0; j < (rowSize - width * 3); ++j) {
-            file.put(0);
-        }
+        std::memcpy(row.data(), image[i].data(), size_t(width) * sizeof(Pixel));
+        file.write(row.data(), rowSize);
     }
 
     file.close();
@@ -97,3 +96,4 @@ void saveBMP(const std::string& filename, const std::vector<std::vector<Pixel>>&
 }
 using BMP::Pixel;
 using BMP::saveBMP;
+#endif
@@ -3,9 +3,16 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <cmath>
 #include <memory>
 #include "Vec3.hpp"
 #include "Ray.hpp"
+#include "Arena.hpp"
+#include "Profiler.hpp"
+#include <optional>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 
 // AABB 包围盒
 template<typename T = float>
@@ -31,15 +38,27 @@ struct AABB {
         expandMin(box.min);
         expandMax(box.max);
     }
+    // 各轴向外扩几个 ulp（按坐标量级），平移到局部空间等舍入后贴着盒面的光线不被剔除；构建时对图元 / 实例盒调用
+    inline void inflate() {
+        for (int i = 0; i < 3; ++i) {
+            const T pad = 4 * std::numeric_limits<T>::epsilon() * std::max(std::abs(min[i]), std::abs(max[i]));
+            min[i] -= pad;
+            max[i] += pad;
+        }
+    }
+    // 板块法。方向分量为 ±0 且起点恰在该轴的面上时 0 × inf = NaN，比较为假即不收紧区间（视为在板内）；
+    // 扁平盒（某轴厚度为 0）t0 == t1，相切也算相交；t1 放宽几个 ulp，避免三角形求交的舍入落在盒外被误剔除
     inline bool intersect(const Ray<T>& ray, T tMin = 0, T tMax = std::numeric_limits<T>::infinity()) const {
+        constexpr T slack = 1 + 4 * std::numeric_limits<T>::epsilon();
         for (int i = 0; i < 3; ++i) {
-            T invD = T(1) / ray.direction[i];
+            const T invD = T(1) / ray.direction[i];
             T t0 = (min[i] - ray.origin[i]) * invD;
             T t1 = (max[i] - ray.origin[i]) * invD;
             if (invD < 0) std::swap(t0, t1);
-            tMin = std::max(t0, tMin);
-            tMax = std::min(t1, tMax);
-            if (tMax <= tMin) return false;
+            t1 *= slack;
+            if (t0 > tMin) tMin = t0;
+            if (t1 < tMax) tMax = t1;
+            if (tMax < tMin) return false;
         }
         return true;
     }
@@ -48,37 +67,86 @@ template<typename T>
 class Object;
 template<typename T>
 struct IndexedTriangle;
+template<typename T>
+struct LODChain;
 
 template<typename T = float>
 class Instance {
 public:
     Object<T>* object;
     Vec3<T> translation;
+    const LODChain<T>* lod = nullptr; // 非空时 object 为其中一级，由 Engine::selectLOD 按相机切换
     Instance(Object<T>* __object, const Vec3<T>& __translation) : object(__object), translation(__translation){}
+    Instance(const LODChain<T>* __lod, const Vec3<T>& __translation);
+};
+template<typename T>
+struct TLASNode;
+// 进程内唯一的构建代数：不同的 BVH 对象之间（包括先后占用同一地址的对象）也不会重复，0 表示尚未构建
+inline uint64_t nextBuildGeneration() {
+    static std::atomic<uint64_t> counter{ 0 };
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+// 遮挡缓存记录：上次挡住某光源的实例叶子、图元，以及对象内部的局部遍历入口
+template<typename T = float>
+struct OccluderHint {
+    const TLASNode<T>* leaf = nullptr; // 实例叶子（TLAS 重建后失效，由持有者负责清空）
+    const void* entry = nullptr;       // 网格为遮挡图元往上几层的 BLASNode
+    uint32_t prim = 0;                 // 遮挡图元
+    uint64_t generation = 0;           // entry / prim 所属 BLAS 的构建代数，BLAS 重建后不再使用
+};
+// 线程安全的按需构建：第一个到达的线程执行构建，其余线程等待其完成；invalidate 之后下次访问重新构建
+class BuildOnce {
+private:
+    std::atomic<bool> ready{ false };
+    std::mutex lock;
+public:
+    template<typename Fn>
+    inline void ensure(Fn&& build) {
+        if (ready.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> guard(lock);
+        if (ready.load(std::memory_order_relaxed)) return;
+        build();
+        ready.store(true, std::memory_order_release);
+    }
+    // 调用方已经同步构建完成（如显式 init）
+    template<typename Fn>
+    void rebuild(Fn&& build) {
+        std::lock_guard<std::mutex> guard(lock);
+        build();
+        ready.store(true, std::memory_order_release);
+    }
+    inline bool isReady() const { return ready.load(std::memory_order_acquire); }
+    inline void invalidate() { ready.store(false, std::memory_order_release); }
 };
 // ================================== BLAS ==================================
 template<typename T = float>
 struct BLASNode {
     AABB<T> box;
-    std::unique_ptr<BLASNode> left;
-    std::unique_ptr<BLASNode> right;
-    std::vector<const Object<T>*> objects; // 叶子节点存三角形索引
+    BLASNode* left = nullptr;
+    BLASNode* right = nullptr;
+    uint32_t first = 0, count = 0; // 叶子节点：图元下标区间 prims[first, first + count)
     inline bool isLeaf() const { return left == nullptr && right == nullptr; }
 };
 
 template<typename T>
 class BLAS {
 private:
+    // 构建期临时数据（全部放在 scratch 里，构建结束整体释放）
+    struct BuildContext {
+        const AABB<T>* boxes;
+        const Vec3<T>* centroids; // 三个顶点坐标之和（只用于比较，省去除以 3）
+    };
     // ================= BLAS 构建 =================
-    std::unique_ptr<BLASNode<T>> __build(const std::vector<Vec3<T>>& points, std::vector<IndexedTriangle<T>>& triangles, std::vector<size_t>& indices, int depth = 0) {
-        auto node = std::make_unique<BLASNode<T>>();
+    // 在 prims[begin, end) 上原地划分，不再为每层递归分配新的下标数组
+    BLASNode<T>* __build(const BuildContext& ctx, uint32_t begin, uint32_t end, int depth = 0) {
+        auto node = arena.create<BLASNode<T>>();
         // 1. 计算包围盒
-        for (auto i : indices)
-            node->box.expand(triangles[i].getAABB());
+        for (uint32_t i = begin; i < end; ++i)
+            node->box.expand(ctx.boxes[prims[i]]);
         // 2. 终止条件
-        if (indices.size() <= 4 || depth > 20) {
-            for (auto i : indices)
-                node->objects.push_back(&triangles[i]);
+        if (end - begin <= 4 || depth > 20) {
+            node->first = begin;
+            node->count = end - begin;
             return node;
         }
         // 3. 选择最长轴排序
@@ -86,25 +154,24 @@ private:
         int axis = 0;
         if (extents.y > extents.x) axis = 1;
         if (extents.z > extents[axis]) axis = 2;
-        auto mid = indices.size() / 2;
-        std::nth_element(indices.begin(), indices.begin() + mid, indices.end(), [&](size_t a, size_t b) {
-            return (points[triangles[a].v0][axis] + points[triangles[a].v1][axis] + points[triangles[a].v2][axis]) < (points[triangles[b].v0][axis] + points[triangles[b].v1][axis] + points[triangles[b].v2][axis]);
+        const uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(prims + begin, prims + mid, prims + end, [&](uint32_t a, uint32_t b) {
+            return ctx.centroids[a][axis] < ctx.centroids[b][axis];
         });
         // 4. 分成两半
-        std::vector<size_t> leftIndices(indices.begin(), indices.begin() + mid);
-        std::vector<size_t> rightIndices(indices.begin() + mid, indices.end());
-        node->left = __build(points, triangles, leftIndices, depth + 1);
-        node->right = __build(points, triangles, rightIndices, depth + 1);
+        node->left = __build(ctx, begin, mid, depth + 1);
+        node->right = __build(ctx, mid, end, depth + 1);
         return node;
     }
     // ================= BLAS 遍历 =================
-    std::optional<HitInfo<T>> __intersect(const Ray<T>& ray, const BLASNode<T>* node) const {
+    template<typename HitFn>
+    std::optional<HitInfo<T>> __intersect(const Ray<T>& ray, const BLASNode<T>* node, HitFn& hitPrim) const {
         if (!node || !node->box.intersect(ray)) return std::nullopt;
         if (node->isLeaf()) {
             std::optional<HitInfo<T>> closestHit;
             T minT = std::numeric_limits<T>::infinity();
-            for (auto obj : node->objects) {
-                auto hit = obj->intersect(ray);
+            for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+                auto hit = hitPrim(prims[i]);
                 if (hit && hit->t < minT) {
                     minT = hit->t;
                     closestHit = hit;
@@ -112,25 +179,104 @@ private:
             }
             return closestHit;
         }
-        auto leftHit = __intersect(ray, node->left.get());
-        auto rightHit = __intersect(ray, node->right.get());
+        auto leftHit = __intersect(ray, node->left, hitPrim);
+        auto rightHit = __intersect(ray, node->right, hitPrim);
         if (leftHit && rightHit)
             return leftHit->t < rightHit->t ? leftHit : rightHit;
         else if (leftHit) return leftHit;
         else return rightHit;
     }
+    // ================= BLAS 遮挡查询（any-hit） =================
+    // record 非空时记下遮挡图元，并在回溯时把入口上移 climb 层
+    template<typename HitFn>
+    bool __occluded(const Ray<T>& ray, const BLASNode<T>* node, T tMax, HitFn& hitPrim, OccluderHint<T>* record, int& climb) const {
+        if (!node || !node->box.intersect(ray, 0, tMax)) return false;
+        if (node->isLeaf()) {
+            for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+                const auto hit = hitPrim(prims[i]);
+                if (hit && hit->t < tMax) { // 任意一个遮挡即可提前返回
+                    if (record) { record->prim = prims[i]; record->entry = node; record->generation = generation; }
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (__occluded(ray, node->left, tMax, hitPrim, record, climb) || __occluded(ray, node->right, tMax, hitPrim, record, climb)) {
+            if (record && climb > 0) { record->entry = node; --climb; }
+            return true;
+        }
+        return false;
+    }
 public:
-    std::unique_ptr<BLASNode<T>> root;
-    BLAS() : root(nullptr) {}
+    BLASNode<T>* root;
+    uint32_t* prims;          // 叶子图元下标，按叶子顺序连续存放
+    size_t primCount;
+    const IndexedTriangle<T>* triangles; // build(points, triangles) 时记录，供 intersect(ray) 使用
+    uint64_t generation = 0;  // 每次构建取新的 nextBuildGeneration()，遮挡缓存据此判断记录是否过期
+    static constexpr int OCCLUDER_ENTRY_LEVELS = 2; // 缓存入口取遮挡叶子往上两层（最多约 16 个图元）
+    Arena arena;              // 节点与图元列表
+    Arena scratch;            // 构建期临时数组
+    BLAS() : root(nullptr), prims(nullptr), primCount(0), triangles(nullptr) {}
     // ================= BLAS 构建 =================
+    // 通用入口：boxOf(i) 给出图元包围盒，centroidOf(i) 给出用于排序的中心（可不归一化）
+    template<typename BoxFn, typename CentroidFn>
+    void build(size_t count, BoxFn&& boxOf, CentroidFn&& centroidOf) {
+        QE_PROFILE_SCOPE("BLAS::build");
+        arena.reset(); // 重建时整体释放旧节点
+        root = nullptr;
+        generation = nextBuildGeneration();
+        primCount = count;
+        prims = arena.allocateArray<uint32_t>(std::max<size_t>(1, count));
+        for (size_t i = 0; i < count; ++i) prims[i] = uint32_t(i);
+        AABB<T>* boxes = scratch.allocateArray<AABB<T>>(std::max<size_t>(1, count));
+        Vec3<T>* centroids = scratch.allocateArray<Vec3<T>>(std::max<size_t>(1, count));
+        for (size_t i = 0; i < count; ++i) {
+            new (boxes + i) AABB<T>(boxOf(i));
+            boxes[i].inflate();
+            new (centroids + i) Vec3<T>(centroidOf(i));
+        }
+        root = __build(BuildContext{ boxes, centroids }, 0, uint32_t(count));
+        scratch.release(); // 临时数组不常驻，直接归还
+    }
     void build(const std::vector<Vec3<T>>& points, std::vector<IndexedTriangle<T>>& triangles) {
-        std::vector<size_t> indices(triangles.size());
-        for (size_t i = 0; i < indices.size(); ++i) indices[i] = i;
-        root = __build(points, triangles, indices);
+        this->triangles = triangles.data();
+        build(triangles.size(),
+              [&](size_t i) { return triangles[i].getAABB(); },
+              [&](size_t i) { return points[triangles[i].v0] + points[triangles[i].v1] + points[triangles[i].v2]; });
+    }
+    template<typename HitFn>
+    inline std::optional<HitInfo<T>> intersect(const Ray<T>& ray, HitFn&& hitPrim) const {
+        return __intersect(ray, root, hitPrim);
     }
     inline std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const {
-        return __intersect(ray, root.get());
+        return intersect(ray, [&](uint32_t i) { return triangles[i].intersect(ray); });
     }
+    // 光线在 (0, tMax) 内是否被任一图元遮挡；hitPrim(i) 返回带 t 的交点
+    template<typename HitFn>
+    inline bool occluded(const Ray<T>& ray, T tMax, HitFn&& hitPrim, OccluderHint<T>* record = nullptr) const {
+        int climb = OCCLUDER_ENTRY_LEVELS;
+        return __occluded(ray, root, tMax, hitPrim, record, climb);
+    }
+    inline bool occluded(const Ray<T>& ray, T tMax, OccluderHint<T>* record = nullptr) const {
+        return occluded(ray, tMax, [&](uint32_t i) { return triangles[i].intersect(ray); }, record);
+    }
+    // 只用缓存记录做局部测试：先测上次的遮挡图元，再遍历缓存的子树入口
+    template<typename HitFn>
+    bool occludedByHint(const Ray<T>& ray, T tMax, HitFn&& hitPrim, OccluderHint<T>& hint) const {
+        if (hint.generation != generation || hint.prim >= primCount) return false;
+        const auto hit = hitPrim(hint.prim);
+        if (hit && hit->t < tMax) return true;
+        if (!hint.entry) return false;
+        OccluderHint<T> found;
+        int climb = 0; // 不改变入口
+        if (!__occluded(ray, static_cast<const BLASNode<T>*>(hint.entry), tMax, hitPrim, &found, climb)) return false;
+        hint.prim = found.prim;
+        return true;
+    }
+    inline bool occludedByHint(const Ray<T>& ray, T tMax, OccluderHint<T>& hint) const {
+        return occludedByHint(ray, tMax, [&](uint32_t i) { return triangles[i].intersect(ray); }, hint);
+    }
+    size_t memoryBytes() const { return arena.bytesReserved() + scratch.bytesReserved(); }
 };
 
 
@@ -138,43 +284,77 @@ public:
 template<typename T = float>
 struct TLASNode {
     AABB<T> box;
-    std::unique_ptr<TLASNode> left;
-    std::unique_ptr<TLASNode> right;
+    TLASNode* left = nullptr;
+    TLASNode* right = nullptr;
     Object<T>* object = nullptr;            // 叶子节点指向对象
+    uint32_t instance = 0;                  // 叶子对应的实例下标（refit、交点的实例编号用）
     Vec3<T> translation = Vec3<T>(0, 0, 0); // 可扩展支持旋转/缩放
     bool isLeaf() const { return left == nullptr && right == nullptr; }
 };
 template<typename T>
 class TLAS {
 public:
-    std::unique_ptr<TLASNode<T>> root;
+    TLASNode<T>* root;
+    Arena arena;   // 节点
+    Arena scratch; // 构建期临时数组
     // 每个 instance: object 指针 + 变换矩阵（这里先简单只做平移）
     TLAS() : root(nullptr) {}
     // ================= TLAS 构建 =================
     void build(const std::vector<Instance<T>>& instances) {
-        std::vector<size_t> indices(instances.size());
-        for (size_t i = 0; i < indices.size(); i++) indices[i] = i;
-        root = __build(instances, indices);
+        QE_PROFILE_SCOPE("TLAS::build");
+        generation = nextBuildGeneration();
+        arena.reset();
+        root = nullptr;
+        if (instances.empty()) return;
+        const size_t n = instances.size();
+        uint32_t* indices = scratch.allocateArray<uint32_t>(n);
+        AABB<T>* boxes = scratch.allocateArray<AABB<T>>(n);
+        for (size_t i = 0; i < n; i++) {
+            indices[i] = uint32_t(i);
+            AABB<T> box = instances[i].object->getAABB(); // 每个 Object 需提供 getAABB()
+            // 平移
+            box.min += instances[i].translation;
+            box.max += instances[i].translation;
+            box.inflate();
+            new (boxes + i) AABB<T>(box);
+        }
+        root = __build(instances, boxes, indices, indices + n);
+        scratch.release(); // 临时数组不常驻，直接归还
     }
     inline std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const {
-        return __intersect(ray, root.get());
+        return __intersect(ray, root);
+    }
+    // 遮挡查询：找到任意一个 t < tMax 的交点即返回，不求最近交点；record 非空时记下遮挡者
+    inline bool occluded(const Ray<T>& ray, T tMax, OccluderHint<T>* record = nullptr) const {
+        return __occluded(ray, root, tMax, record);
+    }
+    // 用缓存的遮挡者做局部测试，不走 TLAS 根
+    inline bool occludedByHint(const Ray<T>& ray, T tMax, OccluderHint<T>& hint) const {
+        if (!hint.leaf) return false;
+        Ray<T> localRay = ray;
+        localRay.origin -= hint.leaf->translation;
+        return hint.leaf->object->occludedByHint(localRay, tMax, hint);
     }
+    // 实例的对象被替换（如切换 LOD）后更新叶子的对象与各级包围盒，不改变树的拓扑
+    void refit(const std::vector<Instance<T>>& instances) {
+        QE_PROFILE_SCOPE("TLAS::refit");
+        generation = nextBuildGeneration(); // 叶子对象变了，遮挡缓存里的 BLAS 记录一并失效
+        if (root) __refit(instances, root);
+    }
+    // 每次构建或 refit 取新的 nextBuildGeneration()（进程内唯一），持有 OccluderHint 的一方据此清空失效的叶子指针
+    uint64_t generation = 0;
+    size_t memoryBytes() const { return arena.bytesReserved() + scratch.bytesReserved(); }
 private:
     // ================= TLAS 构建 =================
-    std::unique_ptr<TLASNode<T>> __build(const std::vector<Instance<T>>& instances, std::vector<size_t>& indices) {
-        auto node = std::make_unique<TLASNode<T>>();
+    TLASNode<T>* __build(const std::vector<Instance<T>>& instances, const AABB<T>* boxes, uint32_t* begin, uint32_t* end) {
+        auto node = arena.create<TLASNode<T>>();
         // 1. 计算 AABB
-        for (auto idx : indices) {
-            AABB<T> box = instances[idx].object->getAABB(); // 每个 Object 需提供 getAABB()
-            // 平移
-            box.min += instances[idx].translation;
-            box.max += instances[idx].translation;
-            node->box.expand(box);
-        }
+        for (auto it = begin; it != end; ++it) node->box.expand(boxes[*it]);
         // 2. 终止条件
-        if (indices.size() == 1) {
-            node->object = instances[indices.front()].object;
-            node->translation = instances[indices.front()].translation;
+        if (end - begin == 1) {
+            node->object = instances[*begin].object;
+            node->instance = *begin;
+            node->translation = instances[*begin].translation;
             return node;
         }
 
@@ -184,39 +364,79 @@ private:
         if (extents.y > extents.x) axis = 1;
         if (extents.z > extents[axis]) axis = 2;
 
-        auto mid = indices.size() / 2;
-        std::nth_element(indices.begin(), indices.begin() + mid, indices.end(), [&](size_t a, size_t b) {
-            return  (instances[a].object->getAABB().min[axis] + instances[a].object->getAABB().max[axis]) * T(0.5) + instances[a].translation[axis]
-                    <
-                    (instances[b].object->getAABB().min[axis] + instances[b].object->getAABB().max[axis]) * T(0.5) + instances[b].translation[axis];
+        auto mid = begin + (end - begin) / 2;
+        std::nth_element(begin, mid, end, [&](uint32_t a, uint32_t b) {
+            return (boxes[a].min[axis] + boxes[a].max[axis]) < (boxes[b].min[axis] + boxes[b].max[axis]);
         });
 
         // 4. 分割
-        std::vector<size_t> leftIndices(indices.begin(), indices.begin() + mid);
-        std::vector<size_t> rightIndices(indices.begin() + mid, indices.end());
-        node->left = __build(instances, leftIndices);
-        node->right = __build(instances, rightIndices);
+        node->left = __build(instances, boxes, begin, mid);
+        node->right = __build(instances, boxes, mid, end);
         return node;
     }
+    void __refit(const std::vector<Instance<T>>& instances, TLASNode<T>* node) {
+        if (node->isLeaf()) {
+            const Instance<T>& ins = instances[node->instance];
+            node->object = ins.object;
+            node->translation = ins.translation;
+            node->box = ins.object->getAABB();
+            node->box.min += ins.translation;
+            node->box.max += ins.translation;
+            node->box.inflate();
+            return;
+        }
+        __refit(instances, node->left);
+        __refit(instances, node->right);
+        node->box = node->left->box;
+        node->box.expand(node->right->box);
+    }
     // ================= TLAS 遍历 =================
     std::optional<HitInfo<T>> __intersect(const Ray<T>& ray, const TLASNode<T>* node) const {
         if (!node || !node->box.intersect(ray)) return std::nullopt;
         if (node->isLeaf()) {
+            node->object->prepare(); // 首条进入该叶子的光线触发 BLAS 构建
             // 将光线变换到对象局部空间
             Ray<T> localRay = ray;
             localRay.origin -= node->translation;
             auto hit = node->object->intersect(localRay);
-            if (hit) hit->position += node->translation; // 转回世界空间
+            if (hit) {
+                hit->position += node->translation; // 转回世界空间
+                hit->instance = node->instance;
+            }
             return hit;
         }
 
-        auto leftHit = __intersect(ray, node->left.get());
-        auto rightHit = __intersect(ray, node->right.get());
+        auto leftHit = __intersect(ray, node->left);
+        auto rightHit = __intersect(ray, node->right);
 
         if (leftHit && rightHit)
             return leftHit->t < rightHit->t ? leftHit : rightHit;
         else if (leftHit) return leftHit;
         else return rightHit;
     }
+    bool __occluded(const Ray<T>& ray, const TLASNode<T>* node, T tMax, OccluderHint<T>* record) const {
+        if (!node || !node->box.intersect(ray, 0, tMax)) return false;
+        if (node->isLeaf()) {
+            node->object->prepare();
+            Ray<T> localRay = ray;
+            localRay.origin -= node->translation;
+            if (!node->object->occluded(localRay, tMax, record)) return false;
+            if (record) record->leaf = node;
+            return true;
+        }
+        return __occluded(ray, node->left, tMax, record) || __occluded(ray, node->right, tMax, record);
+    }
 };
+// 10 位 × 3 轴交织的 Morton 码（输入已量化到 [0, 1023]）
+inline uint32_t mortonExpand10(uint32_t v) {
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+inline uint32_t mortonCode3(uint32_t x, uint32_t y, uint32_t z) {
+    return (mortonExpand10(x) << 2) | (mortonExpand10(y) << 1) | mortonExpand10(z);
+}
 #endif
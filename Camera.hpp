@@ -28,5 +28,14 @@ public:
         const T ndcX = (x + 0.5f) / width - 0.5, ndcY = (y + 0.5f) / height - 0.5;
         return Ray<T>(position, (forward + right * ndcX * tfovw + down * ndcY * tfovh).normalized());
     }
+    // generateRay 的逆：世界坐标点投影到连续像素坐标（像素 (x, y) 覆盖 [x, x+1) × [y, y+1)），在相机后方时返回 false
+    bool project(const Vec3<T>& p, T& x, T& y) const {
+        const Vec3<T> d = p - position;
+        const T z = d.dot(forward);
+        if (z <= T(0)) return false;
+        x = (d.dot(right) / (z * tfovw) + T(0.5)) * width;
+        y = (d.dot(down) / (z * tfovh) + T(0.5)) * height;
+        return true;
+    }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef COMPACTMESH_H
+#define COMPACTMESH_H
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <stdexcept>
+#include "Object.hpp"
+#include "MemoryStats.hpp"
+#include "VertexCompression.hpp"
+/*
+紧凑网格：面向大场景的省内存表示
+    IndexedTriangle 每个三角形约 100 字节（虚表指针、3 个 size_t、edge1/edge2/normal、mesh 与材质指针），
+    TriangleMesh::mp 每个顶点还有一个 std::vector<size_t>。
+    这里每个三角形只存 3 个 uint32_t 索引 + 1 个 uint16_t 材质 id（14 字节），
+    边与法线在求交时现算（只在命中时算法线），顶点邻接用 CSR 压缩且按需构建。
+可选的顶点压缩（quantizePositions / setNormals / setUVs）：
+    位置相对网格包围盒量化为 3 × 16 位（12 -> 6 字节），
+    法线八面体编码为 2 × snorm16（12 -> 4 字节），UV 存为 2 × half（8 -> 4 字节）。
+    量化后所有求交都使用反量化后的顶点，共享顶点反量化结果一致，不会产生裂缝；
+    BVH 包围盒再外扩半个量化步长，保证同时覆盖原始几何与量化几何。
+*/
+enum class VertexStorage {
+    Full,        // Vec3<T>
+    Quantized16  // 相对包围盒的 16 位定点
+};
+template<typename T = float>
+class CompactTriangleMesh : public Object<T> {
+private:
+    bool flagAABB = false;
+    AABB<T> box;
+    std::vector<uint32_t> adjacencyOffsets; // CSR：顶点 v 的三角形为 adjacency[offsets[v], offsets[v + 1])
+    std::vector<uint32_t> adjacency;
+    VertexStorage storage = VertexStorage::Full;
+    std::vector<uint16_t> quantized;  // Quantized16 模式下每顶点 3 个分量
+    Vec3<T> qOrigin, qStep;           // 反量化：qOrigin + q * qStep
+    std::vector<uint32_t> normals;    // 可选，八面体编码的顶点法线
+    std::vector<uint32_t> uvs;        // 可选，half2 顶点 UV
+public:
+    std::vector<Vec3<T>> points;      // Full 模式下的顶点；量化后清空
+    std::vector<uint32_t> indices;               // 每 3 个一组
+    std::vector<uint16_t> materialIds;           // 每个三角形一个，指向 materials
+    std::vector<MaterialSet<T>*> materials;      // 材质表
+    BLAS<T> blas;
+    BuildOnce blasReady;
+    CompactTriangleMesh(std::vector<Vec3<T>> __points = {}) : points(std::move(__points)) {}
+    CompactTriangleMesh(std::vector<Vec3<T>> __points, std::vector<uint32_t> __indices, MaterialSet<T>* materialSet)
+        : points(std::move(__points)), indices(std::move(__indices)) {
+        for (auto idx : indices)
+            if (idx >= points.size()) throw std::runtime_error("triangle index out of range.");
+        materials.push_back(materialSet);
+        materialIds.assign(indices.size() / 3, 0);
+    }
+    inline size_t triangleCount() const { return indices.size() / 3; }
+    inline size_t vertexCount() const { return storage == VertexStorage::Full ? points.size() : quantized.size() / 3; }
+    inline VertexStorage vertexStorage() const { return storage; }
+    inline Vec3<T> vertex(size_t i) const {
+        if (storage == VertexStorage::Full) return points[i];
+        const uint16_t* q = quantized.data() + i * 3;
+        return Vec3<T>(qOrigin.x + T(q[0]) * qStep.x, qOrigin.y + T(q[1]) * qStep.y, qOrigin.z + T(q[2]) * qStep.z);
+    }
+    // ================= 顶点压缩 =================
+    // 位置量化到 16 位并释放全精度顶点（应在 init 之前调用）
+    void quantizePositions() {
+        if (storage == VertexStorage::Quantized16) return;
+        AABB<T> bounds;
+        for (const auto& p : points) bounds.expand(p);
+        qOrigin = points.empty() ? Vec3<T>() : bounds.min;
+        qStep = points.empty() ? Vec3<T>() : (bounds.max - bounds.min) / T(65535);
+        quantized.resize(points.size() * 3);
+        for (size_t i = 0; i < points.size(); ++i)
+            for (int k = 0; k < 3; ++k) quantized[i * 3 + k] = quantizeUnorm16(points[i][k], qOrigin[k], qStep[k]);
+        std::vector<Vec3<T>>().swap(points);
+        storage = VertexStorage::Quantized16;
+        flagAABB = false;
+        blasReady.invalidate();
+    }
+    void dequantizePositions() {
+        if (storage == VertexStorage::Full) return;
+        points.resize(vertexCount());
+        for (size_t i = 0; i < points.size(); ++i) points[i] = vertex(i);
+        std::vector<uint16_t>().swap(quantized);
+        storage = VertexStorage::Full;
+        flagAABB = false;
+        blasReady.invalidate();
+    }
+    void setNormals(const std::vector<Vec3<T>>& vertexNormals) {
+        if (vertexNormals.size() != vertexCount()) throw std::runtime_error("normal count mismatch.");
+        normals.resize(vertexNormals.size());
+        for (size_t i = 0; i < vertexNormals.size(); ++i) normals[i] = octEncode(vertexNormals[i]);
+    }
+    void setUVs(const std::vector<std::pair<T, T>>& vertexUVs) {
+        if (vertexUVs.size() != vertexCount()) throw std::runtime_error("uv count mismatch.");
+        uvs.resize(vertexUVs.size());
+        for (size_t i = 0; i < vertexUVs.size(); ++i) uvs[i] = packHalf2(vertexUVs[i].first, vertexUVs[i].second);
+    }
+    inline bool hasNormals() const { return !normals.empty(); }
+    inline bool hasUVs() const { return !uvs.empty(); }
+    inline Vec3<T> normal(size_t i) const { return octDecode<T>(normals[i]); }
+    inline std::pair<T, T> uv(size_t i) const { return unpackHalf2<T>(uvs[i]); }
+    inline ObjectType getType() const override { return ObjectType::CompactTriangleMesh; }
+    inline AABB<T> getAABB() override {
+        if (flagAABB) return box;
+        box = AABB<T>();
+        for (size_t i = 0; i < vertexCount(); ++i) box.expand(vertex(i));
+        widen(box);
+        flagAABB = true;
+        return box;
+    }
+    // 量化模式下包围盒外扩半个量化步长
+    inline void widen(AABB<T>& b) const {
+        if (storage == VertexStorage::Full) return;
+        b.min -= qStep * T(0.5);
+        b.max += qStep * T(0.5);
+    }
+    uint16_t materialId(MaterialSet<T>* materialSet) {
+        for (size_t i = 0; i < materials.size(); ++i)
+            if (materials[i] == materialSet) return uint16_t(i);
+        if (materials.size() > 0xFFFF) throw std::runtime_error("too many materials in one mesh.");
+        materials.push_back(materialSet);
+        return uint16_t(materials.size() - 1);
+    }
+    // 已设置顶点法线 / UV 时新顶点必须同时给出对应属性，保持各数组与顶点数一致
+    void insertPoint(const Vec3<T>& p, std::optional<Vec3<T>> vertexNormal = std::nullopt, std::optional<std::pair<T, T>> vertexUV = std::nullopt) {
+        if (hasNormals() && !vertexNormal) throw std::runtime_error("insertPoint: mesh has vertex normals, normal required.");
+        if (hasUVs() && !vertexUV) throw std::runtime_error("insertPoint: mesh has vertex UVs, uv required.");
+        dequantizePositions();
+        points.push_back(p);
+        if (hasNormals()) normals.push_back(octEncode(*vertexNormal));
+        if (hasUVs()) uvs.push_back(packHalf2(vertexUV->first, vertexUV->second));
+        flagAABB = false;
+        adjacencyOffsets.clear(); adjacency.clear();
+    }
+    void insertTriangle(uint32_t a, uint32_t b, uint32_t c, MaterialSet<T>* materialSet) {
+        const size_t n = vertexCount();
+        if (a >= n || b >= n || c >= n) throw std::runtime_error("triangle index out of range.");
+        indices.push_back(a); indices.push_back(b); indices.push_back(c);
+        materialIds.push_back(materialId(materialSet));
+        adjacencyOffsets.clear(); adjacency.clear();
+        blasReady.invalidate();
+    }
+    void reserve(size_t pointCount, size_t triangleCount) {
+        points.reserve(pointCount);
+        indices.reserve(triangleCount * 3);
+        materialIds.reserve(triangleCount);
+    }
+    // ================= CSR 顶点邻接 =================
+    void buildAdjacency() {
+        adjacencyOffsets.assign(vertexCount() + 1, 0);
+        for (auto idx : indices) ++adjacencyOffsets[idx + 1];
+        for (size_t v = 0; v < vertexCount(); ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(indices.size());
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) adjacency[cursor[indices[i]]++] = uint32_t(i / 3);
+    }
+    // 返回顶点 v 所属三角形的下标区间
+    std::pair<const uint32_t*, const uint32_t*> trianglesOf(size_t v) {
+        if (adjacencyOffsets.size() != vertexCount() + 1) buildAdjacency();
+        return { adjacency.data() + adjacencyOffsets[v], adjacency.data() + adjacencyOffsets[v + 1] };
+    }
+    // 没有逐三角形的预计算数据，移动顶点只需让包围盒与 BLAS 失效（下次命中时重建）
+    // 量化模式下会以新包围盒整体重新量化，代价为 O(顶点数)
+    void update(size_t idx, const Vec3<T>& p) {
+        const bool wasQuantized = storage == VertexStorage::Quantized16;
+        dequantizePositions();
+        points[idx] = p;
+        flagAABB = false;
+        blasReady.invalidate();
+        if (wasQuantized) quantizePositions();
+    }
+    // ================= 求交 =================
+    inline Vec3<T> faceNormal(size_t tri) const {
+        const Vec3<T> p0 = vertex(indices[tri * 3]);
+        return (vertex(indices[tri * 3 + 1]) - p0).cross(vertex(indices[tri * 3 + 2]) - p0).normalized();
+    }
+    inline AABB<T> triangleAABB(size_t tri) const {
+        AABB<T> b;
+        for (int k = 0; k < 3; ++k) b.expand(vertex(indices[tri * 3 + k]));
+        widen(b);
+        return b;
+    }
+    std::optional<HitInfo<T>> intersectTriangle(const Ray<T>& ray, size_t tri) const {
+        const uint32_t i0 = indices[tri * 3], i1 = indices[tri * 3 + 1], i2 = indices[tri * 3 + 2];
+        const Vec3<T> p0 = vertex(i0);
+        MaterialSet<T>* materialSet = materials[materialIds[tri]];
+        const auto hit = rayTriangle(ray, p0, vertex(i1) - p0, vertex(i2) - p0, materialSet->doubleSided);
+        if (!hit) return std::nullopt;
+        const T w = T(1) - hit->u - hit->v;
+        // 有顶点法线时插值作为着色法线，否则用面法线
+        Vec3<T> n = hasNormals() ? (normal(i0) * w + normal(i1) * hit->u + normal(i2) * hit->v).normalized() : faceNormal(tri);
+        HitInfo<T> info{ hit->t, ray.origin + ray.direction * hit->t, hit->isBack ? -n : n, materialSet, hit->isBack };
+        if (hasUVs()) {
+            const auto uv0 = uv(i0), uv1 = uv(i1), uv2 = uv(i2);
+            info.u = uv0.first * w + uv1.first * hit->u + uv2.first * hit->v;
+            info.v = uv0.second * w + uv1.second * hit->u + uv2.second * hit->v;
+        }
+        return info;
+    }
+    void buildBLAS() {
+        blas.build(triangleCount(),
+                   [&](size_t i) { return triangleAABB(i); },
+                   [&](size_t i) { return vertex(indices[i * 3]) + vertex(indices[i * 3 + 1]) + vertex(indices[i * 3 + 2]); });
+    }
+    // 立即（重新）构建 BLAS；不调用时由 prepare 在首次命中时构建
+    void init() { blasReady.rebuild([this] { buildBLAS(); }); }
+    void prepare() override { blasReady.ensure([this] { buildBLAS(); }); }
+    bool isPrepared() const override { return blasReady.isReady(); }
+    inline std::optional<TriangleHit<T>> hitTriangle(const Ray<T>& ray, uint32_t i) const {
+        const Vec3<T> p0 = vertex(indices[i * 3]);
+        return rayTriangle(ray, p0, vertex(indices[i * 3 + 1]) - p0, vertex(indices[i * 3 + 2]) - p0, materials[materialIds[i]]->doubleSided);
+    }
+    bool occluded(const Ray<T>& ray, T tMax, OccluderHint<T>* record = nullptr) const override {
+        return blas.occluded(ray, tMax, [&](uint32_t i) { return hitTriangle(ray, i); }, record);
+    }
+    bool occludedByHint(const Ray<T>& ray, T tMax, OccluderHint<T>& hint) const override {
+        return blas.occludedByHint(ray, tMax, [&](uint32_t i) { return hitTriangle(ray, i); }, hint);
+    }
+    std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const override {
+        return blas.intersect(ray, [&](uint32_t i) { return intersectTriangle(ray, i); });
+    }
+    size_t primitiveCount() const override { return triangleCount(); }
+    bool primitive(size_t i, Vec3<T>& a, Vec3<T>& b, Vec3<T>& c, bool& doubleSided) const override {
+        a = vertex(indices[i * 3]); b = vertex(indices[i * 3 + 1]); c = vertex(indices[i * 3 + 2]);
+        doubleSided = materials[materialIds[i]]->doubleSided;
+        return true;
+    }
+    std::optional<HitInfo<T>> intersectPrimitive(const Ray<T>& ray, size_t i) const override {
+        return intersectTriangle(ray, i);
+    }
+    void addMemoryStats(MemoryStats& stats) const override {
+        stats.vertices += vectorBytes(points) + vectorBytes(quantized) + vectorBytes(normals) + vectorBytes(uvs);
+        stats.triangles += vectorBytes(indices);
+        stats.materials += vectorBytes(materialIds) + vectorBytes(materials);
+        stats.adjacency += vectorBytes(adjacencyOffsets) + vectorBytes(adjacency);
+        stats.blas += blas.memoryBytes();
+        stats.other += sizeof(*this);
+    }
+};
+#endif
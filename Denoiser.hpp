@@ -0,0 +1,203 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "Vec3.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "ToneMapper.hpp"
+// 辅助输出（AOV）：主光线首个交点的 albedo、法线、距离，以及像素估计值的样本方差（亮度）
+// depth 为 0 表示该像素未命中；variance 为 NaN 表示每像素只有一个样本、无法估计
+template<typename T = float>
+struct AOVBuffer {
+    Framebuffer<T> albedo, normal;
+    std::vector<T> depth, variance;
+    AOVBuffer(size_t __width = 0, size_t __height = 0) { resize(__width, __height); }
+    inline size_t width() const { return albedo.width(); }
+    inline size_t height() const { return albedo.height(); }
+    void resize(size_t __width, size_t __height) {
+        albedo.resize(__width, __height);
+        normal.resize(__width, __height);
+        depth.assign(__width * __height, T(0));
+        variance.assign(__width * __height, T(0));
+    }
+    inline void set(size_t x, size_t y, const Vec3<T>& a, const Vec3<T>& n, T d, T var) {
+        albedo.set(x, y, a);
+        normal.set(x, y, n);
+        depth[y * width() + x] = d;
+        variance[y * width() + x] = var;
+    }
+    inline void clear(size_t x, size_t y) { set(x, y, Vec3<T>(0, 0, 0), Vec3<T>(0, 0, 0), T(0), T(0)); }
+    size_t memoryBytes() const {
+        return albedo.memoryBytes() + normal.memoryBytes() + (depth.capacity() + variance.capacity()) * sizeof(T);
+    }
+};
+
+/*
+边缘感知 à-trous 小波降噪（SVGF 的单帧空间部分），在色调映射之前作用于 HDR：
+    1. 除以 albedo 得到光照（demodulate），滤波后再乘回，纹理与材质边界不被抹平
+    2. 5×5 B3 样条核，第 i 层步长 2^i；每个采样点的权重再乘上
+         法线   max(0, n_p·n_q)^sigmaNormal
+         深度   exp(-|z_p - z_q| / (sigmaDepth · |∇z_p| · 像素距离))
+         亮度   exp(-|l_p - l_q| / (sigmaLuminance · sqrt(3×3 预滤波后的方差)))
+       方差随每层按 w² 传播；AOV 中无法估计的方差先用同一表面上 5×5 邻域的亮度方差代替，噪声越小亮度权重越严格，无噪声区域（只有点光源）基本不动
+未命中像素原样输出，且不参与邻居的加权。
+*/
+template<typename T = float>
+class DenoisePass {
+public:
+    size_t iterations = 3;    // 层数，核半径 2·(2^iterations - 1) 像素
+    T sigmaNormal = 128;
+    T sigmaDepth = 1;
+    T sigmaLuminance = 4;
+    bool demodulate = true;
+    size_t threads = 0;
+    // color 与 out 可以是同一个缓冲
+    void run(const Framebuffer<T>& color, const AOVBuffer<T>& aovs, Framebuffer<T>& out) {
+        QE_PROFILE_SCOPE("DenoisePass::run");
+        w = color.width(); h = color.height();
+        if (aovs.width() != w || aovs.height() != h) throw std::runtime_error("AOV size does not match framebuffer.");
+        const size_t n = w * h;
+        for (int k = 0; k < 2; ++k) { r[k].resize(n); g[k].resize(n); b[k].resize(n); var[k].resize(n); }
+        scale.resize(n * 3);
+        gradient.resize(n);
+        // 1. 拆成 SoA 平面，除以 albedo
+        parallelFor(0, h, [&](size_t y) {
+            for (size_t x = 0; x < w; ++x) {
+                const size_t i = y * w + x;
+                const Vec3<T> c = color.get(x, y), a = aovs.albedo.get(x, y);
+                const T sr = demodulate && a.x > ALBEDO_EPS ? a.x : T(1);
+                const T sg = demodulate && a.y > ALBEDO_EPS ? a.y : T(1);
+                const T sb = demodulate && a.z > ALBEDO_EPS ? a.z : T(1);
+                scale[i * 3] = sr; scale[i * 3 + 1] = sg; scale[i * 3 + 2] = sb;
+                r[0][i] = c.x / sr; g[0][i] = c.y / sg; b[0][i] = c.z / sb;
+                const T L = luminance(sr, sg, sb);
+                var[0][i] = aovs.variance[i] / (L * L);
+            }
+        }, threads, 8);
+        computeDepthGradient(aovs);
+        estimateMissingVariance(aovs);
+        // 2. à-trous 迭代，两组缓冲交替
+        int cur = 0;
+        for (size_t it = 0; it < iterations; ++it, cur ^= 1)
+            atrous(aovs, cur, size_t(1) << it);
+        // 3. 乘回 albedo
+        if (&out != &color) out.resize(w, h);
+        parallelFor(0, h, [&](size_t y) {
+            T* dst = out.row(y);
+            for (size_t x = 0; x < w; ++x) {
+                const size_t i = y * w + x;
+                dst[x * 3] = r[cur][i] * scale[i * 3];
+                dst[x * 3 + 1] = g[cur][i] * scale[i * 3 + 1];
+                dst[x * 3 + 2] = b[cur][i] * scale[i * 3 + 2];
+            }
+        }, threads, 8);
+    }
+private:
+    static constexpr T ALBEDO_EPS = T(1e-3);
+    size_t w = 0, h = 0;
+    std::vector<T> r[2], g[2], b[2], var[2]; // 光照与方差（SoA）
+    std::vector<T> scale;                    // 每像素 demodulate 系数（RGB 交错）
+    std::vector<T> gradient;                 // 每像素深度梯度（两侧差分取小者，避免跨边缘放大）
+    void computeDepthGradient(const AOVBuffer<T>& aovs) {
+        const auto& depth = aovs.depth;
+        parallelFor(0, h, [&](size_t y) {
+            for (size_t x = 0; x < w; ++x) {
+                const size_t i = y * w + x;
+                const T z = depth[i];
+                auto side = [&](bool ok, size_t j) { return ok && depth[j] > 0 ? std::abs(depth[j] - z) : std::numeric_limits<T>::infinity(); };
+                T gx = std::min(side(x > 0, i - 1), side(x + 1 < w, i + 1));
+                T gy = std::min(side(y > 0, i - w), side(y + 1 < h, i + w));
+                if (!std::isfinite(gx)) gx = 0;
+                if (!std::isfinite(gy)) gy = 0;
+                // 正对相机的平面梯度接近 0，保留距离的一个小比例作为下限
+                gradient[i] = std::max({ gx, gy, z * T(1e-3) });
+            }
+        }, threads, 8);
+    }
+    // 邻域亮度的二阶矩减一阶矩平方，只统计法线和深度相近（同一表面）的像素
+    void estimateMissingVariance(const AOVBuffer<T>& aovs) {
+        const auto& depth = aovs.depth;
+        const T* normals = aovs.normal.data();
+        parallelFor(0, h, [&](size_t y) {
+            for (size_t x = 0; x < w; ++x) {
+                const size_t p = y * w + x;
+                if (var[0][p] >= 0) continue;
+                if (!(depth[p] > 0)) { var[0][p] = 0; continue; }
+                T m1 = 0, m2 = 0, count = 0;
+                for (long qy = std::max(0L, long(y) - 2); qy <= std::min(long(h) - 1, long(y) + 2); ++qy)
+                    for (long qx = std::max(0L, long(x) - 2); qx <= std::min(long(w) - 1, long(x) + 2); ++qx) {
+                        const size_t q = size_t(qy) * w + size_t(qx);
+                        if (!(depth[q] > 0) || std::abs(depth[q] - depth[p]) > T(4) * gradient[p] * T(std::abs(qx - long(x)) + std::abs(qy - long(y))) + T(1e-6)) continue;
+                        if (normals[p * 3] * normals[q * 3] + normals[p * 3 + 1] * normals[q * 3 + 1] + normals[p * 3 + 2] * normals[q * 3 + 2] < T(0.9)) continue;
+                        const T L = luminance(r[0][q], g[0][q], b[0][q]);
+                        m1 += L; m2 += L * L; count += 1;
+                    }
+                m1 /= count; m2 /= count;
+                var[0][p] = std::max(T(0), m2 - m1 * m1);
+            }
+        }, threads, 8);
+    }
+    void atrous(const AOVBuffer<T>& aovs, int src, size_t step) {
+        static constexpr T kernel[5] = { T(1) / 16, T(1) / 4, T(3) / 8, T(1) / 4, T(1) / 16 };
+        static constexpr T gauss[3] = { T(1) / 4, T(1) / 2, T(1) / 4 };
+        const int dst = src ^ 1;
+        const auto& depth = aovs.depth;
+        const T* normals = aovs.normal.data();
+        const std::vector<T> &sr = r[src], &sg = g[src], &sb = b[src], &sv = var[src];
+        parallelFor(0, h, [&](size_t y) {
+            for (size_t x = 0; x < w; ++x) {
+                const size_t p = y * w + x;
+                const T zp = depth[p];
+                if (!(zp > 0)) {
+                    r[dst][p] = sr[p]; g[dst][p] = sg[p]; b[dst][p] = sb[p]; var[dst][p] = sv[p];
+                    continue;
+                }
+                // 3×3 高斯预滤波方差，单像素的估计太不稳定
+                T varSum = 0, varWeight = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        const long qx = long(x) + dx, qy = long(y) + dy;
+                        if (qx < 0 || qy < 0 || qx >= long(w) || qy >= long(h)) continue;
+                        const size_t q = size_t(qy) * w + size_t(qx);
+                        if (!(depth[q] > 0)) continue;
+                        const T k = gauss[dx + 1] * gauss[dy + 1];
+                        varSum += k * sv[q]; varWeight += k;
+                    }
+                const T lp = luminance(sr[p], sg[p], sb[p]);
+                const T invSigmaL = T(1) / (sigmaLuminance * std::sqrt(std::max(T(0), varSum / varWeight)) + T(1e-6));
+                const T invSigmaZ = T(1) / (sigmaDepth * gradient[p] * T(step) + T(1e-6));
+                const T npx = normals[p * 3], npy = normals[p * 3 + 1], npz = normals[p * 3 + 2];
+                T sumW = 0, sumR = 0, sumG = 0, sumB = 0, sumV = 0;
+                for (int dy = -2; dy <= 2; ++dy) {
+                    const long qy = long(y) + dy * long(step);
+                    if (qy < 0 || qy >= long(h)) continue;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        const long qx = long(x) + dx * long(step);
+                        if (qx < 0 || qx >= long(w)) continue;
+                        const size_t q = size_t(qy) * w + size_t(qx);
+                        const T zq = depth[q];
+                        if (!(zq > 0)) continue;
+                        const T cosN = std::max(T(0), npx * normals[q * 3] + npy * normals[q * 3 + 1] + npz * normals[q * 3 + 2]);
+                        const T wn = std::pow(cosN, sigmaNormal);
+                        const T wz = std::abs(zp - zq) * invSigmaZ / T(std::abs(dx) + std::abs(dy) + (dx == 0 && dy == 0));
+                        const T wl = std::abs(lp - luminance(sr[q], sg[q], sb[q])) * invSigmaL;
+                        const T weight = kernel[dx + 2] * kernel[dy + 2] * wn * std::exp(-wz - wl);
+                        sumW += weight;
+                        sumR += weight * sr[q]; sumG += weight * sg[q]; sumB += weight * sb[q];
+                        sumV += weight * weight * sv[q];
+                    }
+                }
+                // 中心点权重为核系数本身（各项均为 1），sumW 不会为 0
+                const T inv = T(1) / sumW;
+                r[dst][p] = sumR * inv; g[dst][p] = sumG * inv; b[dst][p] = sumB * inv;
+                var[dst][p] = sumV * inv * inv;
+            }
+        }, threads, 4);
+    }
+};
+#endif
@@ -0,0 +1,332 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+#include <vector>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "RenderServer.hpp"
+/*
+协调者 / worker 分块渲染：
+    worker 各自持有完整场景（本机 fork 共享、或远端进程自行加载同一场景），按图块序号渲染并回传 float 图块；
+    协调者把图块按批租给空闲 worker，组装帧缓冲。租约超时（worker 过慢）或连接断开（worker 死亡）时
+    未完成的图块重新排队给其他 worker，先到的结果生效，重复结果丢弃；超时后仍迟迟不交回的 worker 按死亡处理。
+    worker 回传的长度与图块序号在读取负载之前校验，不符即断开该 worker。
+    每个图块的随机数流只由 (seed, 图块序号) 决定，因此输出与 worker 数量、分配方式无关，与单机 render 逐位一致。
+    辐照度缓存在各 worker 中各自按调度顺序填充，会破坏这一点，设置了 Engine::irradianceCache 的场景不能用于 worker。
+协议（复用 FdConnection）：
+    协调者 -> worker:  JOB id width height spp seed tileSize\n <相机与 sigma 的 13 个 T，二进制>
+                       TILES id i0 i1 ...        渲染这些图块
+                       QUIT
+    worker -> 协调者:  TILE id index bytes\n <float RGB，行主序>
+                       DONE id                   一条 TILES 处理完毕
+*/
+// 相机按原始位模式传输，worker 重建出完全相同的相机
+template<typename T>
+inline std::vector<T> packCamera(const Camera<T>& c, T sigma) {
+    return { c.position.x, c.position.y, c.position.z, c.lookAt.x, c.lookAt.y, c.lookAt.z,
+             c.up.x, c.up.y, c.up.z, c.tfovh, c.tfovw, c.width, sigma };
+}
+template<typename T>
+inline Camera<T> unpackCamera(const std::vector<T>& v, size_t height) {
+    Camera<T> c(Vec3<T>(v[0], v[1], v[2]), Vec3<T>(v[3], v[4], v[5]), Vec3<T>(v[6], v[7], v[8]), T(0), size_t(v[11]), height);
+    c.tfovh = v[9];
+    c.tfovw = v[10];
+    return c;
+}
+inline constexpr size_t CAMERA_PACKED_SIZE = 13;
+
+template<typename T = float>
+class TileWorker {
+private:
+    const Engine<T>& engine;
+    size_t threads;
+public:
+    TileWorker(const Engine<T>& __engine, size_t __threads = 0) : engine(__engine), threads(__threads) {
+        if (engine.irradianceCache) throw std::runtime_error("distributed rendering does not support Engine::irradianceCache.");
+    }
+    void serve(FdConnection& conn) {
+        std::string line;
+        uint64_t job = 0, seed = 0;
+        size_t width = 0, height = 0, tileSize = 64;
+        int spp = 5;
+        std::vector<Tile> tiles;
+        std::unique_ptr<Camera<T>> camera;
+        T sigma = T(0.05);
+        Framebuffer<T> fb;
+        while (conn.readLine(line)) {
+            std::istringstream args(line);
+            std::string cmd;
+            args >> cmd;
+            if (cmd == "JOB") {
+                args >> job >> width >> height >> spp >> seed >> tileSize;
+                std::vector<T> packed(CAMERA_PACKED_SIZE);
+                if (!args || !conn.readExact(packed.data(), packed.size() * sizeof(T))) return;
+                camera = std::make_unique<Camera<T>>(unpackCamera(packed, height));
+                sigma = packed[12];
+                tiles = makeTiles(width, height, tileSize);
+                fb.resize(width, height);
+            } else if (cmd == "TILES") {
+                uint64_t id;
+                args >> id;
+                std::vector<size_t> list;
+                for (size_t idx; args >> idx;)
+                    if (idx < tiles.size()) list.push_back(idx);
+                if (id != job || !camera) { conn.writeLine("DONE " + std::to_string(id)); continue; }
+                std::mutex writeLock;
+                bool connected = true;
+                parallelFor(0, list.size(), [&](size_t k) {
+                    const size_t idx = list[k];
+                    const Tile& tile = tiles[idx];
+                    engine.renderTile(*camera, fb, tile, seed, idx, sigma, spp);
+                    std::vector<float> buf;
+                    buf.reserve(tile.pixelCount() * 3);
+                    for (size_t y = tile.y0; y < tile.y1; ++y)
+                        for (size_t x = tile.x0 * 3; x < tile.x1 * 3; ++x) buf.push_back(float(fb.row(y)[x]));
+                    std::lock_guard<std::mutex> guard(writeLock);
+                    if (connected)
+                        connected = conn.writeLine("TILE " + std::to_string(job) + " " + std::to_string(idx) + " " + std::to_string(buf.size() * sizeof(float)))
+                                    && conn.write(buf.data(), buf.size() * sizeof(float));
+                }, threads);
+                if (!connected || !conn.writeLine("DONE " + std::to_string(id))) return;
+            } else if (cmd == "QUIT") return;
+        }
+    }
+};
+
+template<typename T = float>
+class TileCoordinator {
+public:
+    struct Options {
+        size_t tileSize = 32;
+        size_t batch = 4;          // 每次租出的图块数
+        double initialLease = 30;  // 尚无耗时统计时的租约（秒）
+        double minLease = 1;       // 租约下限（秒）
+        double slowFactor = 4;     // 租约 = slowFactor × 平均单块耗时 × 块数
+        double abandonAfter = 30;  // 租约到期后再等这么久仍未交回 DONE 的 worker 视为卡死并断开（秒）
+    };
+    struct Stats {
+        size_t tilesRendered = 0, tilesReassigned = 0, duplicateTiles = 0, workersLost = 0;
+    };
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Worker {
+        std::unique_ptr<FdConnection> conn;
+        pid_t pid = -1;                 // 本机 fork 出来的 worker，结束时回收
+        bool alive = true;
+        size_t outstanding = 0;         // 已发出、尚未收到 DONE 的 TILES 条数
+        std::vector<size_t> leased;     // 当前帧租给它的、尚未交回的图块
+        size_t leaseCount = 0;          // 最近一次租出的块数
+        Clock::time_point leaseStart, deadline;
+        bool overdue = false;
+    };
+    std::vector<Worker> workers;
+    Options options;
+    Stats stats;
+    uint64_t jobId = 0;
+    double avgTileSeconds = 0; // 指数滑动平均
+    void lose(Worker& w, std::deque<size_t>& pending) {
+        w.alive = false;
+        ++stats.workersLost;
+        for (size_t idx : w.leased) pending.push_front(idx);
+        w.leased.clear();
+        close(w.conn->fd());
+        if (w.pid > 0) { kill(w.pid, SIGKILL); waitpid(w.pid, nullptr, 0); w.pid = -1; }
+    }
+public:
+    explicit TileCoordinator(const Options& __options = Options()) : options(__options) {}
+    TileCoordinator(const TileCoordinator&) = delete;
+    TileCoordinator& operator=(const TileCoordinator&) = delete;
+    ~TileCoordinator() { shutdown(); }
+    void addWorker(int fd, pid_t pid = -1) {
+        Worker w;
+        w.conn = std::make_unique<FdConnection>(fd, fd);
+        w.pid = pid;
+        workers.push_back(std::move(w));
+    }
+    // fork 出 count 个本机 worker，子进程共享（写时复制）已构建好的场景
+    // 调用时不能有其他线程在运行
+    void spawnLocal(const Engine<T>& engine, size_t count, size_t threadsPerWorker = 1) {
+        if (engine.irradianceCache) throw std::runtime_error("distributed rendering does not support Engine::irradianceCache.");
+        for (size_t i = 0; i < count; ++i) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) throw std::runtime_error("socketpair failed.");
+            const pid_t pid = fork();
+            if (pid < 0) throw std::runtime_error("fork failed.");
+            if (pid == 0) {
+                close(fds[0]);
+                for (auto& w : workers) close(w.conn->fd());
+                signal(SIGPIPE, SIG_IGN);
+                FdConnection conn(fds[1], fds[1]);
+                TileWorker<T>(engine, threadsPerWorker).serve(conn);
+                _exit(0);
+            }
+            close(fds[1]);
+            addWorker(fds[0], pid);
+        }
+    }
+    // 等待 count 个远端 worker 连接到 path（worker 端用 connectUnixSocket + TileWorker::serve）
+    void acceptWorkers(const std::string& path, size_t count) {
+        const int server = listenUnixSocket(path);
+        while (count > 0) {
+            const int fd = accept(server, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                close(server);
+                throw std::runtime_error("accept failed.");
+            }
+            addWorker(fd);
+            --count;
+        }
+        close(server);
+    }
+    size_t aliveWorkers() const {
+        return size_t(std::count_if(workers.begin(), workers.end(), [](const Worker& w) { return w.alive; }));
+    }
+    const Stats& getStats() const { return stats; }
+    // 分布式渲染一帧；onTile(tile) 在协调者线程上按到达顺序调用
+    template<typename OnTile>
+    void render(const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed, OnTile&& onTile, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5) {
+        const auto tiles = makeTiles(fb.width(), fb.height(), options.tileSize);
+        const uint64_t job = ++jobId;
+        std::vector<uint8_t> done(tiles.size(), 0);
+        size_t doneCount = 0;
+        std::deque<size_t> pending;
+        for (size_t i = 0; i < tiles.size(); ++i) pending.push_back(i);
+        const auto packed = packCamera(camera, sigma);
+        const std::string header = "JOB " + std::to_string(job) + " " + std::to_string(fb.width()) + " " + std::to_string(fb.height()) + " " +
+                                   std::to_string(TRI_LIGHT_SPP) + " " + std::to_string(seed) + " " + std::to_string(options.tileSize);
+        for (auto& w : workers) {
+            if (!w.alive) continue;
+            w.leased.clear();
+            w.overdue = false;
+            if (!w.conn->writeLine(header) || !w.conn->write(packed.data(), packed.size() * sizeof(T))) lose(w, pending);
+        }
+        std::vector<float> buf;
+        std::vector<pollfd> fds;
+        std::vector<size_t> fdOwner;
+        while (doneCount < tiles.size()) {
+            if (aliveWorkers() == 0) throw std::runtime_error("all render workers lost.");
+            const auto now = Clock::now();
+            // 超时的租约：剩余图块重新排队，worker 保持忙碌直到它自己交回 DONE；再超过 abandonAfter 仍未交回则断开
+            const auto abandon = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.abandonAfter));
+            for (auto& w : workers) {
+                if (!w.alive) continue;
+                if (!w.overdue && !w.leased.empty() && now > w.deadline) {
+                    w.overdue = true;
+                    for (size_t idx : w.leased)
+                        if (!done[idx]) { pending.push_back(idx); ++stats.tilesReassigned; }
+                    w.leased.clear();
+                }
+                if (w.overdue && w.outstanding > 0 && now > w.deadline + abandon) lose(w, pending);
+            }
+            if (aliveWorkers() == 0) throw std::runtime_error("all render workers lost.");
+            // 给空闲 worker 租出新批次
+            for (auto& w : workers) {
+                if (!w.alive || w.outstanding > 0) continue;
+                std::string msg = "TILES " + std::to_string(job);
+                w.leased.clear();
+                while (!pending.empty() && w.leased.size() < options.batch) {
+                    const size_t idx = pending.front();
+                    pending.pop_front();
+                    if (done[idx]) continue;
+                    w.leased.push_back(idx);
+                    msg += " " + std::to_string(idx);
+                }
+                if (w.leased.empty()) continue;
+                const double lease = avgTileSeconds > 0
+                    ? std::max(options.minLease, options.slowFactor * avgTileSeconds * double(w.leased.size())) : options.initialLease;
+                w.leaseCount = w.leased.size();
+                w.leaseStart = now;
+                w.deadline = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(lease));
+                w.overdue = false;
+                if (w.conn->writeLine(msg)) ++w.outstanding;
+                else lose(w, pending);
+            }
+            // 等待任一 worker 有数据，超时用于检查租约
+            fds.clear();
+            fdOwner.clear();
+            bool buffered = false;
+            for (size_t i = 0; i < workers.size(); ++i)
+                if (workers[i].alive) {
+                    fds.push_back(pollfd{ workers[i].conn->fd(), POLLIN, 0 });
+                    fdOwner.push_back(i);
+                    buffered |= workers[i].conn->hasBufferedLine();
+                }
+            if (!buffered && poll(fds.data(), fds.size(), 50) < 0 && errno != EINTR) throw std::runtime_error("poll failed.");
+            for (size_t k = 0; k < fds.size(); ++k) {
+                Worker& w = workers[fdOwner[k]];
+                if (!w.alive || !(fds[k].revents & (POLLIN | POLLHUP | POLLERR) || w.conn->hasBufferedLine())) continue;
+                // 一次读完已到达的所有消息
+                do {
+                    std::string line;
+                    if (!w.conn->readLine(line)) { lose(w, pending); break; }
+                    std::istringstream args(line);
+                    std::string cmd;
+                    uint64_t id = 0;
+                    args >> cmd >> id;
+                    if (cmd == "TILE") {
+                        size_t idx = 0, bytes = 0;
+                        args >> idx >> bytes;
+                        // 长度来自对端，读负载前先校验：本帧的图块须与该块尺寸一致，旧帧的迟到图块只需不超过最大图块
+                        const bool valid = id == job ? idx < tiles.size() && bytes == tiles[idx].pixelCount() * 3 * sizeof(float)
+                                                     : bytes % sizeof(float) == 0 && bytes <= options.tileSize * options.tileSize * 3 * sizeof(float);
+                        if (!args || !valid) { lose(w, pending); break; }
+                        buf.resize(bytes / sizeof(float));
+                        if (!w.conn->readExact(buf.data(), bytes)) { lose(w, pending); break; }
+                        if (id != job || done[idx]) { ++stats.duplicateTiles; continue; }
+                        const Tile& tile = tiles[idx];
+                        const float* src = buf.data();
+                        for (size_t y = tile.y0; y < tile.y1; ++y)
+                            for (size_t x = tile.x0 * 3; x < tile.x1 * 3; ++x) fb.row(y)[x] = T(*src++);
+                        done[idx] = 1;
+                        ++doneCount;
+                        ++stats.tilesRendered;
+                        w.leased.erase(std::remove(w.leased.begin(), w.leased.end(), idx), w.leased.end());
+                        onTile(tile);
+                    } else if (cmd == "DONE") {
+                        if (w.outstanding > 0) --w.outstanding;
+                        if (id == job && !w.overdue) {
+                            const double seconds = std::chrono::duration<double>(Clock::now() - w.leaseStart).count();
+                            const double perTile = seconds / double(std::max<size_t>(1, w.leaseCount));
+                            avgTileSeconds = avgTileSeconds > 0 ? avgTileSeconds * 0.8 + perTile * 0.2 : perTile;
+                        }
+                        // 正常结束时 leased 已被逐块清空；若仍有残留说明 worker 跳过了图块
+                        for (size_t idx : w.leased)
+                            if (!done[idx]) pending.push_back(idx);
+                        w.leased.clear();
+                    }
+                } while (w.alive && w.conn->hasBufferedLine());
+            }
+        }
+    }
+    void render(const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5) {
+        render(camera, fb, seed, [](const Tile&) {}, sigma, TRI_LIGHT_SPP);
+    }
+    void shutdown() {
+        for (auto& w : workers) {
+            if (!w.alive) continue;
+            w.conn->writeLine("QUIT");
+            close(w.conn->fd());
+            if (w.pid > 0) {
+                if (w.outstanding > 0) kill(w.pid, SIGKILL); // 仍卡在旧任务上的 worker 直接结束
+                waitpid(w.pid, nullptr, 0);
+            }
+            w.alive = false;
+        }
+        workers.clear();
+    }
+};
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Vec3.hpp"
+// 图块：像素范围 [x0, x1) × [y0, y1)
+struct Tile {
+    size_t x0, y0, x1, y1;
+    inline size_t width() const { return x1 - x0; }
+    inline size_t height() const { return y1 - y0; }
+    inline size_t pixelCount() const { return width() * height(); }
+};
+// 按行主序切分图块，边缘块自动裁剪
+inline std::vector<Tile> makeTiles(size_t width, size_t height, size_t tileSize = 64) {
+    std::vector<Tile> tiles;
+    tiles.reserve(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+    for (size_t y = 0; y < height; y += tileSize)
+        for (size_t x = 0; x < width; x += tileSize)
+            tiles.push_back(Tile{ x, y, std::min(width, x + tileSize), std::min(height, y + tileSize) });
+    return tiles;
+}
+
+// 连续存储的 HDR 帧缓冲，RGB 交错、行主序、第 0 行为图像顶部
+template<typename T = float>
+class Framebuffer {
+private:
+    size_t w, h;
+    std::vector<T> pixels;
+public:
+    Framebuffer(size_t __width = 0, size_t __height = 0) : w(__width), h(__height), pixels(__width * __height * 3, T(0)) {}
+    inline size_t width() const { return w; }
+    inline size_t height() const { return h; }
+    inline size_t pixelCount() const { return w * h; }
+    inline T* data() { return pixels.data(); }
+    inline const T* data() const { return pixels.data(); }
+    inline T* row(size_t y) { return pixels.data() + y * w * 3; }
+    inline const T* row(size_t y) const { return pixels.data() + y * w * 3; }
+    inline Vec3<T> get(size_t x, size_t y) const {
+        const T* p = pixels.data() + (y * w + x) * 3;
+        return Vec3<T>(p[0], p[1], p[2]);
+    }
+    inline void set(size_t x, size_t y, const Vec3<T>& c) {
+        T* p = pixels.data() + (y * w + x) * 3;
+        p[0] = c.x; p[1] = c.y; p[2] = c.z;
+    }
+    inline void add(size_t x, size_t y, const Vec3<T>& c) {
+        T* p = pixels.data() + (y * w + x) * 3;
+        p[0] += c.x; p[1] += c.y; p[2] += c.z;
+    }
+    void resize(size_t __width, size_t __height) {
+        w = __width; h = __height;
+        pixels.assign(w * h * 3, T(0));
+    }
+    void clear() { std::fill(pixels.begin(), pixels.end(), T(0)); }
+    size_t memoryBytes() const { return pixels.capacity() * sizeof(T); }
+};
+#endif
@@ -0,0 +1,45 @@
+#ifndef HALF_H
+#define HALF_H
+#include <cstdint>
+#include <cstring>
+// IEEE 754 半精度浮点 <-> float（舍入到最近偶数，支持 inf/NaN/非规格化数）
+inline uint16_t floatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t absx = x & 0x7FFFFFFFu;
+    if (absx >= 0x7F800000u) // inf / NaN
+        return uint16_t(sign | 0x7C00u | (absx > 0x7F800000u ? 0x200u : 0u));
+    if (absx >= 0x477FF000u) // 上溢到 inf
+        return uint16_t(sign | 0x7C00u);
+    if (absx < 0x38800000u) { // 非规格化 / 0
+        if (absx < 0x33000000u) return uint16_t(sign);
+        const uint32_t e = absx >> 23;
+        const uint32_t m = (absx & 0x7FFFFFu) | 0x800000u;
+        const uint32_t shift = 126 - e;
+        uint32_t h = m >> shift;
+        const uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1u))) ++h;
+        return uint16_t(sign | h);
+    }
+    uint32_t h = ((absx - 0x38000000u) >> 13);
+    const uint32_t rem = absx & 0x1FFFu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1u))) ++h;
+    return uint16_t(sign | h);
+}
+inline float halfToFloat(uint16_t h) {
+    const uint32_t sign = uint32_t(h & 0x8000u) << 16;
+    uint32_t e = (h >> 10) & 0x1Fu, m = h & 0x3FFu, x;
+    if (e == 0x1F) x = sign | 0x7F800000u | (m << 13);
+    else if (e != 0) x = sign | ((e + 112) << 23) | (m << 13);
+    else if (m == 0) x = sign;
+    else { // 非规格化数，规格化后再组装
+        e = 113;
+        while (!(m & 0x400u)) { m <<= 1; --e; }
+        x = sign | (e << 23) | ((m & 0x3FFu) << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+#endif
@@ -0,0 +1,275 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <type_traits>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include "BMP.cpp"
+#include "Framebuffer.hpp"
+#include "Profiler.hpp"
+/*
+帧缓冲输出：
+    BMP  —— 24 位，按 scale 线性量化（HDR 数据请先色调映射）
+    PFM  —— 32 位浮点 RGB，无损保留 HDR
+    HDR  —— Radiance RGBE，按扫描线做 RLE 压缩
+所有格式都按整行拼好后批量写出；TileStreamWriter 可在图块渲染完成时立即落盘
+*/
+namespace ImageIO {
+enum class ImageFormat {
+    BMP,
+    PFM,
+    HDR
+};
+inline ImageFormat formatFromFilename(const std::string& filename) {
+    const auto dot = filename.find_last_of('.');
+    std::string ext = dot == std::string::npos ? "" : filename.substr(dot + 1);
+    for (auto& ch : ext) ch = char(std::tolower(ch));
+    if (ext == "bmp") return ImageFormat::BMP;
+    if (ext == "pfm") return ImageFormat::PFM;
+    if (ext == "hdr") return ImageFormat::HDR;
+    throw std::runtime_error("unknown image format " + filename);
+}
+
+// ================================== 行编码 ==================================
+inline size_t bmpRowSize(size_t width) { return (width * 3 + 3) / 4 * 4; }
+// 量化为 BGR 8 位（截断，与旧的 toPixel 保持一致）
+template<typename T>
+inline void encodeBMPPixels(const T* src, size_t count, uint8_t* dst, T scale) {
+    for (size_t i = 0; i < count; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            const T v = src[i * 3 + 2 - k] * scale * T(255);
+            dst[i * 3 + k] = uint8_t(std::clamp(int(v), 0, 255));
+        }
+    }
+}
+template<typename T>
+inline void encodePFMPixels(const T* src, size_t count, uint8_t* dst) {
+    if constexpr (std::is_same_v<T, float>) std::memcpy(dst, src, count * 3 * sizeof(float));
+    else for (size_t i = 0; i < count * 3; ++i) {
+        const float v = float(src[i]);
+        std::memcpy(dst + i * sizeof(float), &v, sizeof(float));
+    }
+}
+template<typename T>
+inline void toRGBE(const T* rgb, uint8_t* rgbe) {
+    const T v = std::max({ rgb[0], rgb[1], rgb[2] });
+    if (!(v > T(1e-32))) { rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0; return; }
+    int e;
+    const T m = T(std::frexp(v, &e) * 256.0 / v);
+    for (int k = 0; k < 3; ++k) rgbe[k] = uint8_t(std::max(T(0), rgb[k]) * m);
+    rgbe[3] = uint8_t(e + 128);
+}
+// 单通道 RLE（Radiance 新格式）：长度 >= 4 的重复段编码为游程，其余为字面量
+inline void rleChannel(const uint8_t* data, size_t n, std::vector<uint8_t>& out) {
+    size_t cur = 0;
+    while (cur < n) {
+        size_t begRun = cur, runCount = 0, oldRunCount = 0;
+        while (runCount < 4 && begRun < n) {
+            begRun += runCount;
+            oldRunCount = runCount;
+            runCount = 1;
+            while (begRun + runCount < n && runCount < 127 && data[begRun] == data[begRun + runCount]) ++runCount;
+        }
+        if (oldRunCount > 1 && oldRunCount == begRun - cur) {
+            out.push_back(uint8_t(128 + oldRunCount));
+            out.push_back(data[cur]);
+            cur = begRun;
+        }
+        while (cur < begRun) {
+            const size_t literal = std::min<size_t>(128, begRun - cur);
+            out.push_back(uint8_t(literal));
+            out.insert(out.end(), data + cur, data + cur + literal);
+            cur += literal;
+        }
+        if (runCount >= 4) {
+            out.push_back(uint8_t(128 + runCount));
+            out.push_back(data[begRun]);
+            cur += runCount;
+        }
+    }
+}
+template<typename T>
+inline void encodeHDRRow(const T* src, size_t width, std::vector<uint8_t>& out) {
+    std::vector<uint8_t> rgbe(width * 4);
+    for (size_t i = 0; i < width; ++i) toRGBE(src + i * 3, rgbe.data() + i * 4);
+    if (width < 8 || width > 0x7FFF) { // RLE 只支持这个宽度范围
+        out.insert(out.end(), rgbe.begin(), rgbe.end());
+        return;
+    }
+    out.push_back(2); out.push_back(2);
+    out.push_back(uint8_t(width >> 8)); out.push_back(uint8_t(width & 0xFF));
+    std::vector<uint8_t> channel(width);
+    for (int k = 0; k < 4; ++k) {
+        for (size_t i = 0; i < width; ++i) channel[i] = rgbe[i * 4 + k];
+        rleChannel(channel.data(), width, out);
+    }
+}
+
+// ================================== 文件头 ==================================
+inline std::string bmpHeader(size_t width, size_t height) {
+    BMP::BMPFileHeader fileHeader{};
+    BMP::BMPInfoHeader infoHeader{};
+    const size_t imageSize = bmpRowSize(width) * height;
+    fileHeader.bfType = 0x4D42;
+    fileHeader.bfSize = uint32_t(sizeof(fileHeader) + sizeof(infoHeader) + imageSize);
+    fileHeader.bfOffBits = sizeof(fileHeader) + sizeof(infoHeader);
+    infoHeader.biSize = sizeof(infoHeader);
+    infoHeader.biWidth = int32_t(width);
+    infoHeader.biHeight = int32_t(height);
+    infoHeader.biPlanes = 1;
+    infoHeader.biBitCount = 24;
+    infoHeader.biSizeImage = uint32_t(imageSize);
+    std::string header(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    header.append(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    return header;
+}
+inline std::string pfmHeader(size_t width, size_t height) {
+    return "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n"; // 负数表示小端
+}
+inline std::string hdrHeader(size_t width, size_t height) {
+    return "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+}
+
+// ================================== 整幅写出 ==================================
+template<typename T = float>
+void saveBMP(const std::string& filename, const Framebuffer<T>& fb, T scale = T(1)) {
+    QE_PROFILE_SCOPE("ImageIO::saveBMP");
+    const size_t rowSize = bmpRowSize(fb.width());
+    std::vector<uint8_t> body(rowSize * fb.height(), 0);
+    for (size_t y = 0; y < fb.height(); ++y) // BMP 自底向上
+        encodeBMPPixels(fb.row(y), fb.width(), body.data() + (fb.height() - 1 - y) * rowSize, scale);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    const std::string header = bmpHeader(fb.width(), fb.height());
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(body.data()), body.size());
+}
+template<typename T = float>
+void savePFM(const std::string& filename, const Framebuffer<T>& fb) {
+    QE_PROFILE_SCOPE("ImageIO::savePFM");
+    const size_t rowBytes = fb.width() * 3 * sizeof(float);
+    std::vector<uint8_t> body(rowBytes * fb.height());
+    for (size_t y = 0; y < fb.height(); ++y) // PFM 同样自底向上
+        encodePFMPixels(fb.row(y), fb.width(), body.data() + (fb.height() - 1 - y) * rowBytes);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    const std::string header = pfmHeader(fb.width(), fb.height());
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(body.data()), body.size());
+}
+template<typename T = float>
+void saveHDR(const std::string& filename, const Framebuffer<T>& fb) {
+    QE_PROFILE_SCOPE("ImageIO::saveHDR");
+    std::vector<uint8_t> body;
+    body.reserve(fb.pixelCount() * 2);
+    for (size_t y = 0; y < fb.height(); ++y) encodeHDRRow(fb.row(y), fb.width(), body);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    const std::string header = hdrHeader(fb.width(), fb.height());
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(body.data()), body.size());
+}
+template<typename T = float>
+void save(const std::string& filename, const Framebuffer<T>& fb, T bmpScale = T(1)) {
+    switch (formatFromFilename(filename)) {
+    case ImageFormat::BMP: saveBMP(filename, fb, bmpScale); break;
+    case ImageFormat::PFM: savePFM(filename, fb); break;
+    case ImageFormat::HDR: saveHDR(filename, fb); break;
+    }
+}
+
+// ================================== 流式写出 ==================================
+// 图块完成即写盘：BMP / PFM 行长固定，直接 pwrite 到对应偏移（可多线程并发调用）；
+// HDR 行长可变，只能按行顺序写，凑齐连续的完整扫描线后再压缩写出
+template<typename T = float>
+class TileStreamWriter {
+private:
+    ImageFormat format;
+    size_t width, height;
+    T scale;
+    int fd = -1;
+    size_t headerSize = 0, rowBytes = 0;
+    std::mutex lock;               // 仅 HDR 使用
+    std::vector<size_t> rowFilled; // 每行已写入的像素数
+    std::vector<T> pending;        // 等待按序写出的行数据
+    size_t nextRow = 0;
+    off_t hdrOffset = 0;
+    void writeAll(const void* buf, size_t bytes, off_t offset) {
+        const char* p = static_cast<const char*>(buf);
+        while (bytes > 0) {
+            const ssize_t n = pwrite(fd, p, bytes, offset);
+            if (n <= 0) throw std::runtime_error("failed to write image tile.");
+            p += n; bytes -= size_t(n); offset += n;
+        }
+    }
+public:
+    TileStreamWriter(const std::string& filename, size_t __width, size_t __height, T __scale = T(1))
+        : format(formatFromFilename(filename)), width(__width), height(__height), scale(__scale) {
+        fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        std::string header;
+        switch (format) {
+        case ImageFormat::BMP: header = bmpHeader(width, height); rowBytes = bmpRowSize(width); break;
+        case ImageFormat::PFM: header = pfmHeader(width, height); rowBytes = width * 3 * sizeof(float); break;
+        case ImageFormat::HDR:
+            header = hdrHeader(width, height);
+            rowFilled.assign(height, 0);
+            pending.assign(width * height * 3, T(0));
+            break;
+        }
+        headerSize = header.size();
+        writeAll(header.data(), header.size(), 0);
+        hdrOffset = off_t(headerSize);
+        // 定长格式预先把文件扩到最终大小（对齐字节为 0）
+        if (rowBytes && ftruncate(fd, off_t(headerSize + rowBytes * height)) != 0)
+            throw std::runtime_error("cannot resize " + filename);
+    }
+    TileStreamWriter(const TileStreamWriter&) = delete;
+    TileStreamWriter& operator=(const TileStreamWriter&) = delete;
+    ~TileStreamWriter() { if (fd >= 0) close(fd); }
+    void writeTile(const Framebuffer<T>& fb, const Tile& tile) {
+        QE_PROFILE_SCOPE("TileStreamWriter::writeTile");
+        if (format == ImageFormat::HDR) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t y = tile.y0; y < tile.y1; ++y) {
+                std::copy(fb.row(y) + tile.x0 * 3, fb.row(y) + tile.x1 * 3, pending.data() + (y * width + tile.x0) * 3);
+                rowFilled[y] += tile.width();
+            }
+            std::vector<uint8_t> out;
+            for (; nextRow < height && rowFilled[nextRow] == width; ++nextRow)
+                encodeHDRRow(pending.data() + nextRow * width * 3, width, out);
+            if (!out.empty()) {
+                writeAll(out.data(), out.size(), hdrOffset);
+                hdrOffset += off_t(out.size());
+            }
+            return;
+        }
+        const size_t pixelBytes = format == ImageFormat::BMP ? 3 : 3 * sizeof(float);
+        std::vector<uint8_t> buf(tile.width() * pixelBytes);
+        for (size_t y = tile.y0; y < tile.y1; ++y) {
+            const T* src = fb.row(y) + tile.x0 * 3;
+            if (format == ImageFormat::BMP) encodeBMPPixels(src, tile.width(), buf.data(), scale);
+            else encodePFMPixels(src, tile.width(), buf.data());
+            writeAll(buf.data(), buf.size(), off_t(headerSize + (height - 1 - y) * rowBytes + tile.x0 * pixelBytes));
+        }
+    }
+    // 所有扫描线都已写出时返回 true
+    bool finish() {
+        if (fd < 0) return true;
+        const bool complete = format != ImageFormat::HDR || nextRow == height;
+        close(fd);
+        fd = -1;
+        return complete;
+    }
+};
+}
+#endif
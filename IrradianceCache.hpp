@@ -0,0 +1,211 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <random>
+#include "Vec3.hpp"
+#include "Ray.hpp"
+#include "Consts.hpp"
+/*
+辐照度缓存（Ward 1988 / Ward & Heckbert 1992，含 Křivánek 等人的梯度修正）：漫反射间接光照变化平缓，
+只在稀疏的记录点上用半球采样算辐照度 E，其余着色点由附近记录加权插值。
+    1. 记录：位置 p_i、法线 n_i、E_i、有效半径 R_i（到周围表面距离的调和平均，再按 E / |∇t E| 收紧），
+       以及每个颜色通道的旋转梯度 ∇r、平移梯度 ∇t
+    2. 权重 w_i = 1 / (|p - p_i| / R_i + sqrt(1 - n·n_i))，w_i > 1/accuracy 的记录参与插值；位于着色点前方的记录被排除
+       E(p, n) = Σ w_i (E_i + (n_i × n)·∇r + (p - p_i)·∇t) / Σ w_i
+    3. 没有可用记录时由调用方计算新记录并插入（按需填充）
+存储是定长记录池 + 空间哈希：格子边长 accuracy · maxRadius，恰好覆盖一条记录的影响范围，查询只看周围 27 个格子。
+插入用 fetch_add 分配记录槽，再以 CAS 把记录挂到桶链表头部，查询只做 acquire 读，渲染线程之间无锁共享。
+记录池写满后新算的记录不再插入（仍用于当前着色点）。多线程渲染时记录的生成顺序取决于调度，图像不再逐位可复现。
+*/
+template<typename T = float>
+class IrradianceCache {
+public:
+    struct Record {
+        Vec3<T> position, normal, irradiance;
+        Vec3<T> rotation[3], translation[3]; // 按 r/g/b 通道的旋转、平移梯度
+        T radius = 0;
+        uint64_t cell = 0;                   // 所在格子，用于排除哈希冲突带来的重复访问
+        uint32_t next = EMPTY;
+    };
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+    size_t thetaSamples = 8, phiSamples = 24; // 新记录的分层半球采样数 M × N
+
+    IrradianceCache(size_t __capacity, T __maxRadius, T __minRadius = 0, T __accuracy = T(0.25))
+        : capacity(__capacity), maxRadius(__maxRadius), minRadius(std::min(__minRadius, __maxRadius)), accuracy(__accuracy) {
+        if (capacity == 0 || capacity >= EMPTY) throw std::invalid_argument("IrradianceCache capacity out of range.");
+        if (!(maxRadius > 0) || !(accuracy > 0)) throw std::invalid_argument("IrradianceCache radius and accuracy must be positive.");
+        cellSize = accuracy * maxRadius;
+        size_t buckets = 1;
+        while (buckets < capacity * 2) buckets <<= 1;
+        bucketMask = buckets - 1;
+        records.reset(new Record[capacity]);
+        heads.reset(new std::atomic<uint32_t>[buckets]);
+        clear();
+    }
+    IrradianceCache(const IrradianceCache&) = delete;
+    IrradianceCache& operator=(const IrradianceCache&) = delete;
+
+    inline size_t size() const { return std::min(size_t(count.load(std::memory_order_relaxed)), capacity); }
+    inline bool full() const { return count.load(std::memory_order_relaxed) >= capacity; }
+    // 清空全部记录，调用时不能有并发的查询或插入
+    void clear() {
+        for (size_t b = 0; b <= bucketMask; ++b) heads[b].store(EMPTY, std::memory_order_relaxed);
+        count.store(0, std::memory_order_release);
+    }
+    size_t memoryBytes() const { return capacity * sizeof(Record) + (bucketMask + 1) * sizeof(std::atomic<uint32_t>); }
+
+    // 插值着色点 (position, normal) 的辐照度；没有可用记录时返回 false
+    bool lookup(const Vec3<T>& position, const Vec3<T>& normal, Vec3<T>& irradiance) const {
+        const int64_t cx = cellCoord(position.x), cy = cellCoord(position.y), cz = cellCoord(position.z);
+        Vec3<T> sum(0, 0, 0);
+        T weightSum = 0;
+        for (int64_t dz = -1; dz <= 1; ++dz)
+            for (int64_t dy = -1; dy <= 1; ++dy)
+                for (int64_t dx = -1; dx <= 1; ++dx) {
+                    const uint64_t key = cellKey(cx + dx, cy + dy, cz + dz);
+                    for (uint32_t i = heads[bucket(key)].load(std::memory_order_acquire); i != EMPTY; i = records[i].next) {
+                        const Record& r = records[i];
+                        if (r.cell != key) continue;
+                        const Vec3<T> offset = position - r.position;
+                        // 记录在着色点前方：它看到的半球被着色点所在表面挡住了一部分
+                        if (offset.dot(normal + r.normal) * T(0.5) < T(-0.05) * r.radius) continue;
+                        const T error = offset.length() / r.radius + std::sqrt(std::max(T(0), 1 - normal.dot(r.normal)));
+                        if (error >= accuracy) continue;
+                        const T w = 1 / std::max(error, T(1e-4));
+                        const Vec3<T> axis = r.normal.cross(normal);
+                        sum += w * (r.irradiance + Vec3<T>(axis.dot(r.rotation[0]) + offset.dot(r.translation[0]),
+                                                           axis.dot(r.rotation[1]) + offset.dot(r.translation[1]),
+                                                           axis.dot(r.rotation[2]) + offset.dot(r.translation[2])));
+                        weightSum += w;
+                    }
+                }
+        if (weightSum <= 0) return false;
+        irradiance = sum / weightSum;
+        irradiance = Vec3<T>(std::max(irradiance.x, T(0)), std::max(irradiance.y, T(0)), std::max(irradiance.z, T(0)));
+        return true;
+    }
+    // 在 (position, normal) 处分层采样半球计算一条新记录并插入，返回其辐照度
+    // trace(ray, distance) 返回沿 ray 到达的辐射亮度，并写入交点距离（未命中写 +inf）
+    template<typename URNG, typename Trace>
+    Vec3<T> compute(URNG& rng, const Vec3<T>& position, const Vec3<T>& normal, Trace&& trace) {
+        const size_t M = thetaSamples, N = phiSamples;
+        thread_local std::vector<Vec3<T>> radiance;
+        thread_local std::vector<T> distance, sinTheta, phi;
+        radiance.resize(M * N);
+        distance.resize(M * N);
+        sinTheta.resize(M * N);
+        phi.resize(M * N);
+        std::uniform_real_distribution<T> uniform(0, 1);
+        Vec3<T> tu, tv;
+        tangentFrame(normal, tu, tv);
+        const Vec3<T> origin = position + normal * EPSILON;
+        Record r;
+        r.position = position;
+        r.normal = normal;
+        Vec3<T> E(0, 0, 0);
+        T inverseDistance = 0;
+        // 1. 样本 (j, k)：sin²θ ∈ [j/M, (j+1)/M)，φ ∈ [2πk/N, 2π(k+1)/N)，余弦加权下各层立体角权重相同
+        for (size_t j = 0; j < M; ++j)
+            for (size_t k = 0; k < N; ++k) {
+                const size_t s = j * N + k;
+                const T s2 = (T(j) + uniform(rng)) / T(M);
+                sinTheta[s] = std::sqrt(s2);
+                phi[s] = T(2 * PI) * (T(k) + uniform(rng)) / T(N);
+                const Vec3<T> dir = tu * (std::cos(phi[s]) * sinTheta[s]) + tv * (std::sin(phi[s]) * sinTheta[s]) + normal * std::sqrt(1 - s2);
+                distance[s] = std::numeric_limits<T>::infinity();
+                radiance[s] = trace(Ray<T>(origin, dir), distance[s]);
+                E += radiance[s];
+                inverseDistance += 1 / distance[s];
+            }
+        const T scale = T(PI) / T(M * N);
+        r.irradiance = E * scale;
+        // 2. 旋转梯度：∇r = π/(MN) Σ -tanθ L v(φ)，v(φ) 为基平面内垂直于 φ 的方向
+        Vec3<T> rotation[3] = { Vec3<T>(0, 0, 0), Vec3<T>(0, 0, 0), Vec3<T>(0, 0, 0) };
+        for (size_t s = 0; s < M * N; ++s) {
+            const T cosTheta = std::sqrt(std::max(T(1e-6), 1 - sinTheta[s] * sinTheta[s]));
+            const Vec3<T> v = (tv * std::cos(phi[s]) - tu * std::sin(phi[s])) * (-sinTheta[s] / cosTheta * scale);
+            rotation[0] += v * radiance[s].x;
+            rotation[1] += v * radiance[s].y;
+            rotation[2] += v * radiance[s].z;
+        }
+        // 3. 平移梯度：相邻样本的亮度差乘以分层边界在平移下扫过的（余弦加权）立体角，距离取两侧较近者
+        Vec3<T> translation[3] = { Vec3<T>(0, 0, 0), Vec3<T>(0, 0, 0), Vec3<T>(0, 0, 0) };
+        auto accumulate = [&](const Vec3<T>& dir, const Vec3<T>& diff) {
+            translation[0] += dir * diff.x;
+            translation[1] += dir * diff.y;
+            translation[2] += dir * diff.z;
+        };
+        for (size_t k = 0; k < N; ++k) {
+            const T phiK = T(2 * PI) * (T(k) + T(0.5)) / T(N), phiEdge = T(2 * PI) * T(k) / T(N);
+            const Vec3<T> u = tu * std::cos(phiK) + tv * std::sin(phiK);
+            const Vec3<T> v = tv * std::cos(phiEdge) - tu * std::sin(phiEdge);
+            for (size_t j = 0; j < M; ++j) {
+                const size_t s = j * N + k, left = j * N + (k + N - 1) % N;
+                // θ 方向边界（第 j-1 层与第 j 层之间）
+                if (j > 0) {
+                    const size_t up = s - N;
+                    const T s2 = T(j) / T(M);
+                    const T f = T(2 * PI) / T(N) * std::sqrt(s2) * (1 - s2) / std::min(distance[s], distance[up]);
+                    accumulate(u * f, radiance[s] - radiance[up]);
+                }
+                // φ 方向边界（第 k-1 列与第 k 列之间）
+                const T f = (std::sqrt(T(j + 1) / T(M)) - std::sqrt(T(j) / T(M))) / std::min(distance[s], distance[left]);
+                accumulate(v * f, radiance[s] - radiance[left]);
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            r.rotation[c] = rotation[c];
+            r.translation[c] = translation[c];
+        }
+        // 4. 半径：调和平均距离，再用亮度的平移梯度限制（梯度大的地方插值误差大），最后截到 [minRadius, maxRadius]
+        T radius = inverseDistance > 0 ? T(M * N) / inverseDistance : maxRadius;
+        const T luminance = luma(r.irradiance);
+        const T gradient = (translation[0] * T(0.2126) + translation[1] * T(0.7152) + translation[2] * T(0.0722)).length();
+        if (gradient > 0 && luminance > 0) radius = std::min(radius, luminance / gradient);
+        r.radius = std::clamp(radius, minRadius > 0 ? minRadius : T(1e-4) * maxRadius, maxRadius);
+        insert(r);
+        return r.irradiance;
+    }
+    // 插入一条记录（next、cell 由缓存填写）；记录池已满时返回 false
+    bool insert(Record r) {
+        const uint32_t index = count.fetch_add(1, std::memory_order_relaxed);
+        if (index >= capacity) {
+            count.store(uint32_t(capacity), std::memory_order_relaxed); // 防止计数回绕
+            return false;
+        }
+        r.cell = cellKey(cellCoord(r.position.x), cellCoord(r.position.y), cellCoord(r.position.z));
+        std::atomic<uint32_t>& head = heads[bucket(r.cell)];
+        r.next = head.load(std::memory_order_relaxed);
+        records[index] = r;
+        while (!head.compare_exchange_weak(records[index].next, index, std::memory_order_release, std::memory_order_relaxed)) {}
+        return true;
+    }
+private:
+    const size_t capacity;
+    const T maxRadius, minRadius, accuracy;
+    T cellSize;
+    size_t bucketMask;
+    std::unique_ptr<Record[]> records;
+    std::unique_ptr<std::atomic<uint32_t>[]> heads;
+    std::atomic<uint32_t> count{ 0 };
+
+    inline int64_t cellCoord(T v) const { return int64_t(std::floor(v / cellSize)); }
+    // 每轴取低 21 位拼成 63 位键
+    static inline uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+        constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+        return (uint64_t(x) & mask) | ((uint64_t(y) & mask) << 21) | ((uint64_t(z) & mask) << 42);
+    }
+    inline size_t bucket(uint64_t key) const { return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & bucketMask; }
+    static inline T luma(const Vec3<T>& c) { return T(0.2126) * c.x + T(0.7152) * c.y + T(0.0722) * c.z; }
+    static void tangentFrame(const Vec3<T>& n, Vec3<T>& tu, Vec3<T>& tv) {
+        tu = (std::abs(n.x) > T(0.9) ? Vec3<T>(0, 1, 0) : Vec3<T>(1, 0, 0)).cross(n).normalized();
+        tv = n.cross(tu);
+    }
+};
+#endif
@@ -0,0 +1,338 @@
+#ifndef LOD_H
+#define LOD_H
+#include <vector>
+#include <memory>
+#include <queue>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include "Vec3.hpp"
+#include "Object.hpp"
+#include "Profiler.hpp"
+/*
+二次误差度量（QEM，Garland & Heckbert 1997）网格简化：
+    每个顶点累积相邻三角形平面的面积加权二次型，边折叠代价为新位置到这些平面的加权距离平方和，按代价从小到大贪心折叠；
+    边界边额外加一个垂直平面防止轮廓收缩，会翻转相邻三角形或破坏流形（link condition）的折叠直接跳过。
+输入先按坐标焊接重合顶点（经纬球的接缝、极点），否则接缝会被当成边界。每个三角形保留原来的 MaterialSet。
+误差以对象空间距离给出：原网格各顶点到其所并入顶点周围简化面的最大距离，与折叠点到其平面集合的加权均方根距离取大者。
+前者反映简化面相对原曲面的下陷（凸曲面上 QEM 代价本身几乎为 0），后者反映新顶点偏离原曲面。
+*/
+template<typename T = float>
+class QuadricSimplifier {
+public:
+    explicit QuadricSimplifier(const TriangleMesh<T>& mesh) {
+        QE_PROFILE_SCOPE("QuadricSimplifier::init");
+        // 1. 焊接坐标完全相同的顶点
+        std::vector<uint32_t> remap(mesh.points.size());
+        std::unordered_map<Key, uint32_t, KeyHash> welded;
+        welded.reserve(mesh.points.size());
+        for (size_t i = 0; i < mesh.points.size(); ++i) {
+            const Vec3<T>& p = mesh.points[i];
+            const auto it = welded.emplace(Key{ p.x, p.y, p.z }, uint32_t(positions.size()));
+            if (it.second) positions.push_back(Vec3<double>(p.x, p.y, p.z));
+            remap[i] = it.first->second;
+        }
+        const size_t n = positions.size();
+        original = positions;
+        parent.resize(n);
+        for (uint32_t v = 0; v < n; ++v) parent[v] = v;
+        quadrics.assign(n, Quadric());
+        adjacency.assign(n, {});
+        version.assign(n, 0);
+        removedVertex.assign(n, false);
+        // 2. 三角形与面积加权的平面二次型；焊接后退化的三角形丢弃
+        for (const auto& tri : mesh.triangles) {
+            Face f{ { remap[tri.v0], remap[tri.v1], remap[tri.v2] }, tri.materialSet, false };
+            if (f.v[0] == f.v[1] || f.v[1] == f.v[2] || f.v[0] == f.v[2]) continue;
+            const Vec3<double> cross = (positions[f.v[1]] - positions[f.v[0]]).cross(positions[f.v[2]] - positions[f.v[0]]);
+            const double area2 = cross.length();
+            const uint32_t id = uint32_t(faces.size());
+            faces.push_back(f);
+            for (int k = 0; k < 3; ++k) adjacency[f.v[k]].push_back(id);
+            if (area2 <= 0) continue;
+            const Vec3<double> normal = cross / area2;
+            const Quadric q = Quadric::plane(normal, -normal.dot(positions[f.v[0]]), area2 * 0.5);
+            for (int k = 0; k < 3; ++k) quadrics[f.v[k]] += q;
+        }
+        liveFaces = faces.size();
+        // 3. 边界边：只属于一个三角形的边，加垂直于该三角形、过该边的平面
+        std::unordered_map<uint64_t, uint32_t> edgeUse;
+        edgeUse.reserve(faces.size() * 3);
+        for (const auto& f : faces)
+            for (int k = 0; k < 3; ++k) ++edgeUse[edgeKey(f.v[k], f.v[(k + 1) % 3])];
+        for (const auto& f : faces) {
+            const Vec3<double> faceNormal = (positions[f.v[1]] - positions[f.v[0]]).cross(positions[f.v[2]] - positions[f.v[0]]);
+            if (faceNormal.length() <= 0) continue;
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t a = f.v[k], b = f.v[(k + 1) % 3];
+                if (edgeUse[edgeKey(a, b)] != 1) continue;
+                const Vec3<double> edge = positions[b] - positions[a];
+                Vec3<double> normal = edge.cross(faceNormal);
+                const double len = normal.length();
+                if (len <= 0) continue;
+                normal = normal / len;
+                const Quadric q = Quadric::plane(normal, -normal.dot(positions[a]), BOUNDARY_WEIGHT * edge.lengthSquared());
+                quadrics[a] += q;
+                quadrics[b] += q;
+            }
+        }
+        // 4. 所有边的初始候选
+        for (uint32_t v = 0; v < n; ++v)
+            for (uint32_t u : neighbours(v))
+                if (v < u) pushCandidate(v, u);
+    }
+    inline size_t triangleCount() const { return liveFaces; }
+    // 当前状态相对原网格的几何误差（对象空间距离），O(顶点数 × 平均度数)
+    T error() const {
+        double result = maxError;
+        for (uint32_t v = 0; v < original.size(); ++v) {
+            uint32_t r = v;
+            while (parent[r] != r) r = parent[r];
+            if (r == v || adjacency[r].empty()) continue;
+            double nearest = std::numeric_limits<double>::infinity();
+            for (uint32_t id : adjacency[r]) {
+                const Face& f = faces[id];
+                if (f.removed) continue;
+                const Vec3<double> normal = (positions[f.v[1]] - positions[f.v[0]]).cross(positions[f.v[2]] - positions[f.v[0]]);
+                const double len = normal.length();
+                if (len > 0) nearest = std::min(nearest, std::abs(normal.dot(original[v] - positions[f.v[0]])) / len);
+            }
+            if (std::isfinite(nearest)) result = std::max(result, nearest);
+        }
+        return T(result);
+    }
+    // 持续折叠直到三角形数不超过 target 或没有合法的折叠，返回当前三角形数
+    size_t collapseTo(size_t target) {
+        QE_PROFILE_SCOPE("QuadricSimplifier::collapseTo");
+        while (liveFaces > target && !heap.empty()) {
+            const Candidate c = heap.top();
+            heap.pop();
+            if (removedVertex[c.a] || removedVertex[c.b] || version[c.a] != c.versionA || version[c.b] != c.versionB) continue;
+            if (!canCollapse(c.a, c.b, c.position)) continue;
+            collapse(c.a, c.b, c.position);
+            maxError = std::max(maxError, std::sqrt(std::max(0.0, c.cost) / std::max(quadrics[c.a].weight, 1e-30)));
+        }
+        return liveFaces;
+    }
+    // 以当前状态生成新网格（顶点重新编号，未初始化 BLAS）
+    std::unique_ptr<TriangleMesh<T>> extract() const {
+        std::vector<uint32_t> index(positions.size(), UINT32_MAX);
+        std::vector<Vec3<T>> points;
+        for (const auto& f : faces) {
+            if (f.removed) continue;
+            for (int k = 0; k < 3; ++k)
+                if (index[f.v[k]] == UINT32_MAX) {
+                    index[f.v[k]] = uint32_t(points.size());
+                    const Vec3<double>& p = positions[f.v[k]];
+                    points.emplace_back(T(p.x), T(p.y), T(p.z));
+                }
+        }
+        auto mesh = std::make_unique<TriangleMesh<T>>(std::move(points));
+        mesh->triangles.reserve(liveFaces);
+        for (const auto& f : faces)
+            if (!f.removed) mesh->insertTriangle(index[f.v[0]], index[f.v[1]], index[f.v[2]], f.materialSet);
+        return mesh;
+    }
+private:
+    static constexpr double BOUNDARY_WEIGHT = 100;
+    // 对称 4×4 二次型的上三角 10 项，weight 为累积的面积权重
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0, weight = 0;
+        static Quadric plane(const Vec3<double>& n, double d, double w) {
+            Quadric q;
+            q.a00 = w * n.x * n.x; q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z; q.a03 = w * n.x * d;
+            q.a11 = w * n.y * n.y; q.a12 = w * n.y * n.z; q.a13 = w * n.y * d;
+            q.a22 = w * n.z * n.z; q.a23 = w * n.z * d;
+            q.a33 = w * d * d;
+            q.weight = w;
+            return q;
+        }
+        Quadric& operator+=(const Quadric& o) {
+            a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03; a11 += o.a11; a12 += o.a12; a13 += o.a13;
+            a22 += o.a22; a23 += o.a23; a33 += o.a33; weight += o.weight;
+            return *this;
+        }
+        inline double evaluate(const Vec3<double>& p) const {
+            return a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+                 + a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+                 + a22 * p.z * p.z + 2 * a23 * p.z + a33;
+        }
+        // 使误差最小的位置；矩阵接近奇异时返回 false
+        bool minimize(Vec3<double>& out) const {
+            const double det = a00 * (a11 * a22 - a12 * a12) - a01 * (a01 * a22 - a12 * a02) + a02 * (a01 * a12 - a11 * a02);
+            const double scale = a00 + a11 + a22;
+            if (!(std::abs(det) > 1e-10 * scale * scale * scale)) return false;
+            const double inv = 1 / det;
+            const double bx = -a03, by = -a13, bz = -a23;
+            out.x = inv * (bx * (a11 * a22 - a12 * a12) - a01 * (by * a22 - a12 * bz) + a02 * (by * a12 - a11 * bz));
+            out.y = inv * (a00 * (by * a22 - a12 * bz) - bx * (a01 * a22 - a12 * a02) + a02 * (a01 * bz - by * a02));
+            out.z = inv * (a00 * (a11 * bz - by * a12) - a01 * (a01 * bz - by * a02) + bx * (a01 * a12 - a11 * a02));
+            return true;
+        }
+    };
+    struct Face {
+        uint32_t v[3];
+        MaterialSet<T>* materialSet;
+        bool removed;
+    };
+    struct Candidate {
+        double cost;
+        uint32_t a, b, versionA, versionB;
+        Vec3<double> position;
+        inline bool operator>(const Candidate& o) const { return cost > o.cost; }
+    };
+    struct Key {
+        T x, y, z;
+        inline bool operator==(const Key& o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            const std::hash<T> h;
+            return h(k.x) * 73856093u ^ h(k.y) * 19349663u ^ h(k.z) * 83492791u;
+        }
+    };
+    std::vector<Vec3<double>> positions, original; // original 为焊接后、简化前的坐标
+    std::vector<uint32_t> parent;                  // 折叠去向：b 并入 a 后 parent[b] = a
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<uint32_t>> adjacency; // 顶点 → 相邻三角形（可能含已删除的）
+    std::vector<uint32_t> version;
+    std::vector<bool> removedVertex;
+    std::vector<Face> faces;
+    size_t liveFaces = 0;
+    double maxError = 0;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+
+    static inline uint64_t edgeKey(uint32_t a, uint32_t b) { return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a; }
+    std::vector<uint32_t> neighbours(uint32_t v) const {
+        std::vector<uint32_t> result;
+        for (uint32_t id : adjacency[v]) {
+            const Face& f = faces[id];
+            if (f.removed) continue;
+            for (int k = 0; k < 3; ++k)
+                if (f.v[k] != v) result.push_back(f.v[k]);
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+    void pushCandidate(uint32_t a, uint32_t b) {
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        const Vec3<double> pa = positions[a], pb = positions[b], mid = (pa + pb) * 0.5;
+        Vec3<double> best = mid;
+        double cost = q.evaluate(mid);
+        Vec3<double> opt;
+        // 最优点离边太远（近似平面上的病态解）时不用
+        if (q.minimize(opt) && (opt - mid).lengthSquared() <= (pb - pa).lengthSquared()) {
+            const double c = q.evaluate(opt);
+            if (c < cost) { cost = c; best = opt; }
+        }
+        for (const Vec3<double>& p : { pa, pb }) {
+            const double c = q.evaluate(p);
+            if (c < cost) { cost = c; best = p; }
+        }
+        heap.push(Candidate{ cost, a, b, version[a], version[b], best });
+    }
+    // 流形（两端点的公共邻点恰为共享三角形的对顶点）且相邻三角形法线不翻转
+    bool canCollapse(uint32_t a, uint32_t b, const Vec3<double>& p) const {
+        const auto na = neighbours(a), nb = neighbours(b);
+        size_t common = 0, shared = 0;
+        for (size_t i = 0, j = 0; i < na.size() && j < nb.size();) {
+            if (na[i] < nb[j]) ++i;
+            else if (na[i] > nb[j]) ++j;
+            else { ++common; ++i; ++j; }
+        }
+        for (uint32_t id : adjacency[a]) {
+            const Face& f = faces[id];
+            if (!f.removed && (f.v[0] == b || f.v[1] == b || f.v[2] == b)) ++shared;
+        }
+        if (shared == 0 || common != shared) return false;
+        for (uint32_t v : { a, b })
+            for (uint32_t id : adjacency[v]) {
+                const Face& f = faces[id];
+                if (f.removed) continue;
+                bool hasA = false, hasB = false;
+                for (int k = 0; k < 3; ++k) { hasA |= f.v[k] == a; hasB |= f.v[k] == b; }
+                if (hasA && hasB) continue; // 折叠后删除
+                Vec3<double> before[3], after[3];
+                for (int k = 0; k < 3; ++k) {
+                    before[k] = positions[f.v[k]];
+                    after[k] = f.v[k] == a || f.v[k] == b ? p : before[k];
+                }
+                const Vec3<double> n0 = (before[1] - before[0]).cross(before[2] - before[0]);
+                const Vec3<double> n1 = (after[1] - after[0]).cross(after[2] - after[0]);
+                const double l0 = n0.length(), l1 = n1.length();
+                if (l1 <= 0 || (l0 > 0 && n0.dot(n1) < 0.2 * l0 * l1)) return false;
+            }
+        return true;
+    }
+    void collapse(uint32_t a, uint32_t b, const Vec3<double>& p) {
+        for (uint32_t id : adjacency[b]) {
+            Face& f = faces[id];
+            if (f.removed) continue;
+            if (f.v[0] == a || f.v[1] == a || f.v[2] == a) { f.removed = true; --liveFaces; continue; }
+            for (int k = 0; k < 3; ++k)
+                if (f.v[k] == b) f.v[k] = a;
+            adjacency[a].push_back(id);
+        }
+        // 清掉已删除的三角形，避免邻接表无限增长
+        auto& adj = adjacency[a];
+        adj.erase(std::remove_if(adj.begin(), adj.end(), [&](uint32_t id) { return faces[id].removed; }), adj.end());
+        std::sort(adj.begin(), adj.end());
+        adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+        adjacency[b].clear();
+        adjacency[b].shrink_to_fit();
+        removedVertex[b] = true;
+        parent[b] = a;
+        positions[a] = p;
+        quadrics[a] += quadrics[b];
+        ++version[a]; ++version[b];
+        for (uint32_t u : neighbours(a)) {
+            ++version[u]; // 以 u 为端点的旧候选中，代价依赖 a 的那条已经失效；其余的重新入堆
+            for (uint32_t w : neighbours(u)) pushCandidate(u, w);
+        }
+    }
+};
+
+// 一个网格的 LOD 链：levels[0] 为原网格（不持有），其后每级三角形数按 ratio 递减，各自按需构建 BLAS
+template<typename T = float>
+struct LODChain {
+    std::vector<TriangleMesh<T>*> levels;
+    std::vector<T> errors;  // 各级相对原网格的几何误差（对象空间距离），errors[0] = 0
+    Vec3<T> center;         // 原网格包围球（对象空间），用于估计实例到相机的距离
+    T radius = 0;
+    std::vector<std::unique_ptr<TriangleMesh<T>>> owned;
+
+    LODChain(TriangleMesh<T>* base, size_t maxLevels = 4, T ratio = T(0.5), size_t minTriangles = 32) {
+        QE_PROFILE_SCOPE("LODChain::build");
+        levels.push_back(base);
+        errors.push_back(T(0));
+        const AABB<T> box = base->getAABB();
+        center = (box.min + box.max) * T(0.5);
+        radius = (box.max - box.min).length() * T(0.5);
+        QuadricSimplifier<T> simplifier(*base);
+        size_t current = simplifier.triangleCount();
+        while (levels.size() < maxLevels) {
+            const size_t target = size_t(T(current) * ratio);
+            if (target < minTriangles) break;
+            const size_t reached = simplifier.collapseTo(target);
+            if (reached >= current) break; // 无法再折叠
+            current = reached;
+            owned.push_back(simplifier.extract());
+            levels.push_back(owned.back().get());
+            errors.push_back(simplifier.error());
+        }
+    }
+    // 投影误差（像素）不超过 pixelError 的最粗一级；pixelsPerUnit 为实例所在距离处单位长度对应的像素数
+    size_t select(T pixelsPerUnit, T pixelError) const {
+        size_t level = 0;
+        while (level + 1 < levels.size() && errors[level + 1] * pixelsPerUnit <= pixelError) ++level;
+        return level;
+    }
+};
+template<typename T>
+Instance<T>::Instance(const LODChain<T>* __lod, const Vec3<T>& __translation)
+    : object(__lod->levels[0]), translation(__translation), lod(__lod) {}
+#endif
@@ -0,0 +1,69 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 只读 / 读写内存映射文件（RAII）
+class MappedFile {
+private:
+    int fd = -1;
+    uint8_t* ptr = nullptr;
+    size_t length = 0;
+    void release() {
+        if (ptr) munmap(ptr, length);
+        if (fd >= 0) close(fd);
+        ptr = nullptr; fd = -1; length = 0;
+    }
+public:
+    MappedFile() = default;
+    // writable 且 size > 0 时，文件不存在则创建并扩展到 size 字节
+    explicit MappedFile(const std::string& filename, bool writable = false, size_t size = 0) {
+        fd = open(filename.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        struct stat st;
+        if (fstat(fd, &st) != 0) { release(); throw std::runtime_error("cannot stat " + filename); }
+        length = size_t(st.st_size);
+        if (writable && size > length) {
+            if (ftruncate(fd, off_t(size)) != 0) { release(); throw std::runtime_error("cannot resize " + filename); }
+            length = size;
+        }
+        if (length == 0) return;
+        void* p = mmap(nullptr, length, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { ptr = nullptr; release(); throw std::runtime_error("cannot map " + filename); }
+        ptr = static_cast<uint8_t*>(p);
+        if (!writable) madvise(ptr, length, MADV_SEQUENTIAL);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept : fd(o.fd), ptr(o.ptr), length(o.length) { o.fd = -1; o.ptr = nullptr; o.length = 0; }
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o) {
+            release();
+            fd = o.fd; ptr = o.ptr; length = o.length;
+            o.fd = -1; o.ptr = nullptr; o.length = 0;
+        }
+        return *this;
+    }
+    ~MappedFile() { release(); }
+    inline uint8_t* data() const { return ptr; }
+    inline size_t size() const { return length; }
+    // 异步刷回磁盘，不阻塞调用线程
+    void flushAsync(size_t offset = 0, size_t bytes = 0) const { sync(offset, bytes, MS_ASYNC); }
+    // 同步刷回 [offset, offset + bytes)（bytes 为 0 表示到文件末尾），返回后数据已落盘
+    bool flush(size_t offset = 0, size_t bytes = 0) const { return sync(offset, bytes, MS_SYNC); }
+private:
+    bool sync(size_t offset, size_t bytes, int flags) const {
+        if (!ptr || offset >= length) return true;
+        const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        const size_t begin = offset / page * page;
+        const size_t end = bytes ? std::min(length, offset + bytes) : length;
+        return msync(ptr + begin, end - begin, flags) == 0;
+    }
+};
+#endif
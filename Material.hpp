@@ -24,6 +24,10 @@ public:
         const Vec3<T>& n,       // 法线
         T x, T y
     ) const = 0;
+    // 基础反射色，供降噪的 albedo AOV 使用（光照除以它后再滤波，纹理细节不被抹掉）
+    virtual Vec3<T> getAlbedo(T, T) const { return Vec3<T>(1, 1, 1); }
+    // 朗伯漫反射率（BRDF 的漫反射部分乘以 π），供辐照度缓存的间接光照使用；自发光等材质为 0
+    virtual Vec3<T> getDiffuse(T, T) const { return Vec3<T>(0, 0, 0); }
 };
 
 template<typename T = float>
@@ -43,8 +47,10 @@ public:
         T __sigma = 0.1
     ) : albedo(__albedo), F0(__F0), roughness(__roughness), metalness(__metalness), sigma(__sigma) {}
     MaterialType getType() const override { return MaterialType::CookTorrance; }
+    Vec3<T> getAlbedo(T, T) const override { return albedo; }
+    Vec3<T> getDiffuse(T, T) const override { return (Vec3<T>(1, 1, 1) - F0) * (1 - metalness) * albedo; }
     Vec3<T> getColor(const Vec3<T>& lightColor, const Vec3<T>& l, const Vec3<T>& v, const Vec3<T>& n,
-                    T x, T y) const override {
+                    T, T) const override {
         // 半程向量
         const Vec3<T> h = (l + v).normalized();
         // dot 值
@@ -151,6 +157,12 @@ public:
         metalness(__metalness),
         sigma(__sigma) {}
     MaterialType getType() const override { return MaterialType::CookTorrancePBR; }
+    Vec3<T> getAlbedo(T x, T y) const override { return albedoMap ? albedoMap->sample(x, y) : albedo; }
+    Vec3<T> getDiffuse(T x, T y) const override {
+        const Vec3<T> __F0 = F0Map ? F0Map->sample(x, y) : F0;
+        const T __metalness = metalnessMap ? metalnessMap->sample(x, y).x : metalness;
+        return (Vec3<T>(1, 1, 1) - __F0) * (1 - __metalness) * getAlbedo(x, y);
+    }
 
     Vec3<T> getColor(const Vec3<T>& lightColor, const Vec3<T>& l,
                      const Vec3<T>& v, const Vec3<T>& n,
@@ -208,6 +220,7 @@ public:
         const Vec3<T>& __Color
     ) : Color(__Color) {}
     MaterialType getType() const override { return MaterialType::SelfIllumination; }
+    Vec3<T> getAlbedo(T, T) const override { return Color; }
     // 为了统一化接口冗余设计，希望 -O3 优化掉
     Vec3<T> getColor(const Vec3<T>& lightColor, const Vec3<T>& l, const Vec3<T>& v, const Vec3<T>& n, T x, T y) const override {
         return Color;
@@ -231,6 +244,8 @@ struct HitInfo {
     Vec3<T> normal;   // 法线
     MaterialSet<T>* materialSet = nullptr; // 材质信息
     bool isBack = false;
+    T u = 0, v = 0;   // 纹理坐标（网格无 UV 时为 0）
+    uint32_t instance = ~uint32_t(0); // 所属实例下标（经 TLAS / 可见性缓冲求得时填写），供时间复用校验历史
 };
 /*
 好的 👍，那我来帮你整理一下 **PBR 材质常见参数及物理意义**（和你的 `CookTorranceMaterial` 一一对应）。
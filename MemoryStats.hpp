@@ -0,0 +1,37 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+#include <string>
+#include <vector>
+#include <cstddef>
+// 按子系统统计的内存占用（字节，按容量而非 size 计）
+struct MemoryStats {
+    size_t vertices = 0;    // 顶点坐标（含量化 / 属性数据）
+    size_t triangles = 0;   // 三角形索引与预计算数据
+    size_t adjacency = 0;   // 顶点 -> 三角形邻接
+    size_t materials = 0;   // 材质 id / 材质表
+    size_t blas = 0;        // 各网格的 BLAS（节点 + 图元列表）
+    size_t tlas = 0;
+    size_t instances = 0;
+    size_t lights = 0;
+    size_t scene = 0;       // Engine::make 创建的场景对象
+    size_t other = 0;
+    size_t total() const {
+        return vertices + triangles + adjacency + materials + blas + tlas + instances + lights + scene + other;
+    }
+    MemoryStats& operator+=(const MemoryStats& o) {
+        vertices += o.vertices; triangles += o.triangles; adjacency += o.adjacency; materials += o.materials;
+        blas += o.blas; tlas += o.tlas; instances += o.instances; lights += o.lights; scene += o.scene; other += o.other;
+        return *this;
+    }
+    std::string toJSON() const {
+        auto field = [](const char* name, size_t v) { return std::string("\"") + name + "\": " + std::to_string(v); };
+        return "{" + field("vertices", vertices) + ", " + field("triangles", triangles) + ", " +
+               field("adjacency", adjacency) + ", " + field("materials", materials) + ", " +
+               field("blas", blas) + ", " + field("tlas", tlas) + ", " + field("instances", instances) + ", " +
+               field("lights", lights) + ", " + field("scene", scene) + ", " + field("other", other) + ", " +
+               field("total", total()) + "}";
+    }
+};
+template<typename U>
+inline size_t vectorBytes(const std::vector<U>& v) { return v.capacity() * sizeof(U); }
+#endif
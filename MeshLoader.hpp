@@ -0,0 +1,398 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "Vec3.hpp"
+#include "Object.hpp"
+#include "CompactMesh.hpp"
+#include "Parallel.hpp"
+#include "MappedFile.hpp"
+/*
+网格加载：
+    OBJ    —— 内存映射后按换行切块，多线程解析，再按前缀和合并
+    PLY    —— 仅支持 binary_little_endian / binary_big_endian，定长记录直接并行解码
+    QMESH  —— 自定义二进制格式（.qmesh）：头 + float xyz[] + uint32 index[]，重新加载几乎就是 memcpy
+索引统一为 uint32，顶点数超过 2^32 的网格直接拒绝
+结果统一放在 MeshData 里，再一次性构造 TriangleMesh（预留容量，不走逐个 insertTriangle）
+*/
+template<typename T = float>
+struct MeshData {
+    std::vector<Vec3<T>> points;
+    std::vector<uint32_t> indices; // 每 3 个一组
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+namespace MeshLoader {
+constexpr size_t MAX_POINTS = size_t(UINT32_MAX) + 1; // uint32 索引可寻址的顶点数
+// ================================== OBJ ==================================
+namespace detail {
+    inline const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        return p;
+    }
+    inline const char* nextLine(const char* p, const char* end) {
+        const void* nl = std::memchr(p, '\n', size_t(end - p));
+        return nl ? static_cast<const char*>(nl) + 1 : end;
+    }
+    template<typename T>
+    struct ObjChunk {
+        std::vector<Vec3<T>> points;
+        std::vector<int64_t> indices; // 原始索引（1 起，负数为相对索引），合并时再解析
+        std::vector<uint64_t> faceVertexBase; // 每个三角形所在行之前本块已读的顶点数
+    };
+    template<typename T>
+    void parseObjChunk(const char* p, const char* end, ObjChunk<T>& out) {
+        std::vector<int64_t> face; // 多边形顶点数不设上限
+        while (p < end) {
+            const char* lineEnd = nextLine(p, end);
+            const char* q = skipSpaces(p, lineEnd);
+            if (q + 1 < lineEnd && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t')) {
+                T xyz[3] = { 0, 0, 0 };
+                q += 2;
+                for (int k = 0; k < 3; ++k) {
+                    q = skipSpaces(q, lineEnd);
+                    if (q < lineEnd && *q == '+') ++q;
+                    float value = 0;
+                    auto res = std::from_chars(q, lineEnd, value);
+                    if (res.ec != std::errc()) throw std::runtime_error("bad OBJ vertex.");
+                    xyz[k] = T(value);
+                    q = res.ptr;
+                }
+                out.points.emplace_back(xyz[0], xyz[1], xyz[2]);
+            } else if (q + 1 < lineEnd && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t')) {
+                face.clear();
+                q += 2;
+                for (;;) {
+                    q = skipSpaces(q, lineEnd);
+                    if (q >= lineEnd || *q == '\n' || *q == '#') break;
+                    int64_t idx = 0;
+                    auto res = std::from_chars(q, lineEnd, idx);
+                    if (res.ec != std::errc() || idx == 0) throw std::runtime_error("bad OBJ face.");
+                    face.push_back(idx);
+                    q = res.ptr;
+                    while (q < lineEnd && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') ++q; // 跳过 /vt/vn
+                }
+                // 多边形按扇形三角化
+                for (size_t k = 2; k < face.size(); ++k) {
+                    out.indices.push_back(face[0]);
+                    out.indices.push_back(face[k - 1]);
+                    out.indices.push_back(face[k]);
+                    out.faceVertexBase.push_back(out.points.size());
+                }
+            }
+            p = lineEnd;
+        }
+    }
+}
+template<typename T = float>
+MeshData<T> loadOBJ(const std::string& filename, size_t threads = 0) {
+    MappedFile file(filename);
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+    if (threads == 0) threads = defaultThreadCount();
+    // 1. 切块：边界对齐到下一行开头
+    const size_t chunkCount = std::max<size_t>(1, std::min(threads * 4, file.size() / (1 << 20) + 1));
+    std::vector<const char*> bounds(chunkCount + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        const char* p = std::max(begin + file.size() * i / chunkCount, bounds[i - 1]);
+        bounds[i] = p == begin ? p : detail::nextLine(p - 1, end);
+    }
+    // 2. 并行解析
+    std::vector<detail::ObjChunk<T>> chunks(chunkCount);
+    parallelFor(0, chunkCount, [&](size_t i) { detail::parseObjChunk(bounds[i], bounds[i + 1], chunks[i]); }, threads);
+    // 3. 前缀和，得到每块的顶点 / 索引偏移
+    std::vector<size_t> pointOffset(chunkCount + 1, 0), indexOffset(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        pointOffset[i + 1] = pointOffset[i] + chunks[i].points.size();
+        indexOffset[i + 1] = indexOffset[i] + chunks[i].indices.size();
+    }
+    if (pointOffset[chunkCount] > MAX_POINTS) throw std::runtime_error("OBJ has too many vertices for 32-bit indices.");
+    MeshData<T> mesh;
+    mesh.points.resize(pointOffset[chunkCount]);
+    mesh.indices.resize(indexOffset[chunkCount]);
+    const int64_t pointCount = int64_t(mesh.points.size());
+    // 4. 并行合并，同时解析负索引
+    parallelFor(0, chunkCount, [&](size_t i) {
+        auto& chunk = chunks[i];
+        std::copy(chunk.points.begin(), chunk.points.end(), mesh.points.begin() + pointOffset[i]);
+        for (size_t k = 0; k < chunk.indices.size(); ++k) {
+            const int64_t raw = chunk.indices[k];
+            const int64_t idx = raw > 0 ? raw - 1 : int64_t(pointOffset[i] + chunk.faceVertexBase[k / 3]) + raw;
+            if (idx < 0 || idx >= pointCount) throw std::runtime_error("OBJ index out of range.");
+            mesh.indices[indexOffset[i] + k] = uint32_t(idx);
+        }
+        std::vector<Vec3<T>>().swap(chunk.points); // 尽早释放
+    }, threads);
+    return mesh;
+}
+
+// ================================== PLY ==================================
+namespace detail {
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+    inline PlyType plyType(const std::string& s) {
+        if (s == "char" || s == "int8") return PlyType::Int8;
+        if (s == "uchar" || s == "uint8") return PlyType::UInt8;
+        if (s == "short" || s == "int16") return PlyType::Int16;
+        if (s == "ushort" || s == "uint16") return PlyType::UInt16;
+        if (s == "int" || s == "int32") return PlyType::Int32;
+        if (s == "uint" || s == "uint32") return PlyType::UInt32;
+        if (s == "float" || s == "float32") return PlyType::Float32;
+        if (s == "double" || s == "float64") return PlyType::Float64;
+        throw std::runtime_error("unknown PLY type " + s);
+    }
+    inline size_t plySize(PlyType t) {
+        switch (t) {
+        case PlyType::Int8: case PlyType::UInt8: return 1;
+        case PlyType::Int16: case PlyType::UInt16: return 2;
+        case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+        case PlyType::Float64: return 8;
+        }
+        return 0;
+    }
+    inline double plyRead(const uint8_t* p, PlyType t, bool swap) {
+        uint8_t b[8];
+        const size_t n = plySize(t);
+        for (size_t i = 0; i < n; ++i) b[i] = swap ? p[n - 1 - i] : p[i];
+        switch (t) {
+        case PlyType::Int8: return double(int8_t(b[0]));
+        case PlyType::UInt8: return double(b[0]);
+        case PlyType::Int16: { int16_t v; std::memcpy(&v, b, 2); return v; }
+        case PlyType::UInt16: { uint16_t v; std::memcpy(&v, b, 2); return v; }
+        case PlyType::Int32: { int32_t v; std::memcpy(&v, b, 4); return v; }
+        case PlyType::UInt32: { uint32_t v; std::memcpy(&v, b, 4); return v; }
+        case PlyType::Float32: { float v; std::memcpy(&v, b, 4); return v; }
+        case PlyType::Float64: { double v; std::memcpy(&v, b, 8); return v; }
+        }
+        return 0;
+    }
+    // 浮点转 uint32 前先检查范围（越界转换是未定义行为）
+    inline uint32_t plyIndex(double v) {
+        if (!(v >= 0 && v <= double(UINT32_MAX))) throw std::runtime_error("PLY index out of range.");
+        return uint32_t(v);
+    }
+    struct PlyProperty {
+        std::string name;
+        bool isList = false;
+        PlyType countType = PlyType::UInt8, type = PlyType::Float32;
+    };
+    struct PlyElement {
+        std::string name;
+        size_t count = 0;
+        std::vector<PlyProperty> properties;
+    };
+}
+template<typename T = float>
+MeshData<T> loadPLY(const std::string& filename, size_t threads = 0) {
+    using namespace detail;
+    MappedFile file(filename);
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const char* headerEnd = file.size() ? static_cast<const char*>(memmem(text, file.size(), "end_header", 10)) : nullptr;
+    if (!headerEnd || file.size() < 3 || std::strncmp(text, "ply", 3) != 0) throw std::runtime_error("invalid PLY " + filename);
+    // 1. 解析文本头
+    std::istringstream header(std::string(text, headerEnd));
+    std::vector<PlyElement> elements;
+    bool swap = false;
+    std::string line;
+    while (std::getline(header, line)) {
+        std::istringstream ls(line);
+        std::string word;
+        ls >> word;
+        if (word == "format") {
+            std::string fmt;
+            ls >> fmt;
+            if (fmt == "ascii") throw std::runtime_error("ASCII PLY is not supported.");
+            swap = (fmt == "binary_big_endian");
+        } else if (word == "element") {
+            PlyElement e;
+            ls >> e.name >> e.count;
+            elements.push_back(e);
+        } else if (word == "property" && !elements.empty()) {
+            PlyProperty prop;
+            std::string type;
+            ls >> type;
+            if (type == "list") {
+                std::string countType, itemType;
+                ls >> countType >> itemType;
+                prop.isList = true;
+                prop.countType = plyType(countType);
+                prop.type = plyType(itemType);
+            } else prop.type = plyType(type);
+            ls >> prop.name;
+            elements.back().properties.push_back(prop);
+        }
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(detail::nextLine(headerEnd, text + file.size()));
+    const uint8_t* end = file.data() + file.size();
+    MeshData<T> mesh;
+    if (threads == 0) threads = defaultThreadCount();
+    for (const auto& e : elements) {
+        if (e.name == "vertex") {
+            // 顶点记录定长，直接按下标并行解码
+            size_t stride = 0, offset[3] = { 0, 0, 0 };
+            PlyType type[3] = { PlyType::Float32, PlyType::Float32, PlyType::Float32 };
+            for (const auto& prop : e.properties) {
+                if (prop.isList) throw std::runtime_error("list property in PLY vertex is not supported.");
+                for (int k = 0; k < 3; ++k)
+                    if (prop.name == std::string(1, char('x' + k))) { offset[k] = stride; type[k] = prop.type; }
+                stride += plySize(prop.type);
+            }
+            if (e.count > MAX_POINTS) throw std::runtime_error("PLY has too many vertices for 32-bit indices.");
+            if (stride == 0 || size_t(end - p) / stride < e.count) throw std::runtime_error("truncated PLY vertices.");
+            mesh.points.resize(e.count);
+            parallelFor(0, e.count, [&](size_t i) {
+                const uint8_t* rec = p + i * stride;
+                mesh.points[i] = Vec3<T>(T(plyRead(rec + offset[0], type[0], swap)),
+                                         T(plyRead(rec + offset[1], type[1], swap)),
+                                         T(plyRead(rec + offset[2], type[2], swap)));
+            }, threads, 4096);
+            p += stride * e.count;
+        } else if (e.name == "face") {
+            // 先假设全部为三角形（定长记录）并行校验，成立则并行解码，否则顺序扫描
+            size_t fixedStride = 0, listOffset = 0;
+            const PlyProperty* list = nullptr;
+            for (const auto& prop : e.properties) {
+                if (prop.isList && (prop.name == "vertex_indices" || prop.name == "vertex_index")) {
+                    list = &prop; listOffset = fixedStride;
+                    fixedStride += plySize(prop.countType) + 3 * plySize(prop.type);
+                } else if (prop.isList) { fixedStride = 0; break; }
+                else fixedStride += plySize(prop.type);
+            }
+            if (!list) throw std::runtime_error("PLY face has no vertex_indices.");
+            const size_t countSize = plySize(list->countType), itemSize = plySize(list->type);
+            std::atomic<bool> allTriangles(fixedStride != 0 && size_t(end - p) >= fixedStride * e.count);
+            if (allTriangles)
+                parallelFor(0, e.count, [&](size_t i) {
+                    if (plyRead(p + i * fixedStride + listOffset, list->countType, swap) != 3) allTriangles = false;
+                }, threads, 4096);
+            if (allTriangles) {
+                mesh.indices.resize(e.count * 3);
+                parallelFor(0, e.count, [&](size_t i) {
+                    const uint8_t* rec = p + i * fixedStride + listOffset + countSize;
+                    for (int k = 0; k < 3; ++k)
+                        mesh.indices[i * 3 + k] = plyIndex(plyRead(rec + k * itemSize, list->type, swap));
+                }, threads, 4096);
+                p += fixedStride * e.count;
+            } else {
+                mesh.indices.reserve(e.count * 3);
+                for (size_t i = 0; i < e.count; ++i) {
+                    for (const auto& prop : e.properties) {
+                        if (!prop.isList) { p += plySize(prop.type); continue; }
+                        if (p + plySize(prop.countType) > end) throw std::runtime_error("truncated PLY faces.");
+                        const size_t n = size_t(plyRead(p, prop.countType, swap));
+                        p += plySize(prop.countType);
+                        if (p + n * plySize(prop.type) > end) throw std::runtime_error("truncated PLY faces.");
+                        if (&prop == list)
+                            for (size_t k = 2; k < n; ++k) {
+                                mesh.indices.push_back(plyIndex(plyRead(p, prop.type, swap)));
+                                mesh.indices.push_back(plyIndex(plyRead(p + (k - 1) * itemSize, prop.type, swap)));
+                                mesh.indices.push_back(plyIndex(plyRead(p + k * itemSize, prop.type, swap)));
+                            }
+                        p += n * plySize(prop.type);
+                    }
+                }
+            }
+        } else {
+            // 其他元素只能在全部属性定长时跳过
+            size_t stride = 0;
+            for (const auto& prop : e.properties) {
+                if (prop.isList) throw std::runtime_error("cannot skip PLY element " + e.name);
+                stride += plySize(prop.type);
+            }
+            p += stride * e.count;
+        }
+    }
+    for (auto idx : mesh.indices)
+        if (idx >= mesh.points.size()) throw std::runtime_error("PLY index out of range.");
+    return mesh;
+}
+
+// ================================== QMESH ==================================
+#pragma pack(push, 1)
+struct QMeshHeader {
+    uint32_t magic;         // 'QMS1'
+    uint32_t version;
+    uint64_t pointCount;
+    uint64_t triangleCount;
+};
+#pragma pack(pop)
+constexpr uint32_t QMESH_MAGIC = 0x31534D51; // "QMS1"
+
+template<typename T = float>
+void saveQMesh(const std::string& filename, const MeshData<T>& mesh) {
+    if (mesh.points.size() > MAX_POINTS) throw std::runtime_error("too many vertices for 32-bit indices.");
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    QMeshHeader header{ QMESH_MAGIC, 1, mesh.points.size(), mesh.triangleCount() };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::vector<float> xyz(mesh.points.size() * 3);
+    for (size_t i = 0; i < mesh.points.size(); ++i)
+        for (int k = 0; k < 3; ++k) xyz[i * 3 + k] = float(mesh.points[i][k]);
+    file.write(reinterpret_cast<const char*>(xyz.data()), xyz.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(mesh.indices.data()), header.triangleCount * 3 * sizeof(uint32_t));
+}
+template<typename T = float>
+MeshData<T> loadQMesh(const std::string& filename, size_t threads = 0) {
+    MappedFile file(filename);
+    QMeshHeader header;
+    if (file.size() < sizeof(header)) throw std::runtime_error("invalid QMESH " + filename);
+    std::memcpy(&header, file.data(), sizeof(header));
+    // 头里的数量不可信：先按文件剩余字节数约束，再算各段大小，避免乘法溢出
+    constexpr size_t pointSize = 3 * sizeof(float), triangleSize = 3 * sizeof(uint32_t);
+    const size_t payload = file.size() - sizeof(header);
+    if (header.magic != QMESH_MAGIC || header.pointCount > MAX_POINTS || header.pointCount > payload / pointSize ||
+        header.triangleCount > (payload - header.pointCount * pointSize) / triangleSize)
+        throw std::runtime_error("invalid QMESH " + filename);
+    const size_t pointBytes = header.pointCount * pointSize, indexBytes = header.triangleCount * triangleSize;
+    const uint8_t* xyz = file.data() + sizeof(header);
+    MeshData<T> mesh;
+    mesh.points.resize(header.pointCount);
+    mesh.indices.resize(header.triangleCount * 3);
+    parallelFor(0, header.pointCount, [&](size_t i) {
+        float v[3];
+        std::memcpy(v, xyz + i * sizeof(v), sizeof(v));
+        mesh.points[i] = Vec3<T>(T(v[0]), T(v[1]), T(v[2]));
+    }, threads, 1 << 16);
+    std::memcpy(mesh.indices.data(), xyz + pointBytes, indexBytes);
+    for (auto idx : mesh.indices)
+        if (idx >= mesh.points.size()) throw std::runtime_error("QMESH index out of range.");
+    return mesh;
+}
+
+// 按扩展名分派
+template<typename T = float>
+MeshData<T> load(const std::string& filename, size_t threads = 0) {
+    const auto dot = filename.find_last_of('.');
+    std::string ext = dot == std::string::npos ? "" : filename.substr(dot + 1);
+    for (auto& ch : ext) ch = char(std::tolower(ch));
+    if (ext == "obj") return loadOBJ<T>(filename, threads);
+    if (ext == "ply") return loadPLY<T>(filename, threads);
+    if (ext == "qmesh") return loadQMesh<T>(filename, threads);
+    throw std::runtime_error("unknown mesh format " + filename);
+}
+// 直接构造 TriangleMesh（点数组整体移动进去，三角形批量插入）
+template<typename T = float>
+std::unique_ptr<TriangleMesh<T>> makeTriangleMesh(MeshData<T>&& data, MaterialSet<T>* materialSet) {
+    auto mesh = std::make_unique<TriangleMesh<T>>(std::move(data.points));
+    mesh->insertTriangles(data.indices, materialSet);
+    return mesh;
+}
+// 紧凑网格：点与索引数组直接移动进去，不做任何逐三角形构造
+template<typename T = float>
+std::unique_ptr<CompactTriangleMesh<T>> makeCompactMesh(MeshData<T>&& data, MaterialSet<T>* materialSet) {
+    return std::make_unique<CompactTriangleMesh<T>>(std::move(data.points), std::move(data.indices), materialSet);
+}
+template<typename T = float>
+std::unique_ptr<TriangleMesh<T>> loadTriangleMesh(const std::string& filename, MaterialSet<T>* materialSet, size_t threads = 0) {
+    return makeTriangleMesh(load<T>(filename, threads), materialSet);
+}
+}
+#endif
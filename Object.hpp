@@ -5,10 +5,14 @@
 #include "Vec3.hpp"
 #include "Consts.hpp"
 #include "BVH.hpp"
+#include "MemoryStats.hpp"
+#include <cstdint>
 enum class ObjectType {
     Triangle,
     IndexedTriangle,
-    TriangleMesh
+    TriangleMesh,
+    CompactTriangleMesh,
+    PagedTriangleMesh
 };
 
 // 物体基类
@@ -21,8 +25,62 @@ public:
     virtual std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const = 0; // 判断射线是否与物体相交，返回交点信息
     virtual ObjectType getType() const = 0;
     virtual AABB<T> getAABB() = 0;
+    // 按需构建加速结构：TLAS 在光线第一次进入该对象的叶子时调用（线程安全），此前只用 getAABB()
+    // 直接调用 intersect 的代码需自行先调用 prepare() 或 init()
+    virtual void prepare() {}
+    // 遮挡查询：(0, tMax) 内是否有交点；网格类可覆盖为 any-hit 遍历提前退出，并在 record 中记下遮挡图元
+    virtual bool occluded(const Ray<T>& ray, T tMax, OccluderHint<T>* record = nullptr) const {
+        const auto hit = intersect(ray);
+        if (!hit || hit->t >= tMax) return false; // 未遮挡时保留调用方原有的记录
+        if (record) { record->entry = nullptr; record->generation = 0; } // 没有可复用的图元记录
+        return true;
+    }
+    // 只用缓存记录测试（不做完整遍历），不支持时返回 false
+    virtual bool occludedByHint(const Ray<T>&, T, OccluderHint<T>&) const { return false; }
+    // 光栅化接口：按下标取图元三角形（对象局部坐标）及是否双面；返回 0 个图元的对象主光线仍走追踪
+    virtual size_t primitiveCount() const { return 0; }
+    virtual bool primitive(size_t, Vec3<T>&, Vec3<T>&, Vec3<T>&, bool&) const { return false; }
+    // 只与第 i 个图元求交，用于由可见性缓冲重建主光线交点（不依赖 BLAS）
+    virtual std::optional<HitInfo<T>> intersectPrimitive(const Ray<T>&, size_t) const { return std::nullopt; }
+    // 不经任何加速结构的参考求交：逐个图元线性测试，用于验证 BLAS / TLAS；不提供图元（primitiveCount() == 0）时退回 intersect
+    std::optional<HitInfo<T>> intersectBruteForce(const Ray<T>& ray) const {
+        const size_t count = primitiveCount();
+        if (count == 0) return intersect(ray);
+        std::optional<HitInfo<T>> closestHit;
+        for (size_t i = 0; i < count; ++i) {
+            auto hit = intersectPrimitive(ray, i);
+            if (hit && (!closestHit || hit->t < closestHit->t)) closestHit = hit;
+        }
+        return closestHit;
+    }
+    virtual bool isPrepared() const { return true; }
+    virtual void addMemoryStats(MemoryStats& stats) const { stats.other += sizeof(*this); }
+};
+// Möller–Trumbore 射线-三角形求交，只返回距离与是否命中背面，法线等由调用方按需计算
+template<typename T>
+struct TriangleHit {
+    T t;
+    bool isBack;
+    T u, v; // 重心坐标（对应 p1、p2 的权重）
 };
 template<typename T>
+inline std::optional<TriangleHit<T>> rayTriangle(const Ray<T>& ray, const Vec3<T>& p0, const Vec3<T>& edge1, const Vec3<T>& edge2, bool doubleSided) {
+    Vec3<T> h = ray.direction.cross(edge2);
+    T a = edge1.dot(h);
+    if (std::abs(a) < EPSILON) return std::nullopt; // 平行或退化
+    if (!doubleSided && a < 0) return std::nullopt; // 单面剔除
+    T f = 1 / a;
+    Vec3<T> s = ray.origin - p0;
+    T u = f * s.dot(h);
+    if (u < 0 || u > 1) return std::nullopt;
+    Vec3<T> q = s.cross(edge1);
+    T v = f * ray.direction.dot(q);
+    if (v < 0 || u + v > 1) return std::nullopt;
+    T t = f * edge2.dot(q);
+    if (t < EPSILON) return std::nullopt; // 交点在射线起点之后
+    return TriangleHit<T>{ t, a < 0, u, v };
+}
+template<typename T>
 class TriangleMesh;
 
 // 三角形类，存索引而不是顶点
@@ -53,21 +111,10 @@ public:
         normal = edge1.cross(edge2).normalized();
     }
     std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const override {
-        Vec3<T> h = ray.direction.cross(edge2);
-        T a = edge1.dot(h);
-        if (std::abs(a) < EPSILON) return std::nullopt; // 平行或退化
-        if (!(this->materialSet->doubleSided) && a < 0) return std::nullopt; // 单面剔除
-        T f = 1 / a;
-        Vec3<T> s = ray.origin - mesh->points[v0];
-        T u = f * s.dot(h);
-        if (u < 0 || u > 1) return std::nullopt;
-        Vec3<T> q = s.cross(edge1);
-        T v = f * ray.direction.dot(q);
-        if (v < 0 || u + v > 1) return std::nullopt;
-        T t = f * edge2.dot(q);
-        if (t < EPSILON) return std::nullopt; // 交点在射线起点之后
+        const auto hit = rayTriangle(ray, mesh->points[v0], edge1, edge2, this->materialSet->doubleSided);
+        if (!hit) return std::nullopt;
         // 背面命中取反法线
-        return HitInfo<T>{ t, ray.origin + ray.direction * t, a < 0 ? -normal : normal, this->materialSet, a < 0 };
+        return HitInfo<T>{ hit->t, ray.origin + ray.direction * hit->t, hit->isBack ? -normal : normal, this->materialSet, hit->isBack };
     }
 };
 // 基于三角形网格的Object类（可用于加载复杂模型）
@@ -81,7 +128,9 @@ public:
     std::vector<IndexedTriangle<T>> triangles;
     std::vector<std::vector<size_t>> mp;
     BLAS<T> blas;
+    BuildOnce blasReady;
     TriangleMesh(const std::vector<Vec3<T>>& points): flagAABB(false), box(), points(points), mp(points.size()), blas() {};
+    TriangleMesh(std::vector<Vec3<T>>&& points): flagAABB(false), box(), points(std::move(points)), mp(this->points.size()), blas() {};
     inline AABB<T> getAABB() override {
         if (flagAABB) return box;
         box = AABB<T>();
@@ -96,34 +145,76 @@ public:
         box.expand(p);
     }
     void insertTriangle(size_t a, size_t b, size_t c, MaterialSet<T>* materialSet) {
+        blasReady.invalidate();
         triangles.emplace_back(a, b, c, this, materialSet);
         mp[a].push_back(triangles.size() - 1);
         mp[b].push_back(triangles.size() - 1);
         mp[c].push_back(triangles.size() - 1);
     }
+    void reserve(size_t pointCount, size_t triangleCount) {
+        points.reserve(pointCount); mp.reserve(pointCount);
+        triangles.reserve(triangleCount);
+    }
+    // 批量插入三角形（indices 每 3 个一组），先统计每个顶点的邻接数再一次性 reserve
+    template<typename Index>
+    void insertTriangles(const std::vector<Index>& indices, MaterialSet<T>* materialSet) {
+        blasReady.invalidate();
+        const size_t count = indices.size() / 3, base = triangles.size();
+        std::vector<uint32_t> degree(points.size(), 0);
+        for (size_t i = 0; i < count * 3; ++i) {
+            if (size_t(indices[i]) >= points.size()) throw std::runtime_error("triangle index out of range.");
+            ++degree[indices[i]];
+        }
+        for (size_t i = 0; i < points.size(); ++i) mp[i].reserve(mp[i].size() + degree[i]);
+        triangles.reserve(base + count);
+        for (size_t i = 0; i < count; ++i) {
+            const size_t a = indices[i * 3], b = indices[i * 3 + 1], c = indices[i * 3 + 2];
+            triangles.emplace_back(a, b, c, this, materialSet);
+            mp[a].push_back(base + i);
+            mp[b].push_back(base + i);
+            mp[c].push_back(base + i);
+        }
+    }
     void update(size_t idx, const Vec3<T>& p) {
         points[idx] = p;
         for (const auto i : mp[idx]) triangles[i].compute();
         flagAABB = false; 
+        blasReady.invalidate();
     }
+    // 立即（重新）构建 BLAS；不调用时由 prepare 在首次命中时构建
     void init() {
-        blas.build(points, triangles);
+        blasReady.rebuild([this] { blas.build(points, triangles); });
+    }
+    void prepare() override {
+        blasReady.ensure([this] { blas.build(points, triangles); });
+    }
+    bool isPrepared() const override { return blasReady.isReady(); }
+    bool occluded(const Ray<T>& ray, T tMax, OccluderHint<T>* record = nullptr) const override {
+        return blas.occluded(ray, tMax, record);
+    }
+    bool occludedByHint(const Ray<T>& ray, T tMax, OccluderHint<T>& hint) const override {
+        return blas.occludedByHint(ray, tMax, hint);
     }
     std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const override {
         return blas.intersect(ray);
     }
-    
-    // std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const override {
-    //     std::optional<HitInfo<T>> closestHit;
-    //     T minT = std::numeric_limits<T>::infinity();
-    //     for (const auto& tri : triangles) {
-    //         auto hit = tri.intersect(ray);
-    //         if (hit && hit->t < minT) {
-    //             minT = hit->t;
-    //             closestHit = hit;
-    //         }
-    //     }
-    //     return closestHit;
-    // }
+    size_t primitiveCount() const override { return triangles.size(); }
+    bool primitive(size_t i, Vec3<T>& a, Vec3<T>& b, Vec3<T>& c, bool& doubleSided) const override {
+        const IndexedTriangle<T>& tri = triangles[i];
+        a = points[tri.v0]; b = points[tri.v1]; c = points[tri.v2];
+        doubleSided = tri.materialSet->doubleSided;
+        return true;
+    }
+    std::optional<HitInfo<T>> intersectPrimitive(const Ray<T>& ray, size_t i) const override {
+        return triangles[i].intersect(ray);
+    }
+    void addMemoryStats(MemoryStats& stats) const override {
+        stats.vertices += vectorBytes(points);
+        stats.triangles += vectorBytes(triangles);
+        stats.adjacency += vectorBytes(mp);
+        for (const auto& adj : mp) stats.adjacency += vectorBytes(adj);
+        stats.blas += blas.memoryBytes();
+        stats.other += sizeof(*this);
+    }
 };
 #endif
\ No newline at end of file
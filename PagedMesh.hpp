@@ -0,0 +1,465 @@
+#ifndef PAGEDMESH_H
+#define PAGEDMESH_H
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <unordered_map>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/mman.h>
+#include "Object.hpp"
+#include "MappedFile.hpp"
+#include "MeshLoader.hpp"
+#include "TextureCache.hpp"
+/*
+分页网格（.qpg）：超出内存的几何体按簇（cluster）存盘，渲染时按需流入。
+    三角形按空间划分成簇（默认每簇不超过 4096 个三角形），簇之间的顶层 BVH 与簇目录常驻内存；
+    每个簇是一页：簇内 BVH 节点 + 局部顶点 + 局部索引（按叶子顺序排列），页在文件中按 4K 对齐。
+    求交时遇到不在缓存中的簇才从内存映射文件拷入有界 LRU 缓存（复用 TextureTileCache），
+    拷完即 MADV_DONTNEED 归还映射页，常驻内存只受缓存预算约束。
+    单条光线 intersect 在缺页时同步加载；intersectBatch 把缺页的簇交给后台加载线程，
+    先处理已驻留的簇，等待中的光线在页面到达后再继续，I/O 与求交重叠。
+    文件内容不可信：目录在构造时、簇页在载入缓存前逐项校验（长度、节点下标与树深、叶子区间、局部索引），不合法即抛异常。
+    提供 primitiveCount / primitive / intersectPrimitive（图元按簇顺序编号），可被差分验证与光栅化使用；
+    注意光栅化会读遍全部簇页，超出内存的网格应关闭 Engine::rasterPrimary。
+文件布局：
+    PagedMeshHeader | PagedNode top[topNodeCount] | PagedCluster cluster[clusterCount] | 4K 对齐的簇页 ...
+簇页布局：
+    PagedNode nodes[nodeCount] | float xyz[vertexCount * 3] | uint32_t indices[triangleCount * 3]
+*/
+#pragma pack(push, 1)
+struct PagedMeshHeader {
+    uint32_t magic;          // 'QPG1'
+    uint32_t version;
+    uint32_t topNodeCount;
+    uint32_t clusterCount;
+    uint64_t triangleCount;
+    float min[3], max[3];
+};
+// 扁平 BVH 节点：内部节点左孩子紧随其后，index 为右孩子下标；叶子 count > 0，index 为首个图元
+struct PagedNode {
+    float min[3], max[3];
+    uint32_t index, count;
+};
+struct PagedCluster {
+    uint64_t offset;         // 簇页在文件中的偏移
+    uint32_t bytes, nodeCount, vertexCount, triangleCount;
+    float min[3], max[3];
+};
+#pragma pack(pop)
+constexpr uint32_t PAGED_MESH_MAGIC = 0x31475051; // "QPG1"
+constexpr size_t PAGED_MESH_ALIGN = 4096;
+constexpr size_t PAGED_MESH_MAX_DEPTH = 62; // 遍历栈为 64 项，树深不超过它时不会溢出
+
+namespace PagedMesh {
+namespace detail {
+    // 在 order[begin, end) 上原地划分，按深度优先顺序追加扁平节点
+    template<typename BoxFn, typename CentroidFn>
+    void buildFlat(std::vector<uint32_t>& order, uint32_t begin, uint32_t end, BoxFn& boxOf, CentroidFn& centroidOf,
+                   size_t leafSize, std::vector<PagedNode>& nodes) {
+        const size_t self = nodes.size();
+        nodes.emplace_back();
+        AABB<float> box, centroids;
+        for (uint32_t i = begin; i < end; ++i) {
+            box.expand(boxOf(order[i]));
+            centroids.expand(centroidOf(order[i]));
+        }
+        for (int k = 0; k < 3; ++k) { nodes[self].min[k] = box.min[k]; nodes[self].max[k] = box.max[k]; }
+        if (end - begin <= leafSize) {
+            nodes[self].index = begin;
+            nodes[self].count = end - begin;
+            return;
+        }
+        const Vec3<float> extents = centroids.max - centroids.min;
+        int axis = 0;
+        if (extents.y > extents.x) axis = 1;
+        if (extents.z > extents[axis]) axis = 2;
+        const uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) { return centroidOf(a)[axis] < centroidOf(b)[axis]; });
+        buildFlat(order, begin, mid, boxOf, centroidOf, leafSize, nodes);
+        nodes[self].index = uint32_t(nodes.size());
+        nodes[self].count = 0;
+        buildFlat(order, mid, end, boxOf, centroidOf, leafSize, nodes);
+    }
+    inline AABB<float> nodeBox(const PagedNode& n) {
+        return AABB<float>(Vec3<float>(n.min[0], n.min[1], n.min[2]), Vec3<float>(n.max[0], n.max[1], n.max[2]));
+    }
+    // 校验扁平 BVH：左孩子紧随其后、右孩子下标更大（遍历必然终止），树深不超过遍历栈，叶子区间落在 [0, primitiveCount) 内
+    inline bool validFlat(const PagedNode* nodes, size_t nodeCount, uint64_t primitiveCount) {
+        if (nodeCount == 0) return false;
+        std::vector<uint8_t> depth(nodeCount, 0);
+        depth[0] = 1;
+        for (size_t i = 0; i < nodeCount; ++i) {
+            const PagedNode& n = nodes[i];
+            if (n.count > 0) {
+                if (uint64_t(n.index) + n.count > primitiveCount) return false;
+                continue;
+            }
+            if (n.index <= i + 1 || n.index >= nodeCount || depth[i] >= PAGED_MESH_MAX_DEPTH) return false;
+            depth[i + 1] = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+            depth[n.index] = std::max<uint8_t>(depth[n.index], depth[i] + 1);
+        }
+        return true;
+    }
+}
+// 离线转换：把整个网格切簇写盘（转换本身需要整网格在内存里，可在大内存机器上预处理）
+template<typename T = float>
+void write(const std::string& filename, const MeshData<T>& mesh, size_t clusterTriangles = 4096, size_t leafSize = 4) {
+    const size_t triCount = mesh.triangleCount();
+    if (triCount == 0) throw std::runtime_error("empty mesh.");
+    auto vertex = [&](uint32_t v) { return Vec3<float>(float(mesh.points[v].x), float(mesh.points[v].y), float(mesh.points[v].z)); };
+    std::vector<AABB<float>> triBoxes(triCount);
+    std::vector<Vec3<float>> triCentroids(triCount);
+    for (size_t i = 0; i < triCount; ++i) {
+        for (int k = 0; k < 3; ++k) triBoxes[i].expand(vertex(mesh.indices[i * 3 + k]));
+        triCentroids[i] = (triBoxes[i].min + triBoxes[i].max) * 0.5f;
+    }
+    auto boxOf = [&](uint32_t i) { return triBoxes[i]; };
+    auto centroidOf = [&](uint32_t i) { return triCentroids[i]; };
+    // 1. 顶层：同一个划分过程，叶子即簇
+    std::vector<uint32_t> order(triCount);
+    for (size_t i = 0; i < triCount; ++i) order[i] = uint32_t(i);
+    std::vector<PagedNode> top;
+    detail::buildFlat(order, 0, uint32_t(triCount), boxOf, centroidOf, std::max<size_t>(1, clusterTriangles), top);
+    std::vector<std::pair<uint32_t, uint32_t>> ranges; // 每个簇在 order 中的区间
+    for (auto& n : top)
+        if (n.count > 0) {
+            ranges.emplace_back(n.index, n.count);
+            n.index = uint32_t(ranges.size() - 1); // 叶子改为指向簇
+            n.count = 1;
+        }
+    // 2. 逐簇生成页
+    PagedMeshHeader header{ PAGED_MESH_MAGIC, 1, uint32_t(top.size()), uint32_t(ranges.size()), uint64_t(triCount), {}, {} };
+    for (int k = 0; k < 3; ++k) { header.min[k] = top[0].min[k]; header.max[k] = top[0].max[k]; }
+    std::vector<PagedCluster> clusters(ranges.size());
+    std::vector<std::vector<uint8_t>> pages(ranges.size());
+    uint64_t offset = sizeof(PagedMeshHeader) + top.size() * sizeof(PagedNode) + clusters.size() * sizeof(PagedCluster);
+    offset = (offset + PAGED_MESH_ALIGN - 1) / PAGED_MESH_ALIGN * PAGED_MESH_ALIGN;
+    std::unordered_map<uint32_t, uint32_t> remap;
+    for (size_t c = 0; c < ranges.size(); ++c) {
+        std::vector<uint32_t> local(order.begin() + ranges[c].first, order.begin() + ranges[c].first + ranges[c].second);
+        std::vector<uint32_t> localOrder(local.size());
+        for (size_t i = 0; i < local.size(); ++i) localOrder[i] = uint32_t(i);
+        auto localBox = [&](uint32_t i) { return triBoxes[local[i]]; };
+        auto localCentroid = [&](uint32_t i) { return triCentroids[local[i]]; };
+        std::vector<PagedNode> nodes;
+        detail::buildFlat(localOrder, 0, uint32_t(local.size()), localBox, localCentroid, leafSize, nodes);
+        remap.clear();
+        std::vector<float> xyz;
+        std::vector<uint32_t> indices;
+        indices.reserve(local.size() * 3);
+        for (uint32_t i : localOrder)
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = mesh.indices[size_t(local[i]) * 3 + k];
+                auto [it, inserted] = remap.emplace(v, uint32_t(remap.size()));
+                if (inserted) {
+                    const Vec3<float> p = vertex(v);
+                    xyz.insert(xyz.end(), { p.x, p.y, p.z });
+                }
+                indices.push_back(it->second);
+            }
+        auto& page = pages[c];
+        const size_t nodeBytes = nodes.size() * sizeof(PagedNode), xyzBytes = xyz.size() * sizeof(float);
+        page.resize(nodeBytes + xyzBytes + indices.size() * sizeof(uint32_t));
+        std::memcpy(page.data(), nodes.data(), nodeBytes);
+        std::memcpy(page.data() + nodeBytes, xyz.data(), xyzBytes);
+        std::memcpy(page.data() + nodeBytes + xyzBytes, indices.data(), indices.size() * sizeof(uint32_t));
+        auto& cl = clusters[c];
+        cl.offset = offset;
+        cl.bytes = uint32_t(page.size());
+        cl.nodeCount = uint32_t(nodes.size());
+        cl.vertexCount = uint32_t(xyz.size() / 3);
+        cl.triangleCount = uint32_t(local.size());
+        for (int k = 0; k < 3; ++k) { cl.min[k] = nodes[0].min[k]; cl.max[k] = nodes[0].max[k]; }
+        offset += (page.size() + PAGED_MESH_ALIGN - 1) / PAGED_MESH_ALIGN * PAGED_MESH_ALIGN;
+    }
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(top.data()), top.size() * sizeof(PagedNode));
+    file.write(reinterpret_cast<const char*>(clusters.data()), clusters.size() * sizeof(PagedCluster));
+    const std::vector<char> zeros(PAGED_MESH_ALIGN, 0);
+    for (size_t c = 0; c < pages.size(); ++c) {
+        const size_t pos = size_t(file.tellp());
+        file.write(zeros.data(), std::streamsize(clusters[c].offset - pos));
+        file.write(reinterpret_cast<const char*>(pages[c].data()), pages[c].size());
+    }
+    const size_t pos = size_t(file.tellp());
+    file.write(zeros.data(), std::streamsize((pos + PAGED_MESH_ALIGN - 1) / PAGED_MESH_ALIGN * PAGED_MESH_ALIGN - pos));
+    if (!file) throw std::runtime_error("failed to write " + filename);
+}
+}
+
+template<typename T = float>
+class PagedTriangleMesh : public Object<T> {
+public:
+    using Page = TextureTileCache::Tile;
+    struct Stats {
+        uint64_t pageLoads = 0, deferredRays = 0;
+    };
+private:
+    MappedFile file;
+    PagedMeshHeader header;
+    std::vector<PagedNode> top;          // 常驻的顶层 BVH
+    std::vector<PagedCluster> clusters;  // 常驻的簇目录
+    std::vector<uint64_t> clusterFirst;  // 每个簇首个三角形的全局编号（前缀和，末项为总数）
+    TextureTileCache& cache;
+    uint32_t fileId;
+    mutable std::atomic<uint64_t> pageLoads{ 0 };
+    std::atomic<uint64_t> deferredRays{ 0 };
+    // 后台加载线程：同一簇的并发请求合并为一个 future
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::deque<std::pair<uint32_t, std::promise<Page>>> queue;
+    std::unordered_map<uint32_t, std::shared_future<Page>> inFlight;
+    std::vector<std::thread> loaders;
+    bool stopping = false;
+
+    // 簇页内各段的起始位置（长度已由 validatePage 保证）
+    struct PageView {
+        const PagedNode* nodes;
+        const float* xyz;
+        const uint32_t* indices;
+    };
+    static PageView view(const PagedCluster& cl, const uint8_t* page) {
+        const size_t nodeBytes = size_t(cl.nodeCount) * sizeof(PagedNode), xyzBytes = size_t(cl.vertexCount) * 3 * sizeof(float);
+        return PageView{ reinterpret_cast<const PagedNode*>(page), reinterpret_cast<const float*>(page + nodeBytes),
+                         reinterpret_cast<const uint32_t*>(page + nodeBytes + xyzBytes) };
+    }
+    static void validatePage(const PagedCluster& cl, const std::vector<uint8_t>& page) {
+        const uint64_t expected = uint64_t(cl.nodeCount) * sizeof(PagedNode) + uint64_t(cl.vertexCount) * 3 * sizeof(float)
+                                + uint64_t(cl.triangleCount) * 3 * sizeof(uint32_t);
+        if (page.size() != expected) throw std::runtime_error("paged mesh cluster size mismatch.");
+        const PageView v = view(cl, page.data());
+        if (!PagedMesh::detail::validFlat(v.nodes, cl.nodeCount, cl.triangleCount)) throw std::runtime_error("invalid paged mesh cluster BVH.");
+        for (size_t i = 0; i < size_t(cl.triangleCount) * 3; ++i)
+            if (v.indices[i] >= cl.vertexCount) throw std::runtime_error("paged mesh vertex index out of range.");
+    }
+    std::vector<uint8_t> readPage(uint32_t c) const {
+        const PagedCluster& cl = clusters[c];
+        if (cl.offset > file.size() || cl.bytes > file.size() - cl.offset) throw std::runtime_error("paged mesh cluster out of range.");
+        const uint8_t* src = file.data() + cl.offset;
+        std::vector<uint8_t> page(src, src + cl.bytes);
+        validatePage(cl, page);
+        // 页已拷入缓存，映射页立即归还，避免文件页随访问量增长常驻
+        madvise(const_cast<uint8_t*>(src), (cl.bytes + PAGED_MESH_ALIGN - 1) / PAGED_MESH_ALIGN * PAGED_MESH_ALIGN, MADV_DONTNEED);
+        pageLoads.fetch_add(1, std::memory_order_relaxed);
+        return page;
+    }
+    Page getPage(uint32_t c) const {
+        return cache.get(TextureTileCache::makeKey(fileId, c), [&]() { return readPage(c); });
+    }
+    std::shared_future<Page> requestPage(uint32_t c) {
+        std::lock_guard<std::mutex> guard(queueLock);
+        auto it = inFlight.find(c);
+        if (it != inFlight.end()) return it->second;
+        std::promise<Page> promise;
+        auto future = promise.get_future().share();
+        inFlight.emplace(c, future);
+        queue.emplace_back(c, std::move(promise));
+        queueReady.notify_one();
+        return future;
+    }
+    void loaderLoop() {
+        for (;;) {
+            std::pair<uint32_t, std::promise<Page>> job;
+            {
+                std::unique_lock<std::mutex> guard(queueLock);
+                queueReady.wait(guard, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            try {
+                job.second.set_value(getPage(job.first));
+            } catch (...) {
+                job.second.set_exception(std::current_exception());
+            }
+            std::lock_guard<std::mutex> guard(queueLock);
+            inFlight.erase(job.first);
+        }
+    }
+    // 簇内遍历，hit 记录更近的交点并收紧 tMax
+    bool intersectPage(const Ray<T>& ray, const PagedCluster& cl, const uint8_t* page, T& tMax, TriangleHit<T>& best, Vec3<T>& bestNormal) const {
+        const auto [nodes, xyz, indices] = view(cl, page);
+        auto vertex = [&](uint32_t v) { return Vec3<T>(T(xyz[v * 3]), T(xyz[v * 3 + 1]), T(xyz[v * 3 + 2])); };
+        const bool doubleSided = this->materialSet && this->materialSet->doubleSided;
+        bool found = false;
+        uint32_t stack[64];
+        size_t sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const PagedNode& n = nodes[stack[--sp]];
+            if (!PagedMesh::detail::nodeBox(n).intersect(ray, 0, tMax)) continue;
+            if (n.count == 0) {
+                stack[sp++] = n.index;
+                stack[sp++] = uint32_t(&n - nodes) + 1;
+                continue;
+            }
+            for (uint32_t i = n.index; i < n.index + n.count; ++i) {
+                const Vec3<T> p0 = vertex(indices[i * 3]), e1 = vertex(indices[i * 3 + 1]) - p0, e2 = vertex(indices[i * 3 + 2]) - p0;
+                const auto hit = rayTriangle(ray, p0, e1, e2, doubleSided);
+                if (hit && hit->t < tMax) {
+                    tMax = hit->t;
+                    best = *hit;
+                    bestNormal = e1.cross(e2).normalized();
+                    found = true;
+                }
+            }
+        }
+        return found;
+    }
+    // 全局三角形编号所在的簇及其在簇内的下标；簇页经缓存获取
+    Page locate(size_t i, uint32_t& c, size_t& local) const {
+        c = uint32_t(std::upper_bound(clusterFirst.begin(), clusterFirst.end(), uint64_t(i)) - clusterFirst.begin() - 1);
+        local = size_t(i - clusterFirst[c]);
+        return getPage(c);
+    }
+    HitInfo<T> makeHit(const Ray<T>& ray, const TriangleHit<T>& hit, const Vec3<T>& normal) const {
+        return HitInfo<T>{ hit.t, ray.origin + ray.direction * hit.t, hit.isBack ? -normal : normal, this->materialSet, hit.isBack };
+    }
+    // 顶层遍历，对每个包围盒与光线相交的簇调用 visit(cluster)
+    template<typename Visit>
+    void forEachCluster(const Ray<T>& ray, const T& tMax, Visit&& visit) const {
+        uint32_t stack[64];
+        size_t sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const PagedNode& n = top[stack[--sp]];
+            if (!PagedMesh::detail::nodeBox(n).intersect(ray, 0, tMax)) continue;
+            if (n.count == 0) {
+                stack[sp++] = n.index;
+                stack[sp++] = uint32_t(&n - top.data()) + 1;
+            } else visit(n.index);
+        }
+    }
+public:
+    // cache 可被多个分页网格共享，预算即几何常驻内存上限
+    PagedTriangleMesh(const std::string& filename, TextureTileCache& __cache, MaterialSet<T>* materialSet, size_t loaderThreads = 2)
+        : Object<T>(materialSet), file(filename), cache(__cache), fileId(__cache.registerFile()) {
+        if (file.size() < sizeof(header)) throw std::runtime_error("invalid paged mesh " + filename);
+        std::memcpy(&header, file.data(), sizeof(header));
+        const size_t dirBytes = header.topNodeCount * sizeof(PagedNode) + header.clusterCount * sizeof(PagedCluster);
+        if (header.magic != PAGED_MESH_MAGIC || header.topNodeCount == 0 || file.size() < sizeof(header) + dirBytes)
+            throw std::runtime_error("invalid paged mesh " + filename);
+        top.resize(header.topNodeCount);
+        clusters.resize(header.clusterCount);
+        std::memcpy(top.data(), file.data() + sizeof(header), top.size() * sizeof(PagedNode));
+        std::memcpy(clusters.data(), file.data() + sizeof(header) + top.size() * sizeof(PagedNode), clusters.size() * sizeof(PagedCluster));
+        // 顶层叶子的图元即簇；各簇三角形数之和须等于头中的总数
+        if (!PagedMesh::detail::validFlat(top.data(), top.size(), clusters.size())) throw std::runtime_error("invalid paged mesh " + filename);
+        clusterFirst.resize(clusters.size() + 1, 0);
+        for (size_t c = 0; c < clusters.size(); ++c) clusterFirst[c + 1] = clusterFirst[c] + clusters[c].triangleCount;
+        if (clusterFirst.back() != header.triangleCount) throw std::runtime_error("invalid paged mesh " + filename);
+        madvise(file.data(), file.size(), MADV_RANDOM);
+        for (size_t i = 0; i < std::max<size_t>(1, loaderThreads); ++i) loaders.emplace_back([this] { loaderLoop(); });
+    }
+    PagedTriangleMesh(const PagedTriangleMesh&) = delete;
+    PagedTriangleMesh& operator=(const PagedTriangleMesh&) = delete;
+    ~PagedTriangleMesh() override {
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (auto& t : loaders) t.join();
+    }
+    inline ObjectType getType() const override { return ObjectType::PagedTriangleMesh; }
+    inline AABB<T> getAABB() override {
+        return AABB<T>(Vec3<T>(header.min[0], header.min[1], header.min[2]), Vec3<T>(header.max[0], header.max[1], header.max[2]));
+    }
+    inline size_t triangleCount() const { return size_t(header.triangleCount); }
+    inline size_t clusterCount() const { return clusters.size(); }
+    size_t primitiveCount() const override { return triangleCount(); }
+    bool primitive(size_t i, Vec3<T>& a, Vec3<T>& b, Vec3<T>& c, bool& doubleSided) const override {
+        uint32_t cluster;
+        size_t local;
+        const Page page = locate(i, cluster, local);
+        const auto [nodes, xyz, indices] = view(clusters[cluster], page->data());
+        Vec3<T>* out[3] = { &a, &b, &c };
+        for (int k = 0; k < 3; ++k) {
+            const float* p = xyz + size_t(indices[local * 3 + k]) * 3;
+            *out[k] = Vec3<T>(T(p[0]), T(p[1]), T(p[2]));
+        }
+        doubleSided = this->materialSet && this->materialSet->doubleSided;
+        return true;
+    }
+    std::optional<HitInfo<T>> intersectPrimitive(const Ray<T>& ray, size_t i) const override {
+        Vec3<T> a, b, c;
+        bool doubleSided;
+        primitive(i, a, b, c, doubleSided);
+        const Vec3<T> e1 = b - a, e2 = c - a;
+        const auto hit = rayTriangle(ray, a, e1, e2, doubleSided);
+        if (!hit) return std::nullopt;
+        return makeHit(ray, *hit, e1.cross(e2).normalized());
+    }
+    // 单条光线：缺页时同步加载
+    std::optional<HitInfo<T>> intersect(const Ray<T>& ray) const override {
+        T tMax = std::numeric_limits<T>::infinity();
+        TriangleHit<T> best{};
+        Vec3<T> normal;
+        bool found = false;
+        forEachCluster(ray, tMax, [&](uint32_t c) {
+            const Page page = getPage(c);
+            found |= intersectPage(ray, clusters[c], page->data(), tMax, best, normal);
+        });
+        if (!found) return std::nullopt;
+        return makeHit(ray, best, normal);
+    }
+    // 批量求交：先用已驻留的簇求交，缺页的簇异步加载，等待期间不阻塞其余光线
+    void intersectBatch(const std::vector<Ray<T>>& rays, std::vector<std::optional<HitInfo<T>>>& hits) {
+        const size_t n = rays.size();
+        std::vector<T> tMax(n, std::numeric_limits<T>::infinity());
+        std::vector<TriangleHit<T>> best(n);
+        std::vector<Vec3<T>> normals(n);
+        std::vector<uint8_t> found(n, 0);
+        std::unordered_map<uint32_t, std::vector<uint32_t>> waiting; // 簇 -> 等待它的光线
+        std::vector<std::pair<uint32_t, std::shared_future<Page>>> requests;
+        for (size_t r = 0; r < n; ++r)
+            forEachCluster(rays[r], tMax[r], [&](uint32_t c) {
+                if (const Page page = cache.find(TextureTileCache::makeKey(fileId, c))) {
+                    found[r] |= intersectPage(rays[r], clusters[c], page->data(), tMax[r], best[r], normals[r]);
+                    return;
+                }
+                auto& list = waiting[c];
+                if (list.empty()) requests.emplace_back(c, requestPage(c));
+                list.push_back(uint32_t(r));
+                deferredRays.fetch_add(1, std::memory_order_relaxed);
+            });
+        // 按请求顺序等待（加载线程按 FIFO 处理），每到一页就推进等待它的光线
+        for (auto& [c, future] : requests) {
+            const Page page = future.get();
+            for (uint32_t r : waiting[c]) {
+                const AABB<T> box(Vec3<T>(clusters[c].min[0], clusters[c].min[1], clusters[c].min[2]),
+                                  Vec3<T>(clusters[c].max[0], clusters[c].max[1], clusters[c].max[2]));
+                if (!box.intersect(rays[r], 0, tMax[r])) continue; // 已在更近的簇里命中
+                found[r] |= intersectPage(rays[r], clusters[c], page->data(), tMax[r], best[r], normals[r]);
+            }
+        }
+        hits.resize(n);
+        for (size_t r = 0; r < n; ++r)
+            hits[r] = found[r] ? std::optional<HitInfo<T>>(makeHit(rays[r], best[r], normals[r])) : std::nullopt;
+    }
+    // 预取：把与光线相交的簇提前排进加载队列
+    void prefetch(const Ray<T>& ray) {
+        const T tMax = std::numeric_limits<T>::infinity();
+        forEachCluster(ray, tMax, [&](uint32_t c) {
+            if (!cache.find(TextureTileCache::makeKey(fileId, c))) requestPage(c);
+        });
+    }
+    Stats stats() const { return Stats{ pageLoads.load(), deferredRays.load() }; }
+    void addMemoryStats(MemoryStats& stats) const override {
+        stats.blas += vectorBytes(top);
+        stats.other += vectorBytes(clusters) + sizeof(*this);
+    }
+};
+#endif
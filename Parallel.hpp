@@ -0,0 +1,215 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+
+inline size_t defaultThreadCount() {
+    const unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+namespace detail {
+inline thread_local bool onPoolWorker = false;
+// parallelFor 共用的常驻线程池（defaultThreadCount() - 1 个线程，调用线程自己也参与），首次使用时创建。
+// 每个 Batch 可排入若干份相同的工作；调用方完成自己那份后撤回尚未开始的副本，只等待已在运行的
+class WorkerPool {
+public:
+    struct Batch {
+        std::function<void()> work;
+        size_t running = 0;
+    };
+    static WorkerPool& instance() {
+        static WorkerPool pool(defaultThreadCount() - 1);
+        return pool;
+    }
+    size_t size() const { return workers.size(); }
+    void submit(Batch& batch, size_t copies) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < copies; ++i) queue.push_back(&batch);
+        }
+        if (copies == 1) wake.notify_one();
+        else wake.notify_all();
+    }
+    void finish(Batch& batch) {
+        std::unique_lock<std::mutex> guard(lock);
+        queue.erase(std::remove(queue.begin(), queue.end(), &batch), queue.end());
+        done.wait(guard, [&] { return batch.running == 0; });
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        wake.notify_all();
+        for (auto& th : workers) th.join();
+    }
+private:
+    std::mutex lock;
+    std::condition_variable wake, done;
+    std::deque<Batch*> queue;
+    bool shutdown = false;
+    std::vector<std::thread> workers;
+
+    explicit WorkerPool(size_t threads) {
+        workers.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) workers.emplace_back([this] { workerLoop(); });
+    }
+    void workerLoop() {
+        onPoolWorker = true;
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            wake.wait(guard, [&] { return shutdown || !queue.empty(); });
+            if (queue.empty()) return;
+            Batch* batch = queue.front();
+            queue.pop_front();
+            ++batch->running;
+            guard.unlock();
+            batch->work(); // work 自行捕获异常
+            guard.lock();
+            if (--batch->running == 0) done.notify_all();
+        }
+    }
+};
+}
+// 对 [begin, end) 做动态调度的并行循环，每次领取 grain 个下标。
+// 辅助线程来自常驻线程池，参与线程数不超过池大小 + 1；在池线程中嵌套调用时直接串行执行，不再分发。
+// 任一线程抛出的第一个异常会在所有线程结束后重新抛出
+template<typename F>
+void parallelFor(size_t begin, size_t end, F&& fn, size_t threads = 0, size_t grain = 1) {
+    if (end <= begin) return;
+    if (threads == 0) threads = defaultThreadCount();
+    grain = std::max<size_t>(1, grain);
+    threads = std::min(threads, (end - begin + grain - 1) / grain);
+    if (detail::onPoolWorker) threads = 1;
+    auto& workers = detail::WorkerPool::instance();
+    threads = std::min(threads, workers.size() + 1);
+    if (threads <= 1) {
+        for (size_t i = begin; i < end; ++i) fn(i);
+        return;
+    }
+    std::atomic<size_t> next(begin);
+    std::exception_ptr error;
+    std::mutex errorLock;
+    auto worker = [&]() {
+        try {
+            for (;;) {
+                const size_t first = next.fetch_add(grain, std::memory_order_relaxed);
+                if (first >= end) break;
+                const size_t last = std::min(end, first + grain);
+                for (size_t i = first; i < last; ++i) fn(i);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (!error) error = std::current_exception();
+            next.store(end);
+        }
+    };
+    detail::WorkerPool::Batch batch;
+    batch.work = worker;
+    workers.submit(batch, threads - 1);
+    worker();
+    workers.finish(batch);
+    if (error) std::rethrow_exception(error);
+}
+// 依赖图任务调度：固定线程池执行，任务在所有前驱完成后进入就绪队列（先就绪先执行）。
+// 任务中可以继续 add（依赖已完成的任务视为已满足）；某个任务抛出异常后，尚未开始的任务不再执行，
+// 第一个异常由 wait 重新抛出。
+class TaskGraph {
+public:
+    using TaskId = size_t;
+    explicit TaskGraph(size_t threads = 0) {
+        if (threads == 0) threads = defaultThreadCount();
+        pool.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) pool.emplace_back([this] { workerLoop(); });
+    }
+    ~TaskGraph() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        wake.notify_all();
+        for (auto& th : pool) th.join();
+    }
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    TaskId add(std::function<void()> fn, const std::vector<TaskId>& deps = {}) {
+        std::lock_guard<std::mutex> guard(lock);
+        const TaskId id = tasks.size();
+        tasks.emplace_back();
+        Task& task = tasks.back();
+        task.fn = std::move(fn);
+        for (const TaskId dep : deps) {
+            if (dep >= id) throw std::invalid_argument("task dependency must be added first.");
+            if (!tasks[dep].done) {
+                tasks[dep].dependents.push_back(id);
+                ++task.pending;
+            }
+        }
+        if (task.pending == 0) {
+            ready.push_back(id);
+            wake.notify_one();
+        }
+        return id;
+    }
+    // 等待目前所有任务完成（包括等待期间新加入的）
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [&] { return finished == tasks.size(); });
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+private:
+    struct Task {
+        std::function<void()> fn;
+        std::vector<TaskId> dependents;
+        size_t pending = 0;
+        bool done = false;
+    };
+    std::mutex lock;
+    std::condition_variable wake, idle;
+    std::deque<Task> tasks; // deque：add 时已有任务的引用不失效
+    std::deque<TaskId> ready;
+    size_t finished = 0;
+    bool shutdown = false;
+    std::exception_ptr error;
+    std::vector<std::thread> pool;
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            wake.wait(guard, [&] { return shutdown || !ready.empty(); });
+            if (ready.empty()) return;
+            const TaskId id = ready.front();
+            ready.pop_front();
+            std::function<void()> fn = std::move(tasks[id].fn);
+            const bool skip = error != nullptr;
+            guard.unlock();
+            std::exception_ptr thrown;
+            if (!skip) {
+                try { fn(); } catch (...) { thrown = std::current_exception(); }
+            }
+            fn = nullptr; // 捕获的资源在任务完成前释放
+            guard.lock();
+            if (thrown && !error) error = thrown;
+            Task& task = tasks[id];
+            task.done = true;
+            for (const TaskId next : task.dependents)
+                if (--tasks[next].pending == 0) ready.push_back(next);
+            if (!task.dependents.empty()) wake.notify_all();
+            if (++finished == tasks.size()) idle.notify_all();
+        }
+    }
+};
+#endif
@@ -0,0 +1,140 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "ImageWriter.hpp"
+#include "ToneMapper.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+/*
+单帧流水线：加载、BLAS 构建、渲染、色调映射与编码按依赖图重叠执行，而不是逐阶段串行。
+    load[i] ──> blas[i]（prepare，与其余网格的加载并行）
+    load[*] ──> tlas（按登记顺序插入实例后 Engine::init；TLAS 只需要包围盒，不等 BLAS）
+    tlas ──> tile[j]：renderTile 后立即把 HDR 写入 hdrPath；尚未建好的 BLAS 由首条进入的光线按需构建（或等待正在进行的 blas 任务）
+    Manual 曝光：tile[j] 内同时做色调映射并写 ldrPath
+    自动曝光：tile[*] ──> exposure（整帧 computeMid）──> ldr[j]（逐图块映射、编码）
+图块的随机数流与 Engine::render 相同，输出与串行执行逐位一致（设置了 Engine::irradianceCache 时除外）。
+*/
+struct PipelineStats {
+    // 均为自 run 开始的秒数
+    double loaded = 0;     // 全部网格加载完成
+    double tlasReady = 0;  // TLAS 建好，开始渲染
+    double firstTile = 0;  // 第一个图块渲染并写出
+    double rendered = 0;   // 全部图块渲染完成
+    double total = 0;      // 色调映射与编码全部完成
+};
+
+template<typename T = float>
+class FramePipeline {
+public:
+    using Loader = std::function<TriangleMesh<T>*()>;
+    size_t threads = 0;
+    size_t tileSize = 64;
+    T sigma = 0.05f;
+    int spp = 5;
+    ToneMapPass<T> tonemap;
+    PipelineStats lastStats;
+
+    FramePipeline(Engine<T>& __engine) : engine(__engine) {}
+    // 登记一个网格：load 在工作线程中创建网格并插入三角形（所有权归调用方），translations 为它的实例位置
+    void addMesh(Loader load, std::vector<Vec3<T>> translations) {
+        meshes.push_back(MeshJob{ std::move(load), std::move(translations), nullptr });
+    }
+    // 渲染一帧；hdrPath / ldrPath 为空时跳过对应输出，image / ldr 保存完整结果。
+    // 已登记的网格在本次 run 中加载并插入引擎，之后的 run 不再重复插入
+    void run(const Camera<T>& camera, uint64_t seed, Framebuffer<T>& image, Framebuffer<T>& ldr,
+             const std::string& hdrPath = "", const std::string& ldrPath = "") {
+        QE_PROFILE_SCOPE("FramePipeline::run");
+        const auto start = std::chrono::steady_clock::now();
+        auto now = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+        const size_t width = size_t(camera.width), height = size_t(camera.height);
+        image.resize(width, height);
+        ldr.resize(width, height);
+        std::unique_ptr<ImageIO::TileStreamWriter<T>> hdrWriter, ldrWriter;
+        if (!hdrPath.empty()) hdrWriter = std::make_unique<ImageIO::TileStreamWriter<T>>(hdrPath, width, height);
+        if (!ldrPath.empty()) ldrWriter = std::make_unique<ImageIO::TileStreamWriter<T>>(ldrPath, width, height);
+        const auto tiles = makeTiles(width, height, tileSize);
+        const bool manual = tonemap.exposureMode == ExposureMode::Manual;
+        PipelineStats stats;
+        std::atomic<size_t> tilesDone{ 0 };
+        T mid = tonemap.L_mid;
+        VisibilityBuffer<T> visibility;
+
+        TaskGraph graph(threads);
+        // 1. 加载与 BLAS
+        std::vector<TaskGraph::TaskId> loads;
+        for (auto& mesh : meshes) {
+            const auto load = graph.add([&mesh] {
+                QE_PROFILE_SCOPE("pipeline.load");
+                mesh.mesh = mesh.load();
+            });
+            loads.push_back(load);
+            graph.add([&mesh] {
+                QE_PROFILE_SCOPE("pipeline.blas");
+                mesh.mesh->prepare();
+            }, { load });
+        }
+        // 2. TLAS
+        const auto tlas = graph.add([&] {
+            QE_PROFILE_SCOPE("pipeline.tlas");
+            stats.loaded = now();
+            for (const auto& mesh : meshes)
+                for (const auto& t : mesh.translations) engine.insertInstance(Instance<T>(mesh.mesh, t));
+            engine.init();
+            if (engine.rasterPrimary) engine.rasterizeVisibility(camera, visibility, threads);
+            stats.tlasReady = now();
+        }, loads);
+        // 3. 渲染图块
+        std::vector<TaskGraph::TaskId> rendered;
+        rendered.reserve(tiles.size());
+        for (size_t idx = 0; idx < tiles.size(); ++idx)
+            rendered.push_back(graph.add([&, idx] {
+                const Tile& tile = tiles[idx];
+                engine.renderTile(camera, image, tile, seed, idx, sigma, spp, engine.rasterPrimary ? &visibility : nullptr);
+                if (hdrWriter) hdrWriter->writeTile(image, tile);
+                if (manual) {
+                    tonemap.runTile(image, ldr, tile, mid);
+                    if (ldrWriter) ldrWriter->writeTile(ldr, tile);
+                }
+                const size_t done = ++tilesDone;
+                if (done == 1) stats.firstTile = now();
+                if (done == tiles.size()) stats.rendered = now();
+            }, { tlas }));
+        // 4. 自动曝光需要整帧，之后逐图块映射编码
+        if (!manual) {
+            const auto exposure = graph.add([&] {
+                QE_PROFILE_SCOPE("pipeline.exposure");
+                mid = tonemap.computeMid(image);
+                tonemap.lastMid = mid;
+            }, rendered);
+            for (size_t idx = 0; idx < tiles.size(); ++idx)
+                graph.add([&, idx] {
+                    tonemap.runTile(image, ldr, tiles[idx], mid);
+                    if (ldrWriter) ldrWriter->writeTile(ldr, tiles[idx]);
+                }, { exposure });
+        }
+        graph.wait();
+        meshes.clear();
+        if (manual) tonemap.lastMid = mid;
+        if (hdrWriter) hdrWriter->finish();
+        if (ldrWriter) ldrWriter->finish();
+        stats.total = now();
+        lastStats = stats;
+    }
+private:
+    struct MeshJob {
+        Loader load;
+        std::vector<Vec3<T>> translations;
+        TriangleMesh<T>* mesh;
+    };
+    Engine<T>& engine;
+    std::vector<MeshJob> meshes;
+};
+#endif
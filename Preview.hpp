@@ -0,0 +1,211 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+/*
+交互预览：由粗到细逐遍渲染，每遍结束把当前图像发布给回调并存入共享帧缓冲。
+    1. 子采样遍：步长 startStride, startStride/2, …, 1，每遍只追踪坐标为步长整数倍、且上一遍没追踪过的像素（交错子集），
+       每像素 1 个面光源样本；显示时未追踪的像素取所在步长块左上角已追踪像素的值
+    2. 加样遍：全分辨率，按 8×8 小图块走 Engine::renderTile（与最终渲染同一路径），每遍的面光源样本数等于已累计的样本数（累计数翻倍），直到 targetSamples
+restart / cancel 递增代数，渲染线程每个像素（加样遍为每个小图块）检查一次，毫秒级退出；cancel 返回后渲染线程不再访问 Engine，可以修改场景。
+*/
+struct PreviewPassInfo {
+    size_t pass = 0;     // 本次渲染的第几遍（从 0 开始）
+    size_t stride = 0;   // 已追踪像素的间距，1 表示全分辨率
+    int samples = 0;     // 全分辨率阶段每像素累计的面光源样本数（子采样阶段为 1）
+    double seconds = 0;  // 自 restart 起的耗时
+    bool final = false;  // 已达到 targetSamples
+};
+
+template<typename T = float>
+class PreviewRenderer {
+public:
+    using Callback = std::function<void(const Framebuffer<T>&, const PreviewPassInfo&)>;
+    size_t startStride = 8;  // 首遍步长，须为 2 的幂
+    int targetSamples = 50;
+    T sigma = 0.05f;
+    size_t threads = 0;
+
+    // onPass 在控制线程中调用，调用期间不会开始下一遍；可为空，只用 snapshot 取图
+    PreviewRenderer(const Engine<T>& __engine, Callback __onPass = Callback())
+        : engine(__engine), onPass(std::move(__onPass)), controller([this] { controlLoop(); }) {}
+    ~PreviewRenderer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shutdown = true;
+            ++generation;
+        }
+        wake.notify_all();
+        controller.join();
+    }
+    PreviewRenderer(const PreviewRenderer&) = delete;
+    PreviewRenderer& operator=(const PreviewRenderer&) = delete;
+
+    // 以新相机（重新）开始，不等待旧的渲染退出
+    void restart(const Camera<T>& camera, uint64_t seed = 0) {
+        if (startStride == 0 || (startStride & (startStride - 1))) throw std::invalid_argument("startStride must be a power of two.");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = Job{ camera, seed };
+            ++generation;
+        }
+        wake.notify_all();
+    }
+    // 取消当前渲染并等待渲染线程退出
+    void cancel() {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.reset();
+        ++generation;
+        wake.notify_all();
+        idle.wait(lock, [&] { return !running; });
+    }
+    // 等待当前渲染完成（或被取消）
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return !running && !pending; });
+    }
+    // 复制最近一次发布的图像，返回其遍信息；尚未发布过时 out 为空
+    PreviewPassInfo snapshot(Framebuffer<T>& out) const {
+        std::lock_guard<std::mutex> lock(publishLock);
+        out = published;
+        return publishedInfo;
+    }
+private:
+    struct Job {
+        Camera<T> camera;
+        uint64_t seed;
+    };
+    const Engine<T>& engine;
+    Callback onPass;
+    mutable std::mutex mutex, publishLock;
+    std::condition_variable wake, idle;
+    std::optional<Job> pending;
+    std::atomic<uint64_t> generation{ 0 };
+    bool running = false, shutdown = false;
+    static constexpr size_t REFINE_TILE = 8;
+    Framebuffer<T> sum, scratch, published; // sum：每像素颜色 × 样本数的累计
+    std::vector<T> weight;         // 每像素累计样本数，0 表示尚未追踪
+    PreviewPassInfo publishedInfo;
+    std::thread controller;        // 最后初始化：构造时即开始运行
+
+    void controlLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&] { return shutdown || pending.has_value(); });
+            if (shutdown) break;
+            const Job job = *pending;
+            pending.reset();
+            const uint64_t gen = generation.load();
+            running = true;
+            lock.unlock();
+            renderJob(job, gen);
+            lock.lock();
+            running = false;
+            idle.notify_all();
+        }
+        running = false;
+        idle.notify_all();
+    }
+    inline bool cancelled(uint64_t gen) const { return generation.load(std::memory_order_relaxed) != gen; }
+    void renderJob(const Job& job, uint64_t gen) {
+        QE_PROFILE_SCOPE("PreviewRenderer::render");
+        const auto start = std::chrono::steady_clock::now();
+        const size_t width = size_t(job.camera.width), height = size_t(job.camera.height);
+        sum.resize(width, height);
+        weight.assign(width * height, T(0));
+        PreviewPassInfo info;
+        // 1. 子采样遍
+        for (size_t stride = startStride; stride >= 1; stride /= 2, ++info.pass) {
+            const size_t coarser = stride * 2;
+            const bool first = stride == startStride;
+            if (!tracePass(job, gen, info.pass, 1, stride, [&](size_t x, size_t y) {
+                    return first || x % coarser != 0 || y % coarser != 0;
+                })) return;
+            info.stride = stride;
+            info.samples = 1;
+            info.final = stride == 1 && targetSamples <= 1;
+            publish(job, info, start);
+            if (cancelled(gen)) return;
+        }
+        // 2. 加样遍
+        for (int samples = 1; samples < targetSamples; ++info.pass) {
+            const int spp = std::min(samples, targetSamples - samples);
+            if (!refinePass(job, gen, info.pass, spp)) return;
+            samples += spp;
+            info.samples = samples;
+            info.final = samples >= targetSamples;
+            publish(job, info, start);
+            if (cancelled(gen)) return;
+        }
+    }
+    // 追踪一遍：步长 stride 的网格上满足 select 的像素，每像素 spp 个面光源样本；被取消时返回 false
+    template<typename Select>
+    bool tracePass(const Job& job, uint64_t gen, size_t pass, int spp, size_t stride, Select&& select) {
+        const size_t width = sum.width(), rows = (sum.height() + stride - 1) / stride;
+        const uint64_t passSeed = deriveSeed(job.seed, pass);
+        parallelFor(0, rows, [&](size_t row) {
+            const size_t y = row * stride;
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(passSeed, y)));
+            for (size_t x = 0; x < width; x += stride) {
+                if (cancelled(gen)) return;
+                if (!select(x, y)) continue;
+                const auto color = engine.renderPixel(rng, job.camera.generateRay(y, x), sigma, spp);
+                sum.add(x, y, color ? *color * T(spp) : Vec3<T>(0, 0, 0));
+                weight[y * width + x] += T(spp);
+            }
+        }, threads);
+        return !cancelled(gen);
+    }
+    bool refinePass(const Job& job, uint64_t gen, size_t pass, int spp) {
+        const size_t width = sum.width();
+        const auto tiles = makeTiles(width, sum.height(), REFINE_TILE);
+        scratch.resize(width, sum.height());
+        const uint64_t passSeed = deriveSeed(job.seed, pass);
+        parallelFor(0, tiles.size(), [&](size_t idx) {
+            if (cancelled(gen)) return;
+            const Tile& tile = tiles[idx];
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(passSeed, idx)));
+            engine.renderTile(rng, job.camera, scratch, tile, sigma, spp);
+            for (size_t y = tile.y0; y < tile.y1; ++y)
+                for (size_t x = tile.x0; x < tile.x1; ++x) {
+                    sum.add(x, y, scratch.get(x, y) * T(spp));
+                    weight[y * width + x] += T(spp);
+                }
+        }, threads);
+        return !cancelled(gen);
+    }
+    // 未追踪的像素取所在 stride 块左上角的值
+    void publish(const Job& job, const PreviewPassInfo& info, std::chrono::steady_clock::time_point start) {
+        const size_t width = sum.width(), height = sum.height(), mask = ~(info.stride - 1);
+        {
+            std::lock_guard<std::mutex> lock(publishLock);
+            published.resize(width, height);
+            parallelFor(0, height, [&](size_t y) {
+                for (size_t x = 0; x < width; ++x) {
+                    const size_t sx = x & mask, sy = y & mask;
+                    const T w = weight[sy * width + sx];
+                    published.set(x, y, w > 0 ? sum.get(sx, sy) / w : Vec3<T>(0, 0, 0));
+                }
+            }, threads, 16);
+            publishedInfo = info;
+            publishedInfo.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (onPass) onPass(published, publishedInfo);
+    }
+};
+#endif
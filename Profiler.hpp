@@ -0,0 +1,146 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+/*
+逐阶段帧剖析：
+    QE_PROFILE_SCOPE("名字") 在作用域结束时记录一段耗时。
+    仅在定义 QE_ENABLE_PROFILER 时生效，否则宏展开为空，零开销。
+    每个线程独占一个环形缓冲（写入无锁，满了覆盖最旧事件）和一份按名字累计的统计，
+    导出 Chrome / Perfetto 可读的 trace JSON（chrome://tracing 或 ui.perfetto.dev 打开）以及各阶段汇总。
+    名字必须是字符串字面量（按指针区分）。导出应在被测线程空闲时进行。
+    计时粒度应在图块 / 阶段级：逐像素计时一帧就会写满环形缓冲，trace 只剩最后一小段。
+*/
+namespace Profiler {
+struct Event {
+    const char* name;
+    uint64_t start, end; // 纳秒，相对进程内首次计时
+};
+struct StageStat {
+    const char* name;
+    uint64_t count = 0, total = 0, max = 0;
+};
+inline uint64_t now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+class ThreadBuffer {
+public:
+    static constexpr size_t CAPACITY = size_t(1) << 16;
+    uint32_t tid;
+    std::vector<Event> ring;
+    std::atomic<uint64_t> head{ 0 };   // 已写入的事件总数
+    std::vector<StageStat> stats;      // 阶段数很少，线性查找即可
+    explicit ThreadBuffer(uint32_t __tid) : tid(__tid), ring(CAPACITY) {}
+    inline void record(const char* name, uint64_t start, uint64_t end) {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        ring[h & (CAPACITY - 1)] = Event{ name, start, end };
+        head.store(h + 1, std::memory_order_release);
+        const uint64_t d = end - start;
+        for (auto& s : stats)
+            if (s.name == name) { ++s.count; s.total += d; s.max = std::max(s.max, d); return; }
+        stats.push_back(StageStat{ name, 1, d, d });
+    }
+};
+class Registry {
+public:
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers; // 线程退出后缓冲仍保留，便于导出
+    static Registry& instance() { static Registry r; return r; }
+    ThreadBuffer* create() {
+        std::lock_guard<std::mutex> guard(lock);
+        buffers.push_back(std::make_unique<ThreadBuffer>(uint32_t(buffers.size())));
+        return buffers.back().get();
+    }
+};
+inline ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = Registry::instance().create();
+    return *buffer;
+}
+class ScopedTimer {
+    const char* name;
+    uint64_t start;
+public:
+    explicit ScopedTimer(const char* __name) : name(__name), start(now()) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer() { threadBuffer().record(name, start, now()); }
+};
+// 合并所有线程的阶段统计
+inline std::vector<StageStat> summary() {
+    auto& reg = Registry::instance();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    std::vector<StageStat> merged;
+    for (const auto& buf : reg.buffers)
+        for (const auto& s : buf->stats) {
+            auto it = std::find_if(merged.begin(), merged.end(), [&](const StageStat& m) { return std::string(m.name) == s.name; });
+            if (it == merged.end()) merged.push_back(s);
+            else { it->count += s.count; it->total += s.total; it->max = std::max(it->max, s.max); }
+        }
+    std::sort(merged.begin(), merged.end(), [](const StageStat& a, const StageStat& b) { return a.total > b.total; });
+    return merged;
+}
+inline std::string summaryText() {
+    std::ostringstream out;
+    out << "stage                              count     total(ms)    mean(us)     max(us)\n";
+    for (const auto& s : summary()) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-32s %8llu %13.3f %11.3f %11.3f\n", s.name, (unsigned long long)s.count,
+                      s.total / 1e6, s.count ? s.total / 1e3 / double(s.count) : 0.0, s.max / 1e3);
+        out << line;
+    }
+    return out.str();
+}
+inline std::string escape(const char* s) {
+    std::string r;
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') r += '\\';
+        r += *s;
+    }
+    return r;
+}
+// Chrome trace event 格式（"X" 完整事件，时间单位微秒）
+inline void writeChromeTrace(const std::string& filename) {
+    auto& reg = Registry::instance();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    std::ofstream out(filename);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    char buf[64];
+    for (const auto& tb : reg.buffers) {
+        const uint64_t h = tb->head.load(std::memory_order_acquire);
+        const uint64_t begin = h > ThreadBuffer::CAPACITY ? h - ThreadBuffer::CAPACITY : 0;
+        for (uint64_t i = begin; i < h; ++i) {
+            const Event& e = tb->ring[i & (ThreadBuffer::CAPACITY - 1)];
+            out << (first ? "" : ",") << "\n{\"name\":\"" << escape(e.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tb->tid;
+            std::snprintf(buf, sizeof(buf), ",\"ts\":%.3f,\"dur\":%.3f}", e.start / 1e3, (e.end - e.start) / 1e3);
+            out << buf;
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+inline void reset() {
+    auto& reg = Registry::instance();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    for (auto& tb : reg.buffers) { tb->head.store(0); tb->stats.clear(); }
+}
+}
+#define QE_PROFILE_CONCAT_INNER(a, b) a##b
+#define QE_PROFILE_CONCAT(a, b) QE_PROFILE_CONCAT_INNER(a, b)
+#ifdef QE_ENABLE_PROFILER
+#define QE_PROFILE_SCOPE(name) ::Profiler::ScopedTimer QE_PROFILE_CONCAT(__qeProfileScope, __LINE__)(name)
+#else
+#define QE_PROFILE_SCOPE(name) ((void)0)
+#endif
+#endif
@@ -0,0 +1,268 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <exception>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "MappedFile.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+/*
+渐进渲染的检查点文件：内存映射的浮点累加缓冲，进程被抢占后从中断处继续，结果与一次跑完逐位相同。
+文件布局（按页对齐）：
+    头部       魔数、版本、元素大小，以及决定结果的全部参数（分辨率、图块大小、种子、每遍面光源采样数、sigma）
+    图块记录   每图块已落盘的遍数 passes 与下一遍的随机数流种子
+    图块数据   每图块 3 个槽，槽 k 存前 k 遍之和（k 取模 3），图块内行主序 RGB
+第 p 遍读槽 p%3、写槽 (p+1)%3，已落盘的槽与正在落盘的槽都不会被覆盖；只有记录里的 passes 之前的数据在 msync 之后才写进记录，
+因此任何时刻断电，文件里的记录都指向完整的数据。msync 失败时 commit 抛异常且不更新记录。
+打开已有文件时不改变其大小：大小或头部与当前设置不符即报错，只有不存在或为空的文件才会被创建并扩展。
+*/
+template<typename T = float>
+class AccumulationBuffer {
+private:
+    static constexpr char MAGIC[8] = { 'Q', 'E', 'A', 'C', 'C', 'U', 'M', 0 };
+    static constexpr uint32_t VERSION = 1;
+    struct Header {
+        char magic[8];
+        uint32_t version, elementSize;
+        uint64_t width, height, tileSize, tileCount, seed, spp;
+        double sigma;
+    };
+    struct TileRecord {
+        uint64_t passes;   // 已落盘的遍数（即每像素的样本遍数）
+        uint64_t nextSeed; // 下一遍该图块的随机数流种子，恢复时用于校验
+    };
+public:
+    static constexpr size_t SLOTS = 3;
+    // 第 pass 遍使用的种子；第 0 遍与 Engine::render(seed) 相同
+    static uint64_t passSeed(uint64_t seed, uint64_t pass) { return pass ? deriveSeed(seed, pass) : seed; }
+
+    // 打开已有检查点或新建；已有文件的参数与给定的不一致时抛出异常，避免把不同设置的结果累加到一起
+    AccumulationBuffer(const std::string& filename, size_t __width, size_t __height, size_t __tileSize, uint64_t __seed,
+                       T __sigma = 0.05f, int __spp = 5)
+        : tileList(makeTiles(__width, __height, __tileSize)) {
+        Header expected{};
+        std::memcpy(expected.magic, MAGIC, sizeof(expected.magic));
+        expected.version = VERSION;
+        expected.elementSize = sizeof(T);
+        expected.width = __width; expected.height = __height; expected.tileSize = __tileSize;
+        expected.tileCount = tileList.size();
+        expected.seed = __seed; expected.spp = uint64_t(__spp); expected.sigma = double(__sigma);
+        // 计算布局
+        recordOffset = pageAlign(sizeof(Header));
+        dataOffset = pageAlign(recordOffset + tileList.size() * sizeof(TileRecord));
+        tileOffset.resize(tileList.size());
+        size_t offset = dataOffset;
+        for (size_t t = 0; t < tileList.size(); ++t) {
+            tileOffset[t] = offset;
+            offset += SLOTS * slotBytes(t);
+        }
+        // 先按原大小打开：已有的检查点在校验通过前不能被截断或扩展
+        file = MappedFile(filename, true);
+        if (file.size() == 0) file = MappedFile(filename, true, offset);
+        if (file.size() != offset) throw std::runtime_error("checkpoint " + filename + " has unexpected size.");
+        Header& header = *reinterpret_cast<Header*>(file.data());
+        if (header.magic[0] == 0) {
+            // 新文件（全零），写入头部后立即落盘
+            header = expected;
+            if (!file.flush(0, sizeof(Header))) throw std::runtime_error("cannot write checkpoint " + filename);
+        } else if (std::memcmp(&header, &expected, sizeof(Header)) != 0)
+            throw std::runtime_error("checkpoint " + filename + " was written with different render settings.");
+        for (size_t t = 0; t < tileList.size(); ++t)
+            if (record(t).passes && record(t).nextSeed != deriveSeed(passSeed(__seed, record(t).passes), t))
+                throw std::runtime_error("checkpoint " + filename + " has a corrupt tile record.");
+    }
+    inline const Header& header() const { return *reinterpret_cast<const Header*>(file.data()); }
+    inline size_t width() const { return header().width; }
+    inline size_t height() const { return header().height; }
+    inline uint64_t seed() const { return header().seed; }
+    inline int spp() const { return int(header().spp); }
+    inline T sigma() const { return T(header().sigma); }
+    inline const std::vector<Tile>& tiles() const { return tileList; }
+    // 图块已落盘的遍数
+    inline uint64_t passes(size_t t) const { return record(t).passes; }
+    uint64_t minPasses() const {
+        uint64_t result = UINT64_MAX;
+        for (size_t t = 0; t < tileList.size(); ++t) result = std::min(result, passes(t));
+        return tileList.empty() ? 0 : result;
+    }
+    // 把第 pass 遍的结果（src 中该图块的区域）累加进槽 (pass+1)%3；由渲染线程调用，不同图块可并发
+    void accumulate(size_t t, uint64_t pass, const Framebuffer<T>& src) {
+        const Tile& tile = tileList[t];
+        const T* prev = slot(t, pass % SLOTS);
+        T* dst = slot(t, (pass + 1) % SLOTS);
+        const size_t rowValues = tile.width() * 3;
+        for (size_t y = tile.y0; y < tile.y1; ++y) {
+            const T* in = src.row(y) + tile.x0 * 3;
+            const size_t base = (y - tile.y0) * rowValues;
+            if (pass == 0) std::memcpy(dst + base, in, rowValues * sizeof(T));
+            else for (size_t i = 0; i < rowValues; ++i) dst[base + i] = prev[base + i] + in[i];
+        }
+    }
+    // 检查点：先同步刷回各图块 passes[t] 对应的槽，再写记录并刷回；passes[t] 不小于已落盘的遍数
+    // 槽刷回失败时不改记录直接抛异常；记录刷回失败时同样抛异常，此时文件中的记录是新旧之一，均指向已落盘的槽
+    void commit(const std::vector<uint64_t>& passes) {
+        QE_PROFILE_SCOPE("AccumulationBuffer::commit");
+        bool changed = false;
+        for (size_t t = 0; t < tileList.size(); ++t) {
+            if (passes[t] == record(t).passes) continue;
+            if (!file.flush(tileOffset[t] + (passes[t] % SLOTS) * slotBytes(t), slotBytes(t)))
+                throw std::runtime_error("checkpoint flush failed.");
+            changed = true;
+        }
+        if (!changed) return;
+        for (size_t t = 0; t < tileList.size(); ++t) {
+            record(t).nextSeed = deriveSeed(passSeed(seed(), passes[t]), t);
+            record(t).passes = passes[t];
+        }
+        if (!file.flush(recordOffset, tileList.size() * sizeof(TileRecord))) throw std::runtime_error("checkpoint record flush failed.");
+    }
+    // 取各图块已落盘部分的平均值；尚未渲染的图块写 0
+    void resolve(Framebuffer<T>& out) const {
+        out.resize(width(), height());
+        for (size_t t = 0; t < tileList.size(); ++t) {
+            const Tile& tile = tileList[t];
+            const uint64_t n = passes(t);
+            if (n == 0) continue;
+            const T* src = slot(t, n % SLOTS);
+            const T inv = T(1) / T(n);
+            const size_t rowValues = tile.width() * 3;
+            for (size_t y = tile.y0; y < tile.y1; ++y) {
+                T* dst = out.row(y) + tile.x0 * 3;
+                for (size_t i = 0; i < rowValues; ++i) dst[i] = src[(y - tile.y0) * rowValues + i] * inv;
+            }
+        }
+    }
+private:
+    MappedFile file;
+    std::vector<Tile> tileList;
+    std::vector<size_t> tileOffset;
+    size_t recordOffset = 0, dataOffset = 0;
+    static size_t pageAlign(size_t bytes) {
+        const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        return (bytes + page - 1) / page * page;
+    }
+    inline size_t slotBytes(size_t t) const { return tileList[t].pixelCount() * 3 * sizeof(T); }
+    inline T* slot(size_t t, size_t k) const { return reinterpret_cast<T*>(file.data() + tileOffset[t] + k * slotBytes(t)); }
+    inline TileRecord& record(size_t t) const { return reinterpret_cast<TileRecord*>(file.data() + recordOffset)[t]; }
+};
+
+/*
+可中断的渐进渲染：按遍推进（一遍内所有图块并行），每遍每像素用 spp 个面光源样本，随机数流由 (种子, 遍, 图块) 决定，
+恢复后继续的结果与不中断一次跑完逐位相同，也与线程数无关。
+检查点由后台线程完成：每遍结束后、以及每隔 checkpointSeconds 秒各做一次，渲染线程不等待磁盘。
+只有磁盘慢到一遍都刷不完时，领先已落盘两遍的图块才会等待（否则会覆盖仍需保留的槽）。
+检查点失败（commit 抛异常）时停止渲染，run 在后台线程退出后重新抛出该异常。
+辐照度缓存的内容取决于线程调度且不随检查点保存，设置了 Engine::irradianceCache 时 run 直接抛异常。
+*/
+template<typename T = float>
+class ProgressivePass {
+public:
+    size_t threads = 0;
+    double checkpointSeconds = 30;
+    uint64_t lastCheckpoints = 0; // 最近一次 run 做的检查点次数
+    // 可在信号处理函数中调用：已开始的图块渲染完，做最后一次检查点后 run 返回
+    void requestStop() { stopRequested.store(true, std::memory_order_relaxed); }
+    // onTile(tile, passes) 在图块完成一遍后由渲染线程调用；返回是否所有图块都达到 targetPasses
+    template<typename OnTile>
+    bool run(const Engine<T>& engine, const Camera<T>& camera, AccumulationBuffer<T>& acc, uint64_t targetPasses, OnTile&& onTile) {
+        QE_PROFILE_SCOPE("ProgressivePass::run");
+        if (engine.irradianceCache) throw std::runtime_error("progressive rendering does not support Engine::irradianceCache.");
+        const auto& tiles = acc.tiles();
+        Framebuffer<T> scratch(acc.width(), acc.height()); // 各图块只写自己的区域
+        std::vector<std::atomic<uint64_t>> live(tiles.size());
+        durable.assign(tiles.size(), 0);
+        for (size_t t = 0; t < tiles.size(); ++t) { durable[t] = acc.passes(t); live[t].store(durable[t], std::memory_order_relaxed); }
+        finished = false; wantCheckpoint = false; lastCheckpoints = 0; checkpointError = nullptr;
+        std::thread checkpointer([&] { checkpointLoop(acc, live); });
+        VisibilityBuffer<T> visibility;
+        if (engine.rasterPrimary) engine.rasterizeVisibility(camera, visibility, threads);
+        for (uint64_t pass = acc.minPasses(); pass < targetPasses && !stopRequested.load(std::memory_order_relaxed); ++pass) {
+            const uint64_t seed = AccumulationBuffer<T>::passSeed(acc.seed(), pass);
+            parallelFor(0, tiles.size(), [&](size_t t) {
+                if (stopRequested.load(std::memory_order_relaxed) || live[t].load(std::memory_order_relaxed) != pass) return;
+                if (!waitForSlot(t, pass)) return;
+                engine.renderTile(camera, scratch, tiles[t], seed, t, acc.sigma(), acc.spp(), engine.rasterPrimary ? &visibility : nullptr);
+                acc.accumulate(t, pass, scratch);
+                live[t].store(pass + 1, std::memory_order_release);
+                onTile(tiles[t], pass + 1);
+            }, threads);
+            requestCheckpoint();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        checkpointCv.notify_one();
+        checkpointer.join();
+        stopRequested.store(false, std::memory_order_relaxed);
+        if (checkpointError) std::rethrow_exception(checkpointError);
+        return acc.minPasses() >= targetPasses;
+    }
+    bool run(const Engine<T>& engine, const Camera<T>& camera, AccumulationBuffer<T>& acc, uint64_t targetPasses) {
+        return run(engine, camera, acc, targetPasses, [](const Tile&, uint64_t) {});
+    }
+private:
+    std::atomic<bool> stopRequested{ false };
+    std::mutex mutex;
+    std::condition_variable checkpointCv, slotCv;
+    std::vector<uint64_t> durable; // 已落盘的遍数，受 mutex 保护
+    bool finished = false, wantCheckpoint = false;
+    std::exception_ptr checkpointError; // 受 mutex 保护
+
+    void requestCheckpoint() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wantCheckpoint = true;
+        }
+        checkpointCv.notify_one();
+    }
+    // 第 pass 遍写槽 (pass+1)%3，不能是已落盘的槽 durable%3 或正在落盘的槽，即 pass + 1 ≤ durable + 2
+    // 检查点已失败时返回 false，该图块不再渲染
+    bool waitForSlot(size_t t, uint64_t pass) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (pass + 1 <= durable[t] + 2) return !checkpointError;
+        wantCheckpoint = true;
+        checkpointCv.notify_one();
+        slotCv.wait(lock, [&] { return pass + 1 <= durable[t] + 2 || checkpointError; });
+        return !checkpointError;
+    }
+    void checkpointLoop(AccumulationBuffer<T>& acc, const std::vector<std::atomic<uint64_t>>& live) {
+        std::vector<uint64_t> snapshot(live.size());
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            checkpointCv.wait_for(lock, std::chrono::duration<double>(checkpointSeconds), [&] { return wantCheckpoint || finished; });
+            const bool last = finished;
+            wantCheckpoint = false;
+            lock.unlock();
+            for (size_t t = 0; t < live.size(); ++t) snapshot[t] = live[t].load(std::memory_order_acquire);
+            try {
+                acc.commit(snapshot);
+            } catch (...) {
+                // 记录未推进，durable 保持不变；停止渲染并唤醒等待槽位的线程
+                lock.lock();
+                checkpointError = std::current_exception();
+                stopRequested.store(true, std::memory_order_relaxed);
+                slotCv.notify_all();
+                return;
+            }
+            lock.lock();
+            durable = snapshot;
+            ++lastCheckpoints;
+            slotCv.notify_all();
+            if (last) return;
+        }
+    }
+};
+#endif
@@ -12,7 +12,21 @@
 #include "Material.hpp"
 #include "BVH.hpp"
 #include "Object.hpp"
+#include "Arena.hpp"
+#include "Profiler.hpp"
+#include "MemoryStats.hpp"
+#include <unordered_set>
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Random.hpp"
+#include "Rasterizer.hpp"
+#include "Denoiser.hpp"
+#include "LOD.hpp"
+#include "IrradianceCache.hpp"
 #include <random>
+#include <atomic>
+#include <limits>
 /*
 漫反射着色器（Diffuse Shader）
 表现物体表面对光线的均匀反射（如粉笔、墙壁等无光泽表面）。
@@ -40,34 +54,224 @@ public:
     std::vector<Instance<T>> instances; // 场景物体
     std::vector<Light<T>*> lights;   // 场景光源
     TLAS<T> tlas;
+    Arena sceneArena; // make() 创建的场景对象（光源、材质等），随 Engine 一起析构
     Engine(
         const std::vector<Instance<T>>& __instances = std::vector<Instance<T>>(),
         const std::vector<Light<T>*>& __lights = std::vector<Light<T>*>()
     ) : instances(__instances), lights(__lights), tlas() {}
     void insertInstance(const Instance<T>& ins) { instances.push_back(ins); }
     void insertLight(Light<T>* light) { lights.push_back(light); }
+    // 只构建 TLAS；各对象的 BLAS 在光线第一次进入其叶子时按需构建（也可提前 prewarm）
     void init() { tlas.build(instances); }
+    // 并行预构建已知可见对象的 BLAS，避免渲染线程在首帧排队等待
+    void prewarm(const std::vector<Object<T>*>& objects, size_t threads = 0) {
+        parallelFor(0, objects.size(), [&](size_t i) { objects[i]->prepare(); }, threads);
+    }
+    void prewarm(size_t threads = 0) {
+        std::unordered_set<Object<T>*> seen;
+        std::vector<Object<T>*> objects;
+        for (const auto& ins : instances)
+            if (seen.insert(ins.object).second) objects.push_back(ins.object);
+        prewarm(objects, threads);
+    }
+    // 用低分辨率主光线探测相机可见的对象：被射中的叶子顺带完成 BLAS 构建
+    void prewarm(const Camera<T>& camera, size_t samplesX = 64, size_t samplesY = 36, size_t threads = 0) {
+        parallelFor(0, samplesY, [&](size_t sy) {
+            const size_t y = std::min(size_t(camera.height) - 1, (sy * 2 + 1) * size_t(camera.height) / (samplesY * 2));
+            for (size_t sx = 0; sx < samplesX; ++sx) {
+                const size_t x = std::min(size_t(camera.width) - 1, (sx * 2 + 1) * size_t(camera.width) / (samplesX * 2));
+                tlas.intersect(camera.generateRay(y, x));
+            }
+        }, threads);
+    }
+    // 尚未构建 BLAS 的对象数
+    size_t pendingObjects() const {
+        std::unordered_set<const Object<T>*> seen;
+        size_t pending = 0;
+        for (const auto& ins : instances)
+            if (seen.insert(ins.object).second) pending += !ins.object->isPrepared();
+        return pending;
+    }
+    // 为带 LOD 链的实例按相机选级：投影到屏幕的几何误差不超过 pixelError 像素的最粗一级，相机位于包围球内时用原网格。
+    // 只按距离选、不做视锥剔除，阴影光线看到的几何与主光线一致；有实例切换时原地 refit TLAS，返回切换的实例数
+    size_t selectLOD(const Camera<T>& camera, T pixelError = 1) {
+        QE_PROFILE_SCOPE("Engine::selectLOD");
+        const T pixelsPerUnitAtOne = camera.height / camera.tfovh; // 距离 1 处单位长度对应的像素数
+        size_t changed = 0;
+        for (auto& ins : instances) {
+            if (!ins.lod) continue;
+            const T distance = (ins.translation + ins.lod->center - camera.position).length() - ins.lod->radius;
+            const size_t level = distance > 0 ? ins.lod->select(pixelsPerUnitAtOne / distance, pixelError) : 0;
+            Object<T>* object = ins.lod->levels[level];
+            if (object != ins.object) { ins.object = object; ++changed; }
+        }
+        if (changed) tlas.refit(instances);
+        return changed;
+    }
+    // 按子系统统计内存占用（被多个 Instance 共享的对象只计一次）
+    MemoryStats memoryStats() const {
+        MemoryStats stats;
+        std::unordered_set<const Object<T>*> seen;
+        for (const auto& ins : instances)
+            if (seen.insert(ins.object).second) ins.object->addMemoryStats(stats);
+        stats.instances += vectorBytes(instances);
+        stats.lights += vectorBytes(lights);
+        for (const auto light : lights)
+            stats.lights += light->getType() == LightType::Point ? sizeof(PointLight<T>) : sizeof(TriangleLight<T>);
+        stats.tlas += tlas.memoryBytes();
+        stats.scene += sceneArena.bytesReserved();
+        return stats;
+    }
+    // 在场景内存池中创建对象（如光源、材质、MaterialSet），生命周期归 Engine 管理
+    template<typename U, typename... Args>
+    U* make(Args&&... args) { return sceneArena.create<U>(std::forward<Args>(args)...); }
+    // 阴影光线逐条计时开销过大，其耗时计入 "shade" 阶段
+    inline std::optional<HitInfo<T>> traceShadow(const Ray<T>& shadowRay) const {
+        return tlas.intersect(shadowRay);
+    }
+    // 遮挡查询（any-hit）：(0, tMax) 内有任何交点即为被遮挡
+    inline bool traceOcclusion(const Ray<T>& shadowRay, T tMax) const {
+        return tlas.occluded(shadowRay, tMax);
+    }
+    // ================= 遮挡者缓存 =================
+    // 相邻着色点对同一光源往往被同一个三角形挡住：每个线程为每个光源记住上次的遮挡者，
+    // 新查询先测该三角形及其所在的 BLAS 小子树，命中即可跳过从 TLAS 根开始的遍历
+    bool occluderCache = true;
+    struct OccluderCacheStats {
+        uint64_t queries = 0, occluded = 0, hits = 0; // hits：由缓存直接判定遮挡的查询
+        double hitRate() const { return queries ? double(hits) / double(queries) : 0.0; }
+        double occludedHitRate() const { return occluded ? double(hits) / double(occluded) : 0.0; }
+    };
+    // 汇总计数由 Engine 与各线程缓存共同持有，Engine 先析构时线程里未汇总的计数仍可安全写入
+    struct OccluderCounters {
+        std::atomic<uint64_t> queries{ 0 }, occluded{ 0 }, hits{ 0 };
+    };
+    struct OccluderCache {
+        uint64_t tlasGeneration = 0;                  // 进程内唯一，区分不同 Engine 与同一 TLAS 的各次构建
+        std::shared_ptr<OccluderCounters> counters;   // 所属 Engine 的汇总计数
+        std::vector<OccluderHint<T>> hints; // 按光源下标
+        uint64_t queries = 0, occluded = 0, hits = 0; // 本线程尚未汇总的计数
+    };
+    OccluderCacheStats occluderCacheStats() const {
+        return OccluderCacheStats{ occluderCounters->queries.load(std::memory_order_relaxed), occluderCounters->occluded.load(std::memory_order_relaxed),
+                                   occluderCounters->hits.load(std::memory_order_relaxed) };
+    }
+    void resetOccluderCacheStats() { occluderCounters->queries = 0; occluderCounters->occluded = 0; occluderCounters->hits = 0; }
+private:
+    std::shared_ptr<OccluderCounters> occluderCounters = std::make_shared<OccluderCounters>();
+    // 图块结束时汇总；不经 renderTile 的调用方（时间复用、ReSTIR 等）每线程最多滞后这么多次查询
+    static constexpr uint64_t OCCLUDER_FLUSH_QUERIES = 4096;
+    // 本线程的缓存；换了 Engine 或 TLAS 重建后先把计数汇总给原来的 Engine，再整体清空（叶子指针已失效）
+    // 以 TLAS 的构建代数而不是 Engine 地址识别归属：新 Engine 即使复用了旧地址，代数也不同
+    OccluderCache& threadOccluderCache() const {
+        thread_local OccluderCache cache;
+        if (cache.counters != occluderCounters || cache.tlasGeneration != tlas.generation || cache.hints.size() != lights.size()) {
+            flushOccluderStats(cache);
+            cache.counters = occluderCounters;
+            cache.tlasGeneration = tlas.generation;
+            cache.hints.assign(lights.size(), OccluderHint<T>());
+        }
+        return cache;
+    }
+    static void flushOccluderStats(OccluderCache& cache) {
+        if (cache.counters && cache.queries) {
+            cache.counters->queries.fetch_add(cache.queries, std::memory_order_relaxed);
+            cache.counters->occluded.fetch_add(cache.occluded, std::memory_order_relaxed);
+            cache.counters->hits.fetch_add(cache.hits, std::memory_order_relaxed);
+        }
+        cache.queries = cache.occluded = cache.hits = 0;
+    }
+    inline bool occludedCached(OccluderCache& cache, const Ray<T>& shadowRay, T tMax, size_t light) const {
+        if (!occluderCache) return traceOcclusion(shadowRay, tMax);
+        OccluderHint<T>& hint = cache.hints[light];
+        if (cache.queries >= OCCLUDER_FLUSH_QUERIES) flushOccluderStats(cache);
+        ++cache.queries;
+        if (tlas.occludedByHint(shadowRay, tMax, hint)) { ++cache.hits; ++cache.occluded; return true; }
+        // 未命中则完整遍历并更新记录（未遮挡时保留旧记录）
+        const bool blocked = tlas.occluded(shadowRay, tMax, &hint);
+        cache.occluded += blocked;
+        return blocked;
+    }
+public:
+    // ================= 可见性缓冲 =================
+    // 开启后 render 先把整帧光栅化成 (实例, 图元) 缓冲，主光线只与记录的三角形求交，不再遍历 TLAS
+    bool rasterPrimary = false;
+    VisibilityPass<T> visibilityPass;
+    void rasterizeVisibility(const Camera<T>& camera, VisibilityBuffer<T>& visibility, size_t threads = 0) const {
+        VisibilityPass<T> pass = visibilityPass;
+        if (threads) pass.threads = threads;
+        pass.run(instances, camera, visibility);
+    }
+    // 主光线最近交点：有可见性缓冲时由记录的三角形重建，并补上不支持光栅化的实例；
+    // 重建失败（像素中心贴着三角形边等数值差异）时退回完整追踪
+    std::optional<HitInfo<T>> primaryHit(const Ray<T>& ray, size_t x, size_t y, const VisibilityBuffer<T>* visibility) const {
+        if (!visibility) return tlas.intersect(ray);
+        const size_t i = visibility->index(x, y);
+        std::optional<HitInfo<T>> closest;
+        if (visibility->instance[i] != VisibilityBuffer<T>::EMPTY) {
+            const Instance<T>& ins = instances[visibility->instance[i]];
+            Ray<T> localRay = ray;
+            localRay.origin -= ins.translation;
+            closest = ins.object->intersectPrimitive(localRay, visibility->primitive[i]);
+            if (!closest) return tlas.intersect(ray);
+            closest->position += ins.translation;
+            closest->instance = visibility->instance[i];
+        }
+        for (const uint32_t index : visibility->traced) {
+            const Instance<T>& ins = instances[index];
+            ins.object->prepare();
+            Ray<T> localRay = ray;
+            localRay.origin -= ins.translation;
+            auto hit = ins.object->intersect(localRay);
+            if (hit && (!closest || hit->t < closest->t)) {
+                hit->position += ins.translation;
+                hit->instance = index;
+                closest = hit;
+            }
+        }
+        return closest;
+    }
     template<typename URNG>
     std::optional<Vec3<T>> renderPixel(URNG& rng, const Ray<T>& ray, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5, const size_t deep = 2) const {
-        std::optional<HitInfo<T>> closestHit = tlas.intersect(ray);
+        return shadePixel(rng, ray, tlas.intersect(ray), sigma, TRI_LIGHT_SPP);
+    }
+    // 对已求得的主光线交点做直接光照着色（设置了 irradianceCache 时再加上间接漫反射）；variance 非空时输出面光源采样带来的亮度方差（均值的方差）
+    template<typename URNG>
+    std::optional<Vec3<T>> shadePixel(URNG& rng, const Ray<T>& ray, const std::optional<HitInfo<T>>& closestHit, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5,
+                                      T* variance = nullptr) const {
+        if (variance) *variance = 0;
         if (!closestHit) return std::nullopt;
+        Vec3<T> color = directLight(rng, -ray.direction, *closestHit, TRI_LIGHT_SPP, variance);
+        if (irradianceCache) color += indirectDiffuse(rng(), *closestHit, sigma);
+        color *= std::exp(-sigma * closestHit->t);
+        if (variance) *variance *= std::exp(-2 * sigma * closestHit->t);
+        // 反射和折射暂不实现
+        // if (tri->transparency.max() > EPSILON && deep > 0) {
+
+        // }
+        return color;
+    }
+    // 交点 hit 处（视线方向 view 指向观察者）所有光源的直接光照，不含介质衰减；variance 非空时累加面光源采样方差
+    template<typename URNG>
+    Vec3<T> directLight(URNG& rng, const Vec3<T>& view, const HitInfo<T>& hit, const int TRI_LIGHT_SPP, T* variance = nullptr) const {
         Vec3<T> color(0, 0, 0);
-        for (const auto& tmp : lights) {
+        OccluderCache& cache = threadOccluderCache();
+        for (size_t lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+            const Light<T>* tmp = lights[lightIndex];
             switch(tmp->getType()) {
             case LightType::Point:{
                 const PointLight<T>* light = dynamic_cast<const PointLight<T>*>(tmp);
-                Vec3<T> toLight = light->position - closestHit->position;
+                Vec3<T> toLight = light->position - hit.position;
                 const T len2 = toLight.lengthSquared();
                 if (len2 < T(0)) continue;
                 const T len = std::sqrt(len2);
                 toLight /= len;
 
-                const Ray<T> shadowRay(closestHit->position + closestHit->normal * EPSILON, toLight); // 偏移以防自阴影
-                auto shadownHit = tlas.intersect(shadowRay);
-                if (shadownHit && shadownHit->t < len) continue; // 阴影遮挡，跳过该光源
+                const Ray<T> shadowRay(hit.position + hit.normal * EPSILON, toLight); // 偏移以防自阴影
+                if (occludedCached(cache, shadowRay, len, lightIndex)) continue; // 阴影遮挡，跳过该光源
                 const Vec3<T> input = light->color / len2;
-                for (const auto& material : *closestHit->materialSet)
-                    color += material.second * material.first->getColor(input, -ray.direction, toLight, closestHit->normal, 0, 0);
+                for (const auto& material : *hit.materialSet)
+                    color += material.second * material.first->getColor(input, view, toLight, hit.normal, hit.u, hit.v);
                 break;
             }
             case LightType::Triangle:{
@@ -75,11 +279,12 @@ public:
                 const TriangleLight<T>* light = dynamic_cast<const TriangleLight<T>*>(tmp);
                 Vec3<T> sum(0,0,0);
                 if (light->area <= T(0)) continue;
+                SampleMoments moments;
                 for (int i = 0; i < TRI_LIGHT_SPP; ++i) {
                     // 1) 采样光源面一点
                     auto position = light->samplePoint(rng);
                     // 2) 方向/距离
-                    Vec3<T> toLight = position - closestHit->position;
+                    Vec3<T> toLight = position - hit.position;
                     const T len2 = toLight.lengthSquared();
                     if (len2 <= T(0)) continue;
                     const T len  = std::sqrt(len2);
@@ -87,30 +292,288 @@ public:
                     const T cosL = light->normal.dot(-toLight);
                     if (cosL <= T(0)) continue;
                     // 3) 可见性：阴影测试（距离裁剪）
-                    const Ray<T> shadowRay(closestHit->position + closestHit->normal * EPSILON, toLight);
-                    auto shadownHit = tlas.intersect(shadowRay);
-                    if (shadownHit && shadownHit->t < len) continue; // 阴影遮挡，跳过该光源
+                    const Ray<T> shadowRay(hit.position + hit.normal * EPSILON, toLight);
+                    if (occludedCached(cache, shadowRay, len, lightIndex)) continue; // 阴影遮挡，跳过该光源
                     // 4) NEE 权重：Li * (cosL) / (dist^2 * pdfA)
                     // 其中 Li = light->emission（radiance，常量）
                     // getColor 内部会再乘一次 NdotL（接收端），等效得到 f * Li * NdotL * cosL / (dist^2 * pdfA)
                     const Vec3<T> input = light->color * light->area * cosL / len2;
-                    for (const auto& material : *closestHit->materialSet)
-                        sum += material.second * material.first->getColor(input, -ray.direction, toLight, closestHit->normal, 0, 0);
+                    Vec3<T> sample(0, 0, 0);
+                    for (const auto& material : *hit.materialSet) {
+                        const Vec3<T> c = material.second * material.first->getColor(input, view, toLight, hit.normal, hit.u, hit.v);
+                        sum += c;
+                        sample += c;
+                    }
+                    moments.add(sample);
                 }
                 // 多重采样均值
                 color += sum / T(TRI_LIGHT_SPP);
+                if (variance) *variance += moments.meanVariance(TRI_LIGHT_SPP);
                 break;
             }
             default:
             break;
             }
         }
-        color *= std::exp(-sigma * closestHit->t);
-        // 反射和折射暂不实现
-        // if (tri->transparency.max() > EPSILON && deep > 0) {
-
-        // }
         return color;
     }
+    // ================= 间接漫反射 =================
+    // 非空时主光线交点加上一次漫反射反弹：辐照度从缓存插值，缓存没有可用记录时在此处半球采样生成新记录，
+    // 反弹光线的交点只算直接光照（每个面光源 1 个样本）并乘以沿途的介质衰减。缓存由调用方持有，可跨帧复用（场景与光源不变时）。
+    // 半球样本取自以 indirectSeed 为种子的独立随机数流：着色路径只为每个命中像素从主随机数流取一个种子，
+    // 批量阴影与逐像素路径的取数顺序因此一致。记录按渲染线程的调度顺序插入，多线程时图像不可逐位复现，
+    // 渐进式断点续渲与分布式渲染要求逐位一致，拒绝设置了缓存的 Engine
+    IrradianceCache<T>* irradianceCache = nullptr;
+    Vec3<T> indirectDiffuse(uint64_t indirectSeed, const HitInfo<T>& hit, const T sigma) const {
+        Vec3<T> diffuse(0, 0, 0);
+        for (const auto& material : *hit.materialSet)
+            diffuse += material.second * material.first->getDiffuse(hit.u, hit.v);
+        if (diffuse.x <= 0 && diffuse.y <= 0 && diffuse.z <= 0) return Vec3<T>(0, 0, 0);
+        Vec3<T> irradiance;
+        if (!irradianceCache->lookup(hit.position, hit.normal, irradiance)) {
+            QE_PROFILE_SCOPE("irradiance.record");
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(indirectSeed));
+            irradiance = irradianceCache->compute(rng, hit.position, hit.normal, [&](const Ray<T>& ray, T& distance) {
+                const auto bounce = tlas.intersect(ray);
+                if (!bounce) return Vec3<T>(0, 0, 0);
+                distance = bounce->t;
+                return directLight(rng, -ray.direction, *bounce, 1) * std::exp(-sigma * bounce->t);
+            });
+        }
+        return diffuse * irradiance / T(PI);
+    }
+    // 图块级批量阴影：先为整块收集所有遮挡查询，按 (方向卦限, 起点 Morton 码) 排序后连续追踪，
+    // 相邻查询走过的 BVH 节点大多相同，缓存复用更好；可见性回填后再按原顺序累加，结果与逐像素路径一致
+    // （设置了 irradianceCache 时两者的记录插入顺序须相同，即单线程渲染且缓存初始内容相同）
+    bool batchShadows = true;
+    struct ShadowQuery {
+        Vec3<T> toLight, input; // 方向与入射辐照（未遮挡时的贡献参数）
+        T len;                  // 到光源的距离，作为遮挡查询的 tMax
+        uint32_t pixel, light;
+    };
+    struct TileShadingState {
+        std::vector<std::optional<HitInfo<T>>> hits;
+        std::vector<Vec3<T>> viewDirs;
+        std::vector<uint32_t> queryBegin;         // 每个像素的查询区间起点（最后一项为总数）
+        std::vector<ShadowQuery> queries;
+        std::vector<std::pair<uint64_t, uint32_t>> order; // (排序键, 查询下标)
+        std::vector<uint8_t> visible;
+        std::vector<uint64_t> indirectSeeds;      // 每个像素间接漫反射的随机数种子（设置了 irradianceCache 时）
+    };
+    template<typename URNG>
+    void renderTileBatched(URNG& rng, const Camera<T>& camera, Framebuffer<T>& fb, const Tile& tile, const T sigma, const int TRI_LIGHT_SPP,
+                           const VisibilityBuffer<T>* visibility = nullptr, AOVBuffer<T>* aovs = nullptr) const {
+        thread_local TileShadingState state;
+        const size_t pixels = tile.pixelCount();
+        state.hits.resize(pixels);
+        state.viewDirs.resize(pixels);
+        state.queryBegin.resize(pixels + 1);
+        state.queries.clear();
+        if (irradianceCache) state.indirectSeeds.resize(pixels);
+        // 1. 主光线 + 生成阴影查询（随机数消耗顺序与 renderPixel 相同）
+        AABB<T> bounds;
+        {
+            QE_PROFILE_SCOPE("trace.primary");
+            for (size_t p = 0; p < pixels; ++p) {
+                const size_t x = tile.x0 + p % tile.width(), y = tile.y0 + p / tile.width();
+                const Ray<T> ray = camera.generateRay(y, x);
+                state.queryBegin[p] = uint32_t(state.queries.size());
+                state.viewDirs[p] = -ray.direction;
+                state.hits[p] = primaryHit(ray, x, y, visibility);
+                const auto& hit = state.hits[p];
+                if (!hit) continue;
+                bounds.expand(hit->position);
+                for (uint32_t l = 0; l < lights.size(); ++l) {
+                    const Light<T>* tmp = lights[l];
+                    if (tmp->getType() == LightType::Point) {
+                        const PointLight<T>* light = static_cast<const PointLight<T>*>(tmp);
+                        Vec3<T> toLight = light->position - hit->position;
+                        const T len2 = toLight.lengthSquared();
+                        const T len = std::sqrt(len2);
+                        toLight /= len;
+                        state.queries.push_back(ShadowQuery{ toLight, light->color / len2, len, uint32_t(p), l });
+                    } else if (tmp->getType() == LightType::Triangle) {
+                        const TriangleLight<T>* light = static_cast<const TriangleLight<T>*>(tmp);
+                        if (TRI_LIGHT_SPP <= 0 || light->area <= T(0)) continue;
+                        for (int i = 0; i < TRI_LIGHT_SPP; ++i) {
+                            const auto position = light->samplePoint(rng);
+                            Vec3<T> toLight = position - hit->position;
+                            const T len2 = toLight.lengthSquared();
+                            if (len2 <= T(0)) continue;
+                            const T len = std::sqrt(len2);
+                            toLight /= len;
+                            const T cosL = light->normal.dot(-toLight);
+                            if (cosL <= T(0)) continue;
+                            state.queries.push_back(ShadowQuery{ toLight, light->color * light->area * cosL / len2, len, uint32_t(p), l });
+                        }
+                    }
+                }
+                if (irradianceCache) state.indirectSeeds[p] = rng(); // 与 shadePixel 相同，紧接在该像素的光源样本之后
+            }
+        }
+        state.queryBegin[pixels] = uint32_t(state.queries.size());
+        // 2. 排序：方向卦限在高位，起点在图块交点包围盒内量化成 Morton 码
+        const size_t count = state.queries.size();
+        state.order.resize(count);
+        const Vec3<T> extent = bounds.max - bounds.min;
+        const Vec3<T> scale(extent.x > 0 ? T(1023) / extent.x : 0, extent.y > 0 ? T(1023) / extent.y : 0, extent.z > 0 ? T(1023) / extent.z : 0);
+        for (size_t q = 0; q < count; ++q) {
+            const ShadowQuery& query = state.queries[q];
+            const Vec3<T> rel = (state.hits[query.pixel]->position - bounds.min) * scale;
+            const uint32_t octant = (query.toLight.x < 0) | ((query.toLight.y < 0) << 1) | ((query.toLight.z < 0) << 2);
+            const uint32_t morton = mortonCode3(uint32_t(rel.x), uint32_t(rel.y), uint32_t(rel.z));
+            state.order[q] = { (uint64_t(octant) << 32) | morton, uint32_t(q) };
+        }
+        std::sort(state.order.begin(), state.order.end());
+        // 3. 按排序顺序追踪遮挡，可见性回填到查询下标
+        state.visible.resize(count);
+        {
+            QE_PROFILE_SCOPE("trace.shadow");
+            OccluderCache& cache = threadOccluderCache();
+            for (const auto& [key, q] : state.order) {
+                const ShadowQuery& query = state.queries[q];
+                const auto& hit = state.hits[query.pixel];
+                const Ray<T> shadowRay(hit->position + hit->normal * EPSILON, query.toLight); // 偏移以防自阴影
+                state.visible[q] = !occludedCached(cache, shadowRay, query.len, query.light);
+            }
+            flushOccluderStats(cache);
+        }
+        // 4. 按像素、光源、样本的原顺序累加
+        QE_PROFILE_SCOPE("shade");
+        for (size_t p = 0; p < pixels; ++p) {
+            const size_t x = tile.x0 + p % tile.width(), y = tile.y0 + p / tile.width();
+            const auto& hit = state.hits[p];
+            if (!hit) {
+                fb.set(x, y, Vec3<T>(0, 0, 0));
+                if (aovs) aovs->clear(x, y);
+                continue;
+            }
+            Vec3<T> color(0, 0, 0);
+            T variance = 0;
+            uint32_t q = state.queryBegin[p];
+            const uint32_t qEnd = state.queryBegin[p + 1];
+            for (uint32_t l = 0; l < lights.size(); ++l) {
+                const LightType type = lights[l]->getType();
+                if (type == LightType::Point) {
+                    if (q < qEnd && state.queries[q].light == l) {
+                        const ShadowQuery& query = state.queries[q];
+                        if (state.visible[q])
+                            for (const auto& material : *hit->materialSet)
+                                color += material.second * material.first->getColor(query.input, state.viewDirs[p], query.toLight, hit->normal, hit->u, hit->v);
+                        ++q;
+                    }
+                } else if (type == LightType::Triangle) {
+                    if (TRI_LIGHT_SPP <= 0 || static_cast<const TriangleLight<T>*>(lights[l])->area <= T(0)) continue;
+                    Vec3<T> sum(0, 0, 0);
+                    SampleMoments moments;
+                    for (; q < qEnd && state.queries[q].light == l; ++q) {
+                        if (!state.visible[q]) continue;
+                        const ShadowQuery& query = state.queries[q];
+                        Vec3<T> sample(0, 0, 0);
+                        for (const auto& material : *hit->materialSet) {
+                            const Vec3<T> c = material.second * material.first->getColor(query.input, state.viewDirs[p], query.toLight, hit->normal, hit->u, hit->v);
+                            sum += c;
+                            sample += c;
+                        }
+                        moments.add(sample);
+                    }
+                    color += sum / T(TRI_LIGHT_SPP);
+                    variance += moments.meanVariance(TRI_LIGHT_SPP);
+                }
+            }
+            if (irradianceCache) color += indirectDiffuse(state.indirectSeeds[p], *hit, sigma);
+            color *= std::exp(-sigma * hit->t);
+            fb.set(x, y, color);
+            if (aovs) writeAOV(*aovs, x, y, *hit, variance * std::exp(-2 * sigma * hit->t));
+        }
+    }
+    // 渲染一个图块到帧缓冲，未命中的像素写 0；visibility 非空时主光线交点取自可见性缓冲，aovs 非空时同时写辅助输出
+    template<typename URNG>
+    void renderTile(URNG& rng, const Camera<T>& camera, Framebuffer<T>& fb, const Tile& tile, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5,
+                    const VisibilityBuffer<T>* visibility = nullptr, AOVBuffer<T>* aovs = nullptr) const {
+        QE_PROFILE_SCOPE("Engine::renderTile");
+        if (batchShadows) {
+            renderTileBatched(rng, camera, fb, tile, sigma, TRI_LIGHT_SPP, visibility, aovs);
+            return;
+        }
+        // 先求整块的主光线交点再逐像素着色，剖析事件按图块计而不是按像素计（每线程环形缓冲只有 65536 项）
+        thread_local std::vector<std::optional<HitInfo<T>>> hits;
+        hits.resize(tile.pixelCount());
+        {
+            QE_PROFILE_SCOPE("trace.primary");
+            for (size_t i = tile.y0; i < tile.y1; ++i)
+                for (size_t j = tile.x0; j < tile.x1; ++j)
+                    hits[(i - tile.y0) * tile.width() + (j - tile.x0)] = primaryHit(camera.generateRay(i, j), j, i, visibility);
+        }
+        QE_PROFILE_SCOPE("shade");
+        for (size_t i = tile.y0; i < tile.y1; ++i)
+            for (size_t j = tile.x0; j < tile.x1; ++j) {
+                const Ray<T> ray = camera.generateRay(i, j);
+                const auto& hit = hits[(i - tile.y0) * tile.width() + (j - tile.x0)];
+                T variance = 0;
+                const auto colorOpt = shadePixel(rng, ray, hit, sigma, TRI_LIGHT_SPP, aovs ? &variance : nullptr);
+                fb.set(j, i, colorOpt ? *colorOpt : Vec3<T>(0, 0, 0));
+                if (aovs) {
+                    if (hit) writeAOV(*aovs, j, i, *hit, variance);
+                    else aovs->clear(j, i);
+                }
+            }
+        flushOccluderStats(threadOccluderCache());
+    }
+    // 按图块序号派生随机数流渲染一个图块；render 与分布式 worker 共用，保证结果与切分方式无关
+    void renderTile(const Camera<T>& camera, Framebuffer<T>& fb, const Tile& tile, uint64_t seed, size_t tileIndex,
+                    const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5, const VisibilityBuffer<T>* visibility = nullptr,
+                    AOVBuffer<T>* aovs = nullptr) const {
+        std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(seed, tileIndex)));
+        renderTile(rng, camera, fb, tile, sigma, TRI_LIGHT_SPP, visibility, aovs);
+    }
+    // 多线程分块渲染；每个图块用 (seed, 图块序号) 派生独立的随机数流，结果与线程数无关（设置了 irradianceCache 时除外）
+    // onTile(tile) 在图块完成后由渲染线程调用，可用于流式写盘
+    template<typename OnTile>
+    void render(const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed, OnTile&& onTile, const T sigma = 0.05f,
+                const int TRI_LIGHT_SPP = 5, size_t tileSize = 64, size_t threads = 0) const {
+        renderFrame(camera, fb, nullptr, seed, onTile, sigma, TRI_LIGHT_SPP, tileSize, threads);
+    }
+    // 同时输出降噪所需的 AOV（尺寸随 fb 调整），像素颜色与不带 AOV 的 render 完全相同
+    template<typename OnTile>
+    void render(const Camera<T>& camera, Framebuffer<T>& fb, AOVBuffer<T>& aovs, uint64_t seed, OnTile&& onTile, const T sigma = 0.05f,
+                const int TRI_LIGHT_SPP = 5, size_t tileSize = 64, size_t threads = 0) const {
+        aovs.resize(fb.width(), fb.height());
+        renderFrame(camera, fb, &aovs, seed, onTile, sigma, TRI_LIGHT_SPP, tileSize, threads);
+    }
+    void render(const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed, const T sigma = 0.05f, const int TRI_LIGHT_SPP = 5) const {
+        render(camera, fb, seed, [](const Tile&) {}, sigma, TRI_LIGHT_SPP);
+    }
+private:
+    // 单个像素面光源样本的亮度一、二阶矩；被遮挡或被跳过的样本记为 0
+    struct SampleMoments {
+        T sum = 0, sumSquares = 0;
+        inline void add(const Vec3<T>& c) {
+            const T L = luminance(c.x, c.y, c.z);
+            sum += L;
+            sumSquares += L * L;
+        }
+        // n 个样本均值的方差（无偏样本方差 / n）；单样本无法估计，返回 NaN 交由降噪器在邻域内估计
+        inline T meanVariance(int n) const {
+            if (n < 2) return std::numeric_limits<T>::quiet_NaN();
+            return std::max(T(0), sumSquares - sum * sum / T(n)) / (T(n) * T(n - 1));
+        }
+    };
+    void writeAOV(AOVBuffer<T>& aovs, size_t x, size_t y, const HitInfo<T>& hit, T variance) const {
+        Vec3<T> albedo(0, 0, 0);
+        for (const auto& material : *hit.materialSet) albedo += material.second * material.first->getAlbedo(hit.u, hit.v);
+        aovs.set(x, y, albedo, hit.normal, hit.t, variance);
+    }
+    template<typename OnTile>
+    void renderFrame(const Camera<T>& camera, Framebuffer<T>& fb, AOVBuffer<T>* aovs, uint64_t seed, OnTile&& onTile, const T sigma,
+                     const int TRI_LIGHT_SPP, size_t tileSize, size_t threads) const {
+        const auto tiles = makeTiles(fb.width(), fb.height(), tileSize);
+        VisibilityBuffer<T> visibility;
+        if (rasterPrimary) rasterizeVisibility(camera, visibility, threads);
+        parallelFor(0, tiles.size(), [&](size_t idx) {
+            renderTile(camera, fb, tiles[idx], seed, idx, sigma, TRI_LIGHT_SPP, rasterPrimary ? &visibility : nullptr, aovs);
+            onTile(tiles[idx]);
+        }, threads);
+    }
 };
 #endif
\ No newline at end of file
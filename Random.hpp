@@ -0,0 +1,15 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+#include <cstdint>
+// SplitMix64：由 (种子, 流编号) 派生互不相关的子种子，
+// 用于给每个图块 / 每个线程分配独立随机数流，结果与线程调度无关
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+inline uint64_t deriveSeed(uint64_t seed, uint64_t stream) {
+    return splitmix64(seed ^ splitmix64(stream));
+}
+#endif
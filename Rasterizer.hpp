@@ -0,0 +1,211 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include "Vec3.hpp"
+#include "Camera.hpp"
+#include "BVH.hpp"
+#include "Object.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+/*
+可见性缓冲（visibility buffer）光栅化：把所有实例的三角形投影到屏幕，逐像素只保留最近的
+(实例, 图元) 编号和视空间深度。主光线交点由该三角形与像素光线重新求交得到（见 Engine::primaryHit），
+所以着色所用的 HitInfo 与光线追踪的结果一致，只有阴影等次级光线仍需遍历 BVH。
+像素中心与 Camera::generateRay 相同，取 (x + 0.5, y + 0.5)；屏幕坐标里像素中心落在整数点上。
+不提供三角形的对象（primitiveCount() == 0）记入 traced，由主光线补充追踪。
+*/
+template<typename T = float>
+struct VisibilityBuffer {
+    static constexpr uint32_t EMPTY = ~uint32_t(0);
+    size_t width = 0, height = 0;
+    std::vector<T> depth;                   // 沿 forward 的视空间深度
+    std::vector<uint32_t> instance, primitive;
+    std::vector<uint32_t> traced;           // 需追踪补充的实例下标
+    size_t binnedTriangles = 0;             // 通过剔除、进入分箱的三角形数
+    void reset(size_t w, size_t h) {
+        width = w; height = h;
+        depth.assign(w * h, std::numeric_limits<T>::infinity());
+        instance.assign(w * h, EMPTY);
+        primitive.assign(w * h, EMPTY);
+        traced.clear();
+        binnedTriangles = 0;
+    }
+    inline size_t index(size_t x, size_t y) const { return y * width + x; }
+};
+
+template<typename T = float>
+class VisibilityPass {
+public:
+    size_t tileSize = 64;   // 屏幕分箱的图块边长
+    size_t batchSize = 16384; // 一个分箱任务处理的三角形数
+    size_t threads = 0;
+    T nearPlane = T(1e-4);
+private:
+    struct ScreenVertex { T x, y, invZ; };
+    struct BinEntry { uint32_t tile, instance, primitive; };
+    struct Batch { uint32_t instance; size_t begin, end; };
+    // 视空间坐标：(right, down, forward) 分量
+    static inline Vec3<T> toView(const Camera<T>& camera, const Vec3<T>& p) {
+        const Vec3<T> d = p - camera.position;
+        return Vec3<T>(d.dot(camera.right), d.dot(camera.down), d.dot(camera.forward));
+    }
+    // 三角形建立：背面剔除（与 rayTriangle 的单面规则一致）、近平面裁剪、投影。返回屏幕多边形顶点数（0、3 或 4）
+    int setup(const Camera<T>& camera, const Vec3<T>& a, const Vec3<T>& b, const Vec3<T>& c, bool doubleSided, ScreenVertex out[4]) const {
+        const Vec3<T> n = (b - a).cross(c - a);
+        const T facing = (a - camera.position).dot(n); // > 0 时像素光线从背面射入
+        if (facing == T(0) || (!doubleSided && facing > 0)) return 0;
+        const Vec3<T> in[3] = { toView(camera, a), toView(camera, b), toView(camera, c) };
+        Vec3<T> poly[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const Vec3<T>& p = in[i];
+            const Vec3<T>& q = in[(i + 1) % 3];
+            const bool pIn = p.z >= nearPlane, qIn = q.z >= nearPlane;
+            if (pIn) poly[count++] = p;
+            if (pIn != qIn) poly[count++] = p + (q - p) * ((nearPlane - p.z) / (q.z - p.z));
+        }
+        if (count < 3) return 0;
+        const T sx = camera.width / camera.tfovw, sy = camera.height / camera.tfovh;
+        for (int i = 0; i < count; ++i) {
+            const T invZ = T(1) / poly[i].z;
+            out[i] = ScreenVertex{ poly[i].x * invZ * sx + camera.width * T(0.5) - T(0.5),
+                                   poly[i].y * invZ * sy + camera.height * T(0.5) - T(0.5), invZ };
+        }
+        return count;
+    }
+    static inline T edge(const ScreenVertex& a, const ScreenVertex& b, T px, T py) {
+        return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+    }
+    // 共享边上的像素中心只归属一侧：方向相反的两条边判定互补
+    static inline bool ownsEdge(const ScreenVertex& a, const ScreenVertex& b) {
+        return b.y > a.y || (b.y == a.y && b.x < a.x);
+    }
+    // 在 [x0, x1) × [y0, y1) 内光栅化一个屏幕三角形并做深度测试
+    static void rasterTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, uint32_t instance, uint32_t primitive,
+                               size_t x0, size_t y0, size_t x1, size_t y1, VisibilityBuffer<T>& vb) {
+        T area = edge(v0, v1, v2.x, v2.y);
+        if (area == T(0)) return;
+        if (area < 0) { std::swap(v1, v2); area = -area; }
+        const T minX = std::min({ v0.x, v1.x, v2.x }), maxX = std::max({ v0.x, v1.x, v2.x });
+        const T minY = std::min({ v0.y, v1.y, v2.y }), maxY = std::max({ v0.y, v1.y, v2.y });
+        const long bx0 = std::max(long(x0), long(std::ceil(minX))), bx1 = std::min(long(x1) - 1, long(std::floor(maxX)));
+        const long by0 = std::max(long(y0), long(std::ceil(minY))), by1 = std::min(long(y1) - 1, long(std::floor(maxY)));
+        if (bx0 > bx1 || by0 > by1) return;
+        const bool own0 = ownsEdge(v1, v2), own1 = ownsEdge(v2, v0), own2 = ownsEdge(v0, v1);
+        const T invArea = T(1) / area;
+        for (long y = by0; y <= by1; ++y) {
+            const T py = T(y);
+            for (long x = bx0; x <= bx1; ++x) {
+                const T px = T(x);
+                const T w0 = edge(v1, v2, px, py), w1 = edge(v2, v0, px, py), w2 = edge(v0, v1, px, py);
+                if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+                if ((w0 == 0 && !own0) || (w1 == 0 && !own1) || (w2 == 0 && !own2)) continue;
+                // 1/z 在屏幕空间线性，插值后取倒数得到透视正确的深度
+                const T z = T(1) / ((w0 * v0.invZ + w1 * v1.invZ + w2 * v2.invZ) * invArea);
+                const size_t i = vb.index(size_t(x), size_t(y));
+                if (z < vb.depth[i]) { vb.depth[i] = z; vb.instance[i] = instance; vb.primitive[i] = primitive; }
+            }
+        }
+    }
+    // 实例包围盒的 8 个角点全部落在某个视锥平面之外时整体剔除
+    bool culled(const Camera<T>& camera, const AABB<T>& box) const {
+        const T kx = T(0.5) * camera.tfovw * (T(1) + T(2) / camera.width);
+        const T ky = T(0.5) * camera.tfovh * (T(1) + T(2) / camera.height);
+        int outside[5] = { 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 8; ++i) {
+            const Vec3<T> v = toView(camera, Vec3<T>(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z));
+            outside[0] += v.z < nearPlane;
+            outside[1] += v.x > kx * v.z;
+            outside[2] += -v.x > kx * v.z;
+            outside[3] += v.y > ky * v.z;
+            outside[4] += -v.y > ky * v.z;
+        }
+        return std::any_of(outside, outside + 5, [](int n) { return n == 8; });
+    }
+    inline int setupPrimitive(const Camera<T>& camera, const Instance<T>& ins, size_t prim, ScreenVertex out[4]) const {
+        Vec3<T> a, b, c;
+        bool doubleSided = false;
+        if (!ins.object->primitive(prim, a, b, c, doubleSided)) return 0;
+        return setup(camera, a + ins.translation, b + ins.translation, c + ins.translation, doubleSided, out);
+    }
+public:
+    // 两遍：先按三角形批次并行投影、分箱到屏幕图块，再按图块并行光栅化（同一图块只由一个线程写）
+    void run(const std::vector<Instance<T>>& instances, const Camera<T>& camera, VisibilityBuffer<T>& vb) const {
+        QE_PROFILE_SCOPE("raster.visibility");
+        const size_t width = size_t(camera.width), height = size_t(camera.height);
+        vb.reset(width, height);
+        const size_t tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+        std::vector<Batch> batches;
+        for (size_t i = 0; i < instances.size(); ++i) {
+            Object<T>* object = instances[i].object;
+            const size_t count = object->primitiveCount();
+            if (count == 0) { vb.traced.push_back(uint32_t(i)); continue; }
+            AABB<T> box = object->getAABB();
+            box.min += instances[i].translation;
+            box.max += instances[i].translation;
+            if (culled(camera, box)) continue;
+            for (size_t begin = 0; begin < count; begin += batchSize)
+                batches.push_back(Batch{ uint32_t(i), begin, std::min(count, begin + batchSize) });
+        }
+        // 1. 分箱：每个批次输出自己的 (图块, 实例, 图元) 列表，合并时保持批次顺序，结果与线程数无关
+        std::vector<std::vector<BinEntry>> binned(batches.size());
+        std::vector<size_t> binnedCounts(batches.size(), 0); // 每个批次进入分箱的三角形数（跨多个图块也只计一次）
+        parallelFor(0, batches.size(), [&](size_t b) {
+            const Batch& batch = batches[b];
+            const Instance<T>& ins = instances[batch.instance];
+            auto& out = binned[b];
+            ScreenVertex v[4];
+            for (size_t prim = batch.begin; prim < batch.end; ++prim) {
+                const int count = setupPrimitive(camera, ins, prim, v);
+                if (count == 0) continue;
+                T minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+                for (int k = 1; k < count; ++k) {
+                    minX = std::min(minX, v[k].x); maxX = std::max(maxX, v[k].x);
+                    minY = std::min(minY, v[k].y); maxY = std::max(maxY, v[k].y);
+                }
+                const T fx0 = std::max(std::ceil(minX), T(0)), fx1 = std::min(std::floor(maxX), T(width) - 1);
+                const T fy0 = std::max(std::ceil(minY), T(0)), fy1 = std::min(std::floor(maxY), T(height) - 1);
+                if (!(fx0 <= fx1 && fy0 <= fy1)) continue; // 不覆盖任何像素中心（也排除 NaN）
+                const size_t tx0 = size_t(fx0) / tileSize, tx1 = size_t(fx1) / tileSize;
+                const size_t ty0 = size_t(fy0) / tileSize, ty1 = size_t(fy1) / tileSize;
+                ++binnedCounts[b];
+                for (size_t ty = ty0; ty <= ty1; ++ty)
+                    for (size_t tx = tx0; tx <= tx1; ++tx)
+                        out.push_back(BinEntry{ uint32_t(ty * tilesX + tx), batch.instance, uint32_t(prim) });
+            }
+        }, threads);
+        // 2. 计数排序成按图块连续的数组
+        const size_t tileCount = tilesX * tilesY;
+        std::vector<size_t> offsets(tileCount + 1, 0);
+        for (size_t b = 0; b < binned.size(); ++b) {
+            vb.binnedTriangles += binnedCounts[b];
+            for (const auto& e : binned[b]) ++offsets[e.tile + 1];
+        }
+        for (size_t t = 0; t < tileCount; ++t) offsets[t + 1] += offsets[t];
+        std::vector<std::pair<uint32_t, uint32_t>> entries(offsets[tileCount]);
+        {
+            std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (auto& list : binned) {
+                for (const auto& e : list) entries[cursor[e.tile]++] = { e.instance, e.primitive };
+                std::vector<BinEntry>().swap(list);
+            }
+        }
+        // 3. 逐图块光栅化，三角形在图块内重新建立（比保存屏幕顶点更省内存）
+        parallelFor(0, tileCount, [&](size_t t) {
+            const size_t x0 = (t % tilesX) * tileSize, y0 = (t / tilesX) * tileSize;
+            const size_t x1 = std::min(width, x0 + tileSize), y1 = std::min(height, y0 + tileSize);
+            ScreenVertex v[4];
+            for (size_t e = offsets[t]; e < offsets[t + 1]; ++e) {
+                const auto [instance, prim] = entries[e];
+                const int count = setupPrimitive(camera, instances[instance], prim, v);
+                if (count >= 3) rasterTriangle(v[0], v[1], v[2], instance, prim, x0, y0, x1, y1, vb);
+                if (count == 4) rasterTriangle(v[0], v[2], v[3], instance, prim, x0, y0, x1, y1, vb);
+            }
+        }, threads);
+    }
+};
+#endif
@@ -0,0 +1,261 @@
+#ifndef RESTIR_H
+#define RESTIR_H
+#include <vector>
+#include <optional>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+#include "ToneMapper.hpp"
+/*
+基于蓄水池重采样的直接光照（ReSTIR DI，Bitterli et al. 2020 的有偏版本）：
+    1. 初始候选：每个像素从所有光源里均匀挑 initialCandidates 个光源样本，按未遮挡贡献的亮度 p̂ 做加权蓄水池抽样（RIS）
+    2. 可见性复用：对选中样本追踪一条阴影光线，被挡住则把它的权重清零，避免遮挡样本在复用中扩散
+    3. 时间复用：把交点投影到上一帧相机，几何相近时合并上一帧该点空间复用之前的蓄水池（M 截断为当前的 maxHistory 倍）
+    4. 空间复用：每轮随机取 spatialNeighbors 个半径 spatialRadius 内、几何相近且样本未被挡住的邻居合并
+    5. 着色：对最终样本再追踪一条阴影光线，贡献 = F(y) · W；被挡住时退回本像素空间复用前的样本再测一次。
+       邻居样本在本点的可见性不做检查，历史收敛后邻居集中在本点被挡住的强光源上，不退回会让半影区逐帧变暗
+每像素至多 3 条阴影光线（通常约 1.6 条），与光源数、每光源样本数无关。
+估计量以面积测度统一点光源与面光源：点光源 p(y) = 1/N，面光源 p(y) = 1/(N·area)。
+*/
+template<typename T = float>
+struct LightSample {
+    Vec3<T> position;  // 光源上的点（点光源即其位置）
+    uint32_t light = 0;
+};
+template<typename T = float>
+struct Reservoir {
+    LightSample<T> sample;
+    T wSum = 0; // 候选权重和
+    T M = 0;    // 已考虑的候选数
+    T W = 0;    // 样本的贡献权重 wSum / (M · p̂(y))
+    // 以权重 w 考虑一个代表 count 个候选的样本
+    template<typename URNG>
+    inline bool update(const LightSample<T>& s, T w, T count, URNG& rng) {
+        wSum += w;
+        M += count;
+        if (w > 0 && std::uniform_real_distribution<T>(0, 1)(rng) * wSum < w) { sample = s; return true; }
+        return false;
+    }
+    inline void finalize(T pHat) { W = (M > 0 && pHat > 0) ? wSum / (M * pHat) : T(0); }
+};
+
+template<typename T = float>
+class ReSTIRPass {
+public:
+    size_t initialCandidates = 32;
+    bool visibilityReuse = true;
+    bool temporalReuse = true;
+    T maxHistory = 20;           // 时间复用时上一帧 M 的上限（相对当前帧）
+    size_t spatialPasses = 2;
+    size_t spatialNeighbors = 5;
+    T spatialRadius = 30;        // 像素
+    T normalThreshold = T(0.9);  // 复用邻居的法线夹角余弦下限
+    T depthThreshold = T(0.1);   // 复用邻居的相对深度差上限
+    size_t threads = 0;
+    uint64_t lastShadowRays = 0; // 最近一帧追踪的阴影光线数
+
+    // 丢弃历史（切换场景或相机跳变时调用）
+    void reset() { previous.clear(); prevCamera.reset(); frame = 0; }
+    void run(const Engine<T>& engine, const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed, const T sigma = 0.05f) {
+        QE_PROFILE_SCOPE("ReSTIRPass::run");
+        width = fb.width(); height = fb.height();
+        const size_t pixels = width * height;
+        if (engine.lights.size() != lightCount || previous.size() != pixels) reset();
+        lightCount = engine.lights.size();
+        const uint64_t frameSeed = deriveSeed(seed, frame++);
+        surfaces.resize(pixels);
+        current.assign(pixels, Reservoir<T>());
+        std::vector<uint64_t> rowRays(height, 0);
+        // 1. 主光线（与 Engine::render 相同，可走可见性缓冲）
+        VisibilityBuffer<T> visibility;
+        if (engine.rasterPrimary) engine.rasterizeVisibility(camera, visibility, threads);
+        parallelFor(0, height, [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                const Ray<T> ray = camera.generateRay(y, x);
+                const auto hit = engine.primaryHit(ray, x, y, engine.rasterPrimary ? &visibility : nullptr);
+                Surface& s = surfaces[y * width + x];
+                s.valid = hit.has_value();
+                if (!hit) continue;
+                s.position = hit->position; s.normal = hit->normal; s.view = -ray.direction;
+                s.materialSet = hit->materialSet; s.u = hit->u; s.v = hit->v; s.t = hit->t;
+            }
+        }, threads);
+        // 2. 初始候选 + 可见性复用 + 时间复用
+        const T uniformPdf = lightCount ? T(1) / T(lightCount) : T(0);
+        parallelFor(0, height, [&](size_t y) {
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(frameSeed, y)));
+            for (size_t x = 0; x < width; ++x) {
+                const size_t p = y * width + x;
+                const Surface& s = surfaces[p];
+                if (!s.valid || lightCount == 0) continue;
+                Reservoir<T> r;
+                for (size_t c = 0; c < initialCandidates; ++c) {
+                    LightSample<T> candidate;
+                    T sourcePdf;
+                    if (!sampleLight(engine, rng, candidate, sourcePdf)) { r.M += 1; continue; }
+                    const T pHat = targetPdf(engine, s, candidate);
+                    r.update(candidate, pHat / (sourcePdf * uniformPdf), T(1), rng);
+                }
+                r.finalize(targetPdf(engine, s, r.sample));
+                if (visibilityReuse && r.W > 0) {
+                    ++rowRays[y];
+                    if (!visible(engine, s, r.sample)) r.W = 0;
+                }
+                if (temporalReuse && prevCamera) combineTemporal(engine, s, r, rng);
+                current[p] = r;
+            }
+        }, threads);
+        history = current; // 空间复用前的结果，用于着色退回与下一帧时间复用
+        // 3. 空间复用（两组缓冲交替）
+        next.resize(pixels);
+        for (size_t pass = 0; pass < spatialPasses; ++pass) {
+            parallelFor(0, height, [&](size_t y) {
+                std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(frameSeed, (pass + 1) * height + y)));
+                std::uniform_real_distribution<T> uni(0, 1);
+                for (size_t x = 0; x < width; ++x) {
+                    const size_t p = y * width + x;
+                    const Surface& s = surfaces[p];
+                    if (!s.valid) { next[p] = current[p]; continue; }
+                    Reservoir<T> r;
+                    merge(engine, s, r, current[p], current[p].M, rng);
+                    for (size_t k = 0; k < spatialNeighbors; ++k) {
+                        const T angle = uni(rng) * T(2 * PI), radius = spatialRadius * std::sqrt(uni(rng));
+                        const long qx = long(x) + long(std::lround(radius * std::cos(angle)));
+                        const long qy = long(y) + long(std::lround(radius * std::sin(angle)));
+                        if (qx < 0 || qy < 0 || qx >= long(width) || qy >= long(height) || (size_t(qx) == x && size_t(qy) == y)) continue;
+                        const size_t q = size_t(qy) * width + size_t(qx);
+                        if (!similar(s, surfaces[q].valid, surfaces[q].normal, surfaces[q].t)) continue;
+                        // 可见性复用中被挡住的邻居不参与：计入它的 M 会让阴影边缘附近整体变暗（有偏版本的主要偏差）
+                        if (current[q].W <= 0) continue;
+                        merge(engine, s, r, current[q], current[q].M, rng);
+                    }
+                    r.finalize(targetPdf(engine, s, r.sample));
+                    next[p] = r;
+                }
+            }, threads);
+            current.swap(next);
+        }
+        // 4. 最终着色：每像素一条阴影光线，被挡住时退回空间复用前的样本
+        parallelFor(0, height, [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                const size_t p = y * width + x;
+                const Surface& s = surfaces[p];
+                Vec3<T> color(0, 0, 0);
+                const Reservoir<T>& r = current[p];
+                if (s.valid && r.W > 0) {
+                    ++rowRays[y];
+                    if (visible(engine, s, r.sample)) color = contribution(engine, s, r.sample) * r.W;
+                    else {
+                        const Reservoir<T>& own = history[p];
+                        if (own.W > 0) {
+                            ++rowRays[y];
+                            if (visible(engine, s, own.sample)) color = contribution(engine, s, own.sample) * own.W;
+                        }
+                    }
+                    color = color * std::exp(-sigma * s.t);
+                }
+                fb.set(x, y, color);
+            }
+        }, threads);
+        lastShadowRays = 0;
+        for (auto n : rowRays) lastShadowRays += n;
+        // 5. 保存空间复用前的蓄水池供下一帧时间复用：存空间复用后的结果会让邻居的 M 反复计入
+        previous.swap(history);
+        prevSurfaces.swap(surfaces);
+        prevCamera = camera;
+    }
+private:
+    struct Surface {
+        Vec3<T> position, normal, view;
+        MaterialSet<T>* materialSet = nullptr;
+        T u = 0, v = 0, t = 0;
+        bool valid = false;
+    };
+    size_t width = 0, height = 0, lightCount = 0;
+    uint64_t frame = 0;
+    std::vector<Surface> surfaces, prevSurfaces;
+    std::vector<Reservoir<T>> current, next, history, previous;
+    std::optional<Camera<T>> prevCamera;
+
+    // 均匀选光源，面光源再在面上均匀取点；sourcePdf 为光源内部的面积密度（点光源为 1）
+    template<typename URNG>
+    bool sampleLight(const Engine<T>& engine, URNG& rng, LightSample<T>& out, T& sourcePdf) const {
+        out.light = uint32_t(std::min<size_t>(lightCount - 1, size_t(std::uniform_real_distribution<T>(0, 1)(rng) * T(lightCount))));
+        const Light<T>* light = engine.lights[out.light];
+        if (light->getType() == LightType::Point) {
+            out.position = static_cast<const PointLight<T>*>(light)->position;
+            sourcePdf = 1;
+            return true;
+        }
+        if (light->getType() != LightType::Triangle) return false;
+        const TriangleLight<T>* tri = static_cast<const TriangleLight<T>*>(light);
+        if (tri->area <= T(0)) return false;
+        out.position = tri->samplePoint(rng);
+        sourcePdf = T(1) / tri->area;
+        return true;
+    }
+    // 未遮挡贡献 F(y)：点光源 color / r²，面光源按面积测度 color · cosL / r²（与 Engine 的直接光照一致）
+    Vec3<T> contribution(const Engine<T>& engine, const Surface& s, const LightSample<T>& y) const {
+        if (y.light >= engine.lights.size()) return Vec3<T>(0, 0, 0);
+        const Light<T>* light = engine.lights[y.light];
+        Vec3<T> toLight = y.position - s.position;
+        const T len2 = toLight.lengthSquared();
+        if (len2 <= T(0)) return Vec3<T>(0, 0, 0);
+        toLight /= std::sqrt(len2);
+        Vec3<T> input;
+        if (light->getType() == LightType::Point) input = static_cast<const PointLight<T>*>(light)->color / len2;
+        else {
+            const TriangleLight<T>* tri = static_cast<const TriangleLight<T>*>(light);
+            const T cosL = tri->normal.dot(-toLight);
+            if (cosL <= T(0)) return Vec3<T>(0, 0, 0);
+            input = tri->color * cosL / len2;
+        }
+        Vec3<T> color(0, 0, 0);
+        for (const auto& material : *s.materialSet)
+            color += material.second * material.first->getColor(input, s.view, toLight, s.normal, s.u, s.v);
+        return color;
+    }
+    inline T targetPdf(const Engine<T>& engine, const Surface& s, const LightSample<T>& y) const {
+        const Vec3<T> c = contribution(engine, s, y);
+        return std::max(T(0), luminance(c.x, c.y, c.z));
+    }
+    bool visible(const Engine<T>& engine, const Surface& s, const LightSample<T>& y) const {
+        Vec3<T> toLight = y.position - s.position;
+        const T len = toLight.length();
+        if (len <= T(0)) return false;
+        return !engine.traceOcclusion(Ray<T>(s.position + s.normal * EPSILON, toLight / len), len);
+    }
+    inline bool similar(const Surface& s, bool valid, const Vec3<T>& normal, T depth) const {
+        return valid && s.normal.dot(normal) >= normalThreshold && std::abs(depth - s.t) <= depthThreshold * s.t;
+    }
+    // 把另一个蓄水池（已 finalize）合并进 r，目标函数在当前着色点重新计算
+    template<typename URNG>
+    inline void merge(const Engine<T>& engine, const Surface& s, Reservoir<T>& r, const Reservoir<T>& other, T M, URNG& rng) const {
+        if (M <= 0) return;
+        const T w = other.W > 0 ? targetPdf(engine, s, other.sample) * other.W * M : T(0);
+        r.update(other.sample, w, M, rng);
+    }
+    template<typename URNG>
+    void combineTemporal(const Engine<T>& engine, const Surface& s, Reservoir<T>& r, URNG& rng) const {
+        T px, py;
+        if (!prevCamera->project(s.position, px, py) || px < 0 || py < 0 || px >= T(width) || py >= T(height)) return;
+        const size_t q = size_t(py) * width + size_t(px);
+        const Surface& prev = prevSurfaces[q];
+        // 与上一帧该像素比较：法线相近，且上一帧记录的距离与本点到上一帧相机的距离一致（排除遮挡变化）
+        const T prevDepth = (s.position - prevCamera->position).length();
+        if (!prev.valid || s.normal.dot(prev.normal) < normalThreshold || std::abs(prev.t - prevDepth) > depthThreshold * prevDepth) return;
+        if (previous[q].W <= 0) return; // 与空间复用相同，不合并被挡住的样本
+        Reservoir<T> combined;
+        merge(engine, s, combined, r, r.M, rng);
+        merge(engine, s, combined, previous[q], std::min(previous[q].M, maxHistory * std::max(r.M, T(1))), rng);
+        combined.finalize(targetPdf(engine, s, combined.sample));
+        r = combined;
+    }
+};
+#endif
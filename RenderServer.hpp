@@ -0,0 +1,295 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+#include <string>
+#include <vector>
+#include <sstream>
+#include <mutex>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <list>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "ImageWriter.hpp"
+#include "ToneMapper.hpp"
+/*
+常驻渲染服务：场景、BLAS、TLAS 只构建一次，通过 stdin/stdout 管道或 Unix socket 接收任务。
+协议按行分隔的文本命令，应答同样是文本行，图块数据紧跟在 TILE 行之后以原始 float 流出：
+    render px py pz lx ly lz fovDeg width height spp output [seed]
+        -> TILE x0 y0 x1 y1 bytes\n <bytes 字节的 float RGB，行主序>   （每个图块完成即发送）
+        -> DONE output seconds
+    move index tx ty tz        修改实例平移（只重建 TLAS）           -> OK
+    add object tx ty tz        新增常驻对象 object 的实例               -> OK index
+    remove index               删除实例                                 -> OK
+    light px py pz r g b       新增点光源                               -> OK
+    stats                      -> STATS {内存 JSON}
+    quit                       -> BYE，结束当前连接
+出错时应答 ERR message，连接保持；宽高超过 maxDimension 或像素数超过 maxPixels 的 render 直接应答 ERR。
+*/
+// 文件描述符上的带缓冲连接（管道或 socket 通用）
+class FdConnection {
+private:
+    int inFd, outFd;
+    std::string buffer;
+    size_t pos = 0;
+public:
+    FdConnection(int __inFd, int __outFd) : inFd(__inFd), outFd(__outFd) {}
+    bool readLine(std::string& line) {
+        for (;;) {
+            const size_t nl = buffer.find('\n', pos);
+            if (nl != std::string::npos) {
+                line.assign(buffer, pos, nl - pos);
+                pos = nl + 1;
+                if (pos > 4096) { buffer.erase(0, pos); pos = 0; }
+                return true;
+            }
+            char chunk[4096];
+            const ssize_t n = read(inFd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { // 对端关闭：把最后不完整的一行也交出去
+                if (pos < buffer.size()) { line.assign(buffer, pos, std::string::npos); buffer.clear(); pos = 0; return true; }
+                return false;
+            }
+            buffer.append(chunk, size_t(n));
+        }
+    }
+    // 读取恰好 bytes 字节（先消费行缓冲里剩余的数据）
+    bool readExact(void* data, size_t bytes) {
+        char* p = static_cast<char*>(data);
+        const size_t buffered = std::min(bytes, buffer.size() - pos);
+        std::memcpy(p, buffer.data() + pos, buffered);
+        pos += buffered; p += buffered; bytes -= buffered;
+        while (bytes > 0) {
+            const ssize_t n = read(inFd, p, bytes);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n; bytes -= size_t(n);
+        }
+        return true;
+    }
+    // 缓冲里已有完整的一行（poll 看不到这部分数据）
+    bool hasBufferedLine() const { return buffer.find('\n', pos) != std::string::npos; }
+    int fd() const { return inFd; }
+    bool write(const void* data, size_t bytes) {
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            const ssize_t n = ::write(outFd, p, bytes);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n; bytes -= size_t(n);
+        }
+        return true;
+    }
+    bool writeLine(const std::string& line) { return write((line + "\n").data(), line.size() + 1); }
+};
+inline sockaddr_un unixSocketAddress(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("socket path too long.");
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+inline int listenUnixSocket(const std::string& path, int backlog = 8) {
+    const sockaddr_un addr = unixSocketAddress(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("cannot create socket.");
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot listen on " + path);
+    }
+    return fd;
+}
+inline int connectUnixSocket(const std::string& path) {
+    const sockaddr_un addr = unixSocketAddress(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("cannot create socket.");
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot connect to " + path);
+    }
+    return fd;
+}
+
+template<typename T = float>
+class RenderServer {
+private:
+    Engine<T>& engine;
+    std::vector<Object<T>*> objects; // 可通过 add 实例化的常驻对象
+    std::mutex sceneLock;            // 任务串行执行，编辑与渲染互斥
+    size_t threads;
+    // socket 模式下的连接线程；fd 由拥有者在 join 之后关闭，避免 shutdown 作用到被复用的描述符
+    struct Client {
+        std::thread thread;
+        int fd;
+        bool finished = false;
+    };
+    std::mutex clientLock;
+    std::list<Client> clients;
+    int listenFd = -1;
+    bool stopping = false;
+    // join 已结束的连接线程；all 时先 shutdown 仍在运行的连接，使其 readLine 返回
+    void joinClients(bool all) {
+        std::list<Client> done;
+        {
+            std::lock_guard<std::mutex> guard(clientLock);
+            for (auto it = clients.begin(); it != clients.end();) {
+                if (all && !it->finished) shutdown(it->fd, SHUT_RDWR);
+                if (all || it->finished) done.splice(done.end(), clients, it++);
+                else ++it;
+            }
+        }
+        for (auto& client : done) {
+            client.thread.join();
+            close(client.fd);
+        }
+    }
+    void render(std::istringstream& args, FdConnection& conn) {
+        T px, py, pz, lx, ly, lz, fov;
+        size_t width, height;
+        int spp;
+        std::string output;
+        uint64_t seed = 1;
+        if (!(args >> px >> py >> pz >> lx >> ly >> lz >> fov >> width >> height >> spp >> output))
+            throw std::runtime_error("usage: render px py pz lx ly lz fovDeg width height spp output [seed]");
+        args >> seed;
+        if (width == 0 || height == 0) throw std::runtime_error("empty image.");
+        if (width > maxDimension || height > maxDimension || width * height > maxPixels) throw std::runtime_error("image too large.");
+        const auto start = std::chrono::steady_clock::now();
+        const Camera<T> camera(Vec3<T>(px, py, pz), Vec3<T>(lx, ly, lz), Vec3<T>(0, 1, 0), fov * T(PI) / T(180), width, height);
+        Framebuffer<T> image(width, height);
+        std::mutex writeLock;
+        bool connected = true;
+        engine.render(camera, image, seed, [&](const Tile& tile) {
+            std::vector<float> buf;
+            buf.reserve(tile.pixelCount() * 3);
+            for (size_t y = tile.y0; y < tile.y1; ++y)
+                for (size_t x = tile.x0 * 3; x < tile.x1 * 3; ++x) buf.push_back(float(image.row(y)[x]));
+            const size_t bytes = buf.size() * sizeof(float);
+            std::lock_guard<std::mutex> guard(writeLock);
+            if (!connected) return;
+            connected = conn.writeLine("TILE " + std::to_string(tile.x0) + " " + std::to_string(tile.y0) + " " +
+                                       std::to_string(tile.x1) + " " + std::to_string(tile.y1) + " " + std::to_string(bytes))
+                        && conn.write(buf.data(), bytes);
+        }, T(0.05), spp, 64, threads);
+        if (output != "-") {
+            if (ImageIO::formatFromFilename(output) == ImageIO::ImageFormat::BMP) {
+                Framebuffer<T> ldr;
+                ToneMapPass<T> tonemap;
+                tonemap.threads = threads;
+                tonemap.run(image, ldr);
+                ImageIO::saveBMP(output, ldr);
+            } else ImageIO::save(output, image);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        conn.writeLine("DONE " + output + " " + std::to_string(seconds));
+    }
+public:
+    size_t maxDimension = 16384;        // render 的宽、高上限
+    size_t maxPixels = size_t(8192) * 8192; // render 的像素数上限（帧缓冲在此之前不分配）
+
+    RenderServer(Engine<T>& __engine, std::vector<Object<T>*> __objects, size_t __threads = 0)
+        : engine(__engine), objects(std::move(__objects)), threads(__threads) {}
+    ~RenderServer() {
+        stop();
+        joinClients(true);
+    }
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+    // 处理一条命令；返回 false 表示连接应结束
+    bool handle(const std::string& line, FdConnection& conn) {
+        std::istringstream args(line);
+        std::string cmd;
+        if (!(args >> cmd)) return true;
+        std::lock_guard<std::mutex> guard(sceneLock);
+        try {
+            if (cmd == "render") render(args, conn);
+            else if (cmd == "move") {
+                size_t index; T x, y, z;
+                if (!(args >> index >> x >> y >> z) || index >= engine.instances.size()) throw std::runtime_error("usage: move index tx ty tz");
+                engine.instances[index].translation = Vec3<T>(x, y, z);
+                engine.init(); // BLAS 不变，只重建 TLAS
+                conn.writeLine("OK");
+            } else if (cmd == "add") {
+                size_t object; T x, y, z;
+                if (!(args >> object >> x >> y >> z) || object >= objects.size()) throw std::runtime_error("usage: add object tx ty tz");
+                engine.insertInstance(Instance<T>(objects[object], Vec3<T>(x, y, z)));
+                engine.init();
+                conn.writeLine("OK " + std::to_string(engine.instances.size() - 1));
+            } else if (cmd == "remove") {
+                size_t index;
+                if (!(args >> index) || index >= engine.instances.size()) throw std::runtime_error("usage: remove index");
+                engine.instances.erase(engine.instances.begin() + index);
+                engine.init();
+                conn.writeLine("OK");
+            } else if (cmd == "light") {
+                T x, y, z, r, g, b;
+                if (!(args >> x >> y >> z >> r >> g >> b)) throw std::runtime_error("usage: light px py pz r g b");
+                engine.insertLight(engine.template make<PointLight<T>>(Vec3<T>(x, y, z), Vec3<T>(r, g, b)));
+                conn.writeLine("OK");
+            } else if (cmd == "stats") {
+                conn.writeLine("STATS " + engine.memoryStats().toJSON());
+            } else if (cmd == "quit") {
+                conn.writeLine("BYE");
+                return false;
+            } else throw std::runtime_error("unknown command " + cmd);
+        } catch (const std::exception& e) {
+            conn.writeLine(std::string("ERR ") + e.what());
+        }
+        return true;
+    }
+    void serve(FdConnection& conn) {
+        std::string line;
+        while (conn.readLine(line))
+            if (!handle(line, conn)) break;
+    }
+    // 监听 Unix socket，逐个连接处理（每个连接一个线程，任务本身由 sceneLock 串行化）。
+    // stop() 或 accept 出错时返回；返回前断开并 join 所有连接线程
+    void serveUnixSocket(const std::string& path) {
+        const int server = listenUnixSocket(path);
+        {
+            std::lock_guard<std::mutex> guard(clientLock);
+            if (stopping) { close(server); return; }
+            listenFd = server;
+        }
+        for (;;) {
+            const int client = accept(server, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            joinClients(false);
+            std::lock_guard<std::mutex> guard(clientLock);
+            if (stopping) { close(client); break; }
+            Client& entry = clients.emplace_back();
+            entry.fd = client;
+            entry.thread = std::thread([this, &entry, client]() {
+                FdConnection conn(client, client);
+                serve(conn);
+                std::lock_guard<std::mutex> guard(clientLock);
+                entry.finished = true;
+            });
+        }
+        {
+            std::lock_guard<std::mutex> guard(clientLock);
+            listenFd = -1;
+        }
+        close(server);
+        joinClients(true);
+    }
+    // 让 serveUnixSocket 停止接受新连接并返回（可从其他线程调用）
+    void stop() {
+        std::lock_guard<std::mutex> guard(clientLock);
+        stopping = true;
+        if (listenFd >= 0) shutdown(listenFd, SHUT_RDWR);
+    }
+};
+#endif
@@ -0,0 +1,140 @@
+#ifndef SCENEGEN_H
+#define SCENEGEN_H
+#include <vector>
+#include <memory>
+#include <random>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Random.hpp"
+/*
+程序化测试场景（固定种子，可复现）：
+    高面数细分球 + 起伏地形网格、成千上万个网格实例、大量点光源 / 三角形面光源、多层混合材质
+用于基准测试与各种加速路径的对比验证
+*/
+namespace SceneGen {
+// 经纬球，segments × rings 个四边形
+template<typename T = float>
+std::unique_ptr<TriangleMesh<T>> makeSphere(size_t segments, size_t rings, T radius, MaterialSet<T>* materialSet) {
+    std::vector<Vec3<T>> points;
+    points.reserve((rings + 1) * (segments + 1));
+    for (size_t r = 0; r <= rings; ++r) {
+        const T phi = T(PI) * T(r) / T(rings);
+        for (size_t s = 0; s <= segments; ++s) {
+            const T theta = T(2 * PI) * T(s) / T(segments);
+            points.emplace_back(radius * std::sin(phi) * std::cos(theta), radius * std::cos(phi), radius * std::sin(phi) * std::sin(theta));
+        }
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(rings * segments * 6);
+    for (size_t r = 0; r < rings; ++r)
+        for (size_t s = 0; s < segments; ++s) {
+            const uint32_t a = uint32_t(r * (segments + 1) + s), b = a + 1, c = uint32_t(a + segments + 1), d = c + 1;
+            indices.insert(indices.end(), { a, b, c, b, d, c }); // 外法线朝外
+        }
+    auto mesh = std::make_unique<TriangleMesh<T>>(std::move(points));
+    mesh->insertTriangles(indices, materialSet);
+    return mesh;
+}
+// n × n 网格的起伏地面（y 向上）
+template<typename T = float>
+std::unique_ptr<TriangleMesh<T>> makeTerrain(size_t n, T size, T amplitude, uint64_t seed, MaterialSet<T>* materialSet) {
+    std::mt19937 rng(static_cast<std::mt19937::result_type>(seed));
+    std::uniform_real_distribution<T> phase(0, T(2 * PI));
+    const T p1 = phase(rng), p2 = phase(rng);
+    std::vector<Vec3<T>> points;
+    points.reserve((n + 1) * (n + 1));
+    for (size_t i = 0; i <= n; ++i)
+        for (size_t j = 0; j <= n; ++j) {
+            const T x = (T(i) / T(n) - T(0.5)) * size, z = (T(j) / T(n) - T(0.5)) * size;
+            points.emplace_back(x, amplitude * (std::sin(x * T(0.7) + p1) * std::cos(z * T(0.5) + p2)), z);
+        }
+    std::vector<uint32_t> indices;
+    indices.reserve(n * n * 6);
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j) {
+            const uint32_t a = uint32_t(i * (n + 1) + j), b = a + 1, c = uint32_t(a + n + 1), d = c + 1;
+            indices.insert(indices.end(), { a, b, c, b, d, c });
+        }
+    auto mesh = std::make_unique<TriangleMesh<T>>(std::move(points));
+    mesh->insertTriangles(indices, materialSet);
+    return mesh;
+}
+struct SceneConfig {
+    size_t width = 640, height = 360;
+    size_t terrainResolution = 512;   // 地形 2 * n^2 个三角形
+    size_t sphereSegments = 256;      // 细分球 2 * seg * seg / 2 个三角形
+    size_t instanceCount = 2000;      // 小物体实例数
+    size_t pointLights = 16;
+    size_t triangleLights = 8;
+    size_t lodLevels = 0;             // > 1 时球体实例使用 QEM 简化的 LOD 链，按相机选级
+    uint64_t seed = 20240601;
+};
+// 各命令行程序共用的场景规模：small / medium（默认值）/ large，未知名字抛异常
+inline SceneConfig preset(const std::string& name) {
+    SceneConfig config;
+    if (name == "small") {
+        config.width = 320; config.height = 180;
+        config.terrainResolution = 128; config.sphereSegments = 64;
+        config.instanceCount = 200; config.pointLights = 4; config.triangleLights = 2;
+    } else if (name == "large") {
+        config.width = 1920; config.height = 1080;
+        config.terrainResolution = 1536; config.sphereSegments = 1024;
+        config.instanceCount = 20000; config.pointLights = 64; config.triangleLights = 32;
+    } else if (name != "medium") throw std::runtime_error("unknown preset " + name);
+    return config;
+}
+// 场景持有所有网格与材质；光源、材质由 engine.make 创建
+template<typename T = float>
+struct Scene {
+    Engine<T> engine;
+    std::vector<std::unique_ptr<TriangleMesh<T>>> meshes;
+    std::vector<std::unique_ptr<LODChain<T>>> lods; // 与 meshes[1..] 对应（仅 lodLevels > 1 时）
+    Camera<T> camera = Camera<T>(Vec3<T>(0, 8, 24), Vec3<T>(0, 0, 0), Vec3<T>(0, 1, 0), T(60) * T(PI) / T(180), 640, 360);
+};
+template<typename T = float>
+void buildScene(Scene<T>& scene, const SceneConfig& config, bool initAccel = true) {
+    auto& engine = scene.engine;
+    std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(config.seed, 0)));
+    std::uniform_real_distribution<T> uni(0, 1);
+    // 多层材质：漫反射 + 金属高光按权重混合
+    auto stone = engine.template make<CookTorranceMaterial<T>>(Vec3<T>(0.3, 0.3, 0.3), Vec3<T>(0.04, 0.04, 0.04), T(0.8), T(0));
+    auto plastic = engine.template make<CookTorranceMaterial<T>>(Vec3<T>(0.8, 0.1, 0.1), Vec3<T>(0.04, 0.04, 0.04), T(0.4), T(0));
+    auto gold = engine.template make<CookTorrancePBRMaterial<T>>(Vec3<T>(0, 0, 0), Vec3<T>(1.0, 0.77, 0.34), T(0.3), T(1), T(0));
+    auto ground = engine.template make<MaterialSet<T>>(std::vector<std::pair<Material<T>*, T>>{ { stone, T(1) } }, false);
+    auto layered = engine.template make<MaterialSet<T>>(std::vector<std::pair<Material<T>*, T>>{ { plastic, T(0.7) }, { gold, T(0.3) } }, false);
+    auto metal = engine.template make<MaterialSet<T>>(std::vector<std::pair<Material<T>*, T>>{ { gold, T(1) } }, true);
+
+    scene.meshes.push_back(makeTerrain<T>(config.terrainResolution, T(60), T(1.5), deriveSeed(config.seed, 1), ground));
+    scene.meshes.push_back(makeSphere<T>(config.sphereSegments, config.sphereSegments / 2, T(3), layered));
+    scene.meshes.push_back(makeSphere<T>(12, 6, T(0.3), metal));   // 实例化的小物体
+    scene.meshes.push_back(makeSphere<T>(6, 3, T(0.25), layered));
+    if (config.lodLevels > 1)
+        for (size_t m = 1; m < scene.meshes.size(); ++m) scene.lods.push_back(std::make_unique<LODChain<T>>(scene.meshes[m].get(), config.lodLevels));
+    auto instance = [&](size_t mesh, const Vec3<T>& translation) {
+        if (config.lodLevels > 1) return Instance<T>(scene.lods[mesh - 1].get(), translation);
+        return Instance<T>(scene.meshes[mesh].get(), translation);
+    };
+    engine.insertInstance(Instance<T>(scene.meshes[0].get(), Vec3<T>(0, -2, 0)));
+    engine.insertInstance(instance(1, Vec3<T>(0, 2, 0)));
+    for (size_t i = 0; i < config.instanceCount; ++i) {
+        const T x = (uni(rng) - T(0.5)) * 50, z = (uni(rng) - T(0.5)) * 50;
+        engine.insertInstance(instance(2 + (i & 1), Vec3<T>(x, T(0.5) + uni(rng), z)));
+    }
+    for (size_t i = 0; i < config.pointLights; ++i) {
+        const Vec3<T> pos((uni(rng) - T(0.5)) * 40, 6 + uni(rng) * 6, (uni(rng) - T(0.5)) * 40);
+        engine.insertLight(engine.template make<PointLight<T>>(pos, Vec3<T>(400 + 400 * uni(rng))));
+    }
+    for (size_t i = 0; i < config.triangleLights; ++i) {
+        const Vec3<T> c((uni(rng) - T(0.5)) * 30, 12 + uni(rng) * 4, (uni(rng) - T(0.5)) * 30);
+        // 面朝下的三角形面光源
+        engine.insertLight(engine.template make<TriangleLight<T>>(c + Vec3<T>(-1, 0, -1), c + Vec3<T>(1, 0, -1), c + Vec3<T>(0, 0, 1), Vec3<T>(200)));
+    }
+    scene.camera = Camera<T>(Vec3<T>(0, 8, 24), Vec3<T>(0, 0, 0), Vec3<T>(0, 1, 0), T(60) * T(PI) / T(180), config.width, config.height);
+    engine.selectLOD(scene.camera);
+    if (initAccel) engine.init(); // 网格 BLAS 在首次命中时按需构建
+}
+}
+#endif
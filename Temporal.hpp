@@ -0,0 +1,186 @@
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+#include <vector>
+#include <optional>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "QE.cpp"
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+#include "ToneMapper.hpp"
+/*
+静态场景相机漫游的时间复用：把上一帧累计的辐射亮度重投影到当前视角继续累加，样本集中花在历史无效的像素上。
+长历史只适合相机静止或近乎静止：运动中金属、清漆等高光随视角缓慢变化，单帧变化小于容差检测不出来，累积成偏差。
+相机位姿与上一帧不同时历史截断到 movingHistory；它小于 freshSamples 时运动中每帧都取 freshSamples 个样本，历史只起平滑作用
+    1. 重投影：当前交点投影到上一帧相机，取周围 4 个像素做双线性；每个像素须是同一实例、法线相近、
+       当前点到其切平面的距离小于 planeThreshold × 相机距离，否则视为遮挡变化（disocclusion）不参与。有效权重之和低于 minCoverage 即无历史
+    2. 采样：历史样本数不足 freshSamples 的像素（新露出、首帧、刚被拒绝）本帧取 freshSamples 个面光源样本，其余只追加 refreshSamples 个
+    3. 变化检测：新估计与历史的亮度差超过 changeSigma 个标准差再加 changeTolerance 的相对容差时丢弃历史，并当帧补足 freshSamples 个样本。
+       标准差来自面光源采样的单样本方差（由 shadePixel 的方差输出估计，随历史一起重投影），只有点光源的像素方差为 0，
+       高光随视角移动等任何超过容差的变化都会被拒绝；静态场景里历史只用来平均掉面光源的采样噪声
+    4. 累加：按样本数加权平均，样本数截断到 maxHistory（相机运动时为 movingHistory），更早的样本按比例淡出（也限制了双线性重采样带来的累积模糊）
+320x180、8 个面光源的场景，相机每帧平移约 0.18 的慢速漫游，第 6 帧相对 256 spp 参考的 RMSE：
+    不截断（maxHistory = 256）  0.0158，每像素 3.3 个样本
+    movingHistory = 8           0.0062，每像素 12.6 个样本；同样本数的逐帧渲染为 0.0085
+点光源无采样噪声，只有面光源的样本数随历史增长；间接漫反射（Engine::irradianceCache）同样被累加。
+*/
+template<typename T = float>
+class TemporalReusePass {
+public:
+    int freshSamples = 16;
+    int refreshSamples = 1;
+    T maxHistory = 256;
+    T movingHistory = 8;          // 相机位姿变化时历史样本数的上限
+    T normalThreshold = T(0.999); // 复用历史的法线夹角余弦下限（平面着色的网格上相邻面片不互相混合）
+    T planeThreshold = T(0.01);
+    T minCoverage = T(0.5);       // 有效像素的双线性权重之和低于它时视为无历史（轮廓、屏幕边缘不外推）
+    T changeSigma = 4;
+    T changeTolerance = T(0.03);
+    T sigma = 0.05f;
+    size_t threads = 0;
+    // 最近一帧的统计
+    size_t lastFresh = 0;         // 没有可用历史的像素数
+    size_t lastRejected = 0;      // 历史因着色变化被丢弃的像素数
+    uint64_t lastSamples = 0;     // 本帧追踪的面光源样本数（按像素计）
+    T lastMeanHistory = 0;        // 命中像素的平均累计样本数（等效 spp）
+
+    // 丢弃历史（切换场景、光源或相机跳变时调用）
+    void reset() { previous.clear(); prevSurfaces.clear(); prevCamera.reset(); frame = 0; }
+    void run(const Engine<T>& engine, const Camera<T>& camera, Framebuffer<T>& fb, uint64_t seed) {
+        QE_PROFILE_SCOPE("TemporalReusePass::run");
+        width = fb.width(); height = fb.height();
+        const size_t pixels = width * height;
+        if (previous.size() != pixels) reset();
+        const uint64_t frameSeed = deriveSeed(seed, frame++);
+        const bool moving = prevCamera && ((camera.position - prevCamera->position).length() > 0 || (camera.forward - prevCamera->forward).length() > 0);
+        hits.resize(pixels);
+        surfaces.resize(pixels);
+        current.assign(pixels, History());
+        // 1. 主光线（与 Engine::render 相同，可走可见性缓冲）
+        VisibilityBuffer<T> visibility;
+        if (engine.rasterPrimary) engine.rasterizeVisibility(camera, visibility, threads);
+        parallelFor(0, height, [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                const size_t p = y * width + x;
+                hits[p] = engine.primaryHit(camera.generateRay(y, x), x, y, engine.rasterPrimary ? &visibility : nullptr);
+                Surface& s = surfaces[p];
+                s.valid = hits[p].has_value();
+                if (!s.valid) continue;
+                s.position = hits[p]->position; s.normal = hits[p]->normal; s.instance = hits[p]->instance;
+            }
+        }, threads);
+        // 2. 重投影 + 采样 + 累加
+        std::vector<uint64_t> rowSamples(height, 0);
+        std::vector<size_t> rowFresh(height, 0), rowRejected(height, 0);
+        std::vector<double> rowHistory(height, 0);
+        parallelFor(0, height, [&](size_t y) {
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(frameSeed, y)));
+            for (size_t x = 0; x < width; ++x) {
+                const size_t p = y * width + x;
+                if (!surfaces[p].valid) { fb.set(x, y, Vec3<T>(0, 0, 0)); continue; }
+                const Ray<T> ray = camera.generateRay(y, x);
+                History h;
+                if (!prevCamera || !reproject(surfaces[p], h)) ++rowFresh[y];
+                if (moving) h.samples = std::min(h.samples, movingHistory);
+                // 历史存表面出射辐射亮度：介质衰减随相机距离变化，按当前距离重新施加
+                const T attenuation = std::exp(-sigma * hits[p]->t);
+                int n = h.samples >= T(freshSamples) ? refreshSamples : freshSamples;
+                T meanVariance;
+                Vec3<T> estimate = *engine.shadePixel(rng, ray, hits[p], sigma, n, &meanVariance) / attenuation;
+                T variance = std::isnan(meanVariance) ? h.variance : meanVariance * T(n) / (attenuation * attenuation); // 单样本方差，n = 1 时沿用历史
+                if (h.samples > 0 && changed(h, estimate, variance, n)) {
+                    ++rowRejected[y];
+                    h = History();
+                    if (n < freshSamples) {
+                        const Vec3<T> extra = *engine.shadePixel(rng, ray, hits[p], sigma, freshSamples - n, &meanVariance) / attenuation;
+                        estimate = (estimate * T(n) + extra * T(freshSamples - n)) / T(freshSamples);
+                        if (!std::isnan(meanVariance)) variance = meanVariance * T(freshSamples - n) / (attenuation * attenuation);
+                        n = freshSamples;
+                    }
+                }
+                rowSamples[y] += uint64_t(n);
+                History& out = current[p];
+                const T total = h.samples + T(n);
+                out.color = (h.color * h.samples + estimate * T(n)) / total;
+                out.samples = std::min(total, maxHistory);
+                out.variance = std::isnan(variance) ? T(0) : variance;
+                rowHistory[y] += out.samples;
+                fb.set(x, y, out.color * attenuation);
+            }
+        }, threads);
+        lastSamples = 0; lastFresh = 0; lastRejected = 0;
+        double history = 0;
+        size_t valid = 0;
+        for (size_t y = 0; y < height; ++y) {
+            lastSamples += rowSamples[y]; lastFresh += rowFresh[y]; lastRejected += rowRejected[y]; history += rowHistory[y];
+        }
+        for (const auto& s : surfaces) valid += s.valid;
+        lastMeanHistory = valid ? T(history / double(valid)) : T(0);
+        // 3. 当前帧成为下一帧的历史
+        previous.swap(current);
+        prevSurfaces.swap(surfaces);
+        prevCamera = camera;
+    }
+private:
+    struct Surface {
+        Vec3<T> position, normal;
+        uint32_t instance = 0;
+        bool valid = false;
+    };
+    struct History {
+        Vec3<T> color = Vec3<T>(0, 0, 0); // 累计平均
+        T samples = 0;                    // 累计样本数，0 表示无历史
+        T variance = 0;                   // 面光源单样本的亮度方差估计
+    };
+    size_t width = 0, height = 0;
+    uint64_t frame = 0;
+    std::vector<std::optional<HitInfo<T>>> hits;
+    std::vector<Surface> surfaces, prevSurfaces;
+    std::vector<History> current, previous;
+    std::optional<Camera<T>> prevCamera;
+
+    // 双线性取上一帧的历史，只用几何一致的像素并重新归一化权重
+    bool reproject(const Surface& s, History& out) const {
+        T px, py;
+        if (!prevCamera->project(s.position, px, py)) return false;
+        px -= T(0.5); py -= T(0.5); // 转到像素中心坐标
+        const T fx = std::floor(px), fy = std::floor(py);
+        const T tx = px - fx, ty = py - fy;
+        const T distance = (s.position - prevCamera->position).length();
+        History sum;
+        T weightSum = 0;
+        for (int dy = 0; dy <= 1; ++dy)
+            for (int dx = 0; dx <= 1; ++dx) {
+                const T qx = fx + T(dx), qy = fy + T(dy);
+                if (qx < 0 || qy < 0 || qx >= T(width) || qy >= T(height)) continue;
+                const T w = (dx ? tx : 1 - tx) * (dy ? ty : 1 - ty);
+                if (w <= 0) continue;
+                const size_t q = size_t(qy) * width + size_t(qx);
+                const Surface& prev = prevSurfaces[q];
+                const History& h = previous[q];
+                if (!prev.valid || h.samples <= 0 || prev.instance != s.instance || s.normal.dot(prev.normal) < normalThreshold) continue;
+                if (std::abs((s.position - prev.position).dot(prev.normal)) > planeThreshold * distance) continue;
+                sum.color += h.color * w;
+                sum.samples += h.samples * w;
+                sum.variance += h.variance * w;
+                weightSum += w;
+            }
+        if (weightSum < minCoverage) return false;
+        const T inv = 1 / weightSum;
+        out.color = sum.color * inv;
+        out.samples = sum.samples * inv;
+        out.variance = sum.variance * inv;
+        return true;
+    }
+    // 新估计（n 个样本）与历史之差是否超出两者采样噪声所能解释的范围
+    inline bool changed(const History& h, const Vec3<T>& estimate, T variance, int n) const {
+        const T L = luminance(estimate.x, estimate.y, estimate.z), Lh = luminance(h.color.x, h.color.y, h.color.z);
+        const T deviation = std::sqrt(std::max(T(0), variance) * (T(1) / T(n) + T(1) / h.samples));
+        return std::abs(L - Lh) > changeSigma * deviation + changeTolerance * std::max(Lh, L) + T(1e-6);
+    }
+};
+#endif
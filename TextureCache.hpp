@@ -0,0 +1,240 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Vec3.hpp"
+#include "Half.hpp"
+#include "Material.hpp"
+/*
+分块纹理（.qtx）磁盘格式：
+    TiledTextureHeader
+    tile[0], tile[1], ... 按行主序排列，每块固定 tileSize * tileSize * texelBytes 字节
+    （边缘块不足部分补 0，因此块偏移可以直接算出，不需要索引表）
+内存中的缓存块保持磁盘格式（8 位或半精度），采样时才解码成 Vec3，
+相比 ImageTexture 每个纹素 12 字节，内存占用降到 3 / 6 字节。
+*/
+enum class TexelFormat : uint32_t {
+    RGB8,     // 每分量 8 位，[0,1] 线性量化
+    RGBHalf   // 每分量半精度浮点，可存 HDR
+};
+inline size_t texelBytes(TexelFormat format) { return format == TexelFormat::RGB8 ? 3 : 6; }
+
+#pragma pack(push, 1)
+struct TiledTextureHeader {
+    uint32_t magic;    // 'QTX1'
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t format;   // TexelFormat
+};
+#pragma pack(pop)
+constexpr uint32_t TILED_TEXTURE_MAGIC = 0x31585451; // "QTX1"
+
+// 把整张图写成分块纹理文件（data 按 height 行 * width 列存储，与 ImageTexture 一致）
+template<typename T = float>
+void writeTiledTexture(const std::string& filename, size_t width, size_t height, const std::vector<Vec3<T>>& data,
+                       TexelFormat format = TexelFormat::RGB8, size_t tileSize = 64) {
+    if (data.size() < width * height) throw std::runtime_error("texture data too small.");
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    TiledTextureHeader header{ TILED_TEXTURE_MAGIC, uint32_t(width), uint32_t(height), uint32_t(tileSize), uint32_t(format) };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const size_t tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    const size_t bpp = texelBytes(format);
+    std::vector<uint8_t> tile(tileSize * tileSize * bpp);
+    for (size_t ty = 0; ty < tilesY; ++ty)
+        for (size_t tx = 0; tx < tilesX; ++tx) {
+            std::fill(tile.begin(), tile.end(), 0);
+            for (size_t r = 0; r < tileSize && ty * tileSize + r < height; ++r)
+                for (size_t c = 0; c < tileSize && tx * tileSize + c < width; ++c) {
+                    const Vec3<T>& v = data[(ty * tileSize + r) * width + tx * tileSize + c];
+                    uint8_t* dst = tile.data() + (r * tileSize + c) * bpp;
+                    if (format == TexelFormat::RGB8) {
+                        for (int k = 0; k < 3; ++k)
+                            dst[k] = uint8_t(std::clamp(float(v[k]), 0.0f, 1.0f) * 255.0f + 0.5f);
+                    } else {
+                        for (int k = 0; k < 3; ++k) {
+                            const uint16_t h = floatToHalf(float(v[k]));
+                            std::memcpy(dst + k * 2, &h, 2);
+                        }
+                    }
+                }
+            file.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+        }
+}
+
+// 缓存命中统计
+struct TextureCacheStats {
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t residentBytes = 0, budgetBytes = 0;
+    double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+// 分片、线程安全的 LRU 块缓存，总内存受 budget 约束
+class TextureTileCache {
+public:
+    using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+    using Loader = std::function<std::vector<uint8_t>()>;
+private:
+    struct Shard {
+        std::mutex lock;
+        std::list<std::pair<uint64_t, Tile>> lru; // 表头为最近使用
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Tile>>::iterator> table;
+        size_t bytes = 0;
+    };
+    std::vector<Shard> shards;
+    size_t shardBudget;
+    std::atomic<uint64_t> hits{ 0 }, misses{ 0 }, evictions{ 0 };
+    std::atomic<uint32_t> nextFileId{ 0 };
+    inline Shard& shardOf(uint64_t key) {
+        // 简单混合一下，避免同一纹理的相邻块落到同一分片
+        key ^= key >> 33; key *= 0xff51afd7ed558ccdULL; key ^= key >> 33;
+        return shards[key % shards.size()];
+    }
+public:
+    TextureTileCache(size_t budgetBytes = size_t(256) << 20, size_t shardCount = 16)
+        : shards(std::max<size_t>(1, shardCount)), shardBudget(budgetBytes / std::max<size_t>(1, shardCount)) {}
+    TextureTileCache(const TextureTileCache&) = delete;
+    TextureTileCache& operator=(const TextureTileCache&) = delete;
+    uint32_t registerFile() { return nextFileId++; }
+    static inline uint64_t makeKey(uint32_t fileId, uint64_t tileIndex) { return (uint64_t(fileId) << 40) | tileIndex; }
+    // 只查不加载：未缓存时返回空指针（由调用方决定何时加载，不计为未命中）
+    Tile find(uint64_t key) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.table.find(key);
+        if (it == shard.table.end()) return nullptr;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+    // 命中直接返回；未命中时在锁外调用 loader 读盘，再插入并按 LRU 淘汰
+    Tile get(uint64_t key, const Loader& loader) {
+        Shard& shard = shardOf(key);
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto it = shard.table.find(key);
+            if (it != shard.table.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second->second;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        Tile tile = std::make_shared<const std::vector<uint8_t>>(loader());
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.table.find(key);
+        if (it != shard.table.end()) return it->second->second; // 其他线程已经加载
+        shard.lru.emplace_front(key, tile);
+        shard.table[key] = shard.lru.begin();
+        shard.bytes += tile->size();
+        // 至少保留刚插入的块；被淘汰的块若仍被采样线程持有，由 shared_ptr 延迟释放
+        while (shard.bytes > shardBudget && shard.lru.size() > 1) {
+            auto& victim = shard.lru.back();
+            shard.bytes -= victim.second->size();
+            shard.table.erase(victim.first);
+            shard.lru.pop_back();
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return tile;
+    }
+    void clear() {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.lru.clear(); shard.table.clear(); shard.bytes = 0;
+        }
+    }
+    TextureCacheStats stats() {
+        TextureCacheStats s;
+        s.hits = hits.load(); s.misses = misses.load(); s.evictions = evictions.load();
+        s.budgetBytes = shardBudget * shards.size();
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            s.residentBytes += shard.bytes;
+        }
+        return s;
+    }
+};
+
+// 按需分页的图像纹理：只常驻文件头，块通过共享缓存读入。
+// 不长期占用文件描述符：读块时才打开文件，读完即关，纹理文件再多也不会耗尽 fd
+template<typename T = float>
+class TiledImageTexture : public Texture<T> {
+private:
+    TextureTileCache& cache;
+    uint32_t fileId;
+    std::string filename;
+    TiledTextureHeader header;
+    size_t tilesX, tileBytes;
+    std::vector<uint8_t> readTile(size_t tileIndex) const {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        std::vector<uint8_t> buf(tileBytes);
+        const off_t offset = off_t(sizeof(TiledTextureHeader) + tileIndex * tileBytes);
+        size_t done = 0;
+        while (done < tileBytes) {
+            const ssize_t n = pread(fd, buf.data() + done, tileBytes - done, offset + off_t(done));
+            if (n <= 0) { close(fd); throw std::runtime_error("failed to read texture tile."); }
+            done += size_t(n);
+        }
+        close(fd);
+        return buf;
+    }
+public:
+    static constexpr uint32_t MAX_TILE_SIZE = 4096;
+    TiledImageTexture(const std::string& __filename, TextureTileCache& __cache)
+        : cache(__cache), fileId(__cache.registerFile()), filename(__filename) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        struct stat st;
+        const bool ok = pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) && fstat(fd, &st) == 0;
+        close(fd);
+        if (!ok || header.magic != TILED_TEXTURE_MAGIC) throw std::runtime_error("invalid tiled texture " + filename);
+        // 文件头不可信：块大小为 0 会除零，未知格式会算错纹素字节数
+        if (header.tileSize == 0 || header.tileSize > MAX_TILE_SIZE) throw std::runtime_error("invalid tile size in " + filename);
+        if (header.format != uint32_t(TexelFormat::RGB8) && header.format != uint32_t(TexelFormat::RGBHalf))
+            throw std::runtime_error("unknown texel format in " + filename);
+        if (header.width == 0 || header.height == 0) throw std::runtime_error("empty tiled texture " + filename);
+        tilesX = (header.width + header.tileSize - 1) / header.tileSize;
+        const size_t tilesY = (header.height + header.tileSize - 1) / header.tileSize;
+        tileBytes = size_t(header.tileSize) * header.tileSize * texelBytes(TexelFormat(header.format));
+        if (size_t(st.st_size) < sizeof(TiledTextureHeader) + tilesX * tilesY * tileBytes)
+            throw std::runtime_error("truncated tiled texture " + filename);
+    }
+    TiledImageTexture(const TiledImageTexture&) = delete;
+    TiledImageTexture& operator=(const TiledImageTexture&) = delete;
+    size_t getWidth() const { return header.width; }
+    size_t getHeight() const { return header.height; }
+    // 采样约定与 ImageTexture 相同：x 对应行，y 对应列，最近邻
+    Vec3<T> sample(T x, T y) const override {
+        x = std::clamp(x, T(0), T(1));
+        y = std::clamp(y, T(0), T(1));
+        const size_t height = header.height, width = header.width, ts = header.tileSize;
+        const size_t r = std::min(size_t(std::round(x * (height - 1))), height - 1);
+        const size_t c = std::min(size_t(std::round(y * (width - 1))), width - 1);
+        const size_t tileIndex = (r / ts) * tilesX + c / ts;
+        const auto tile = cache.get(TextureTileCache::makeKey(fileId, tileIndex), [&] { return readTile(tileIndex); });
+        const TexelFormat format = TexelFormat(header.format);
+        const uint8_t* p = tile->data() + ((r % ts) * ts + c % ts) * texelBytes(format);
+        if (format == TexelFormat::RGB8)
+            return Vec3<T>(T(p[0]) / T(255), T(p[1]) / T(255), T(p[2]) / T(255));
+        uint16_t h[3];
+        std::memcpy(h, p, sizeof(h));
+        return Vec3<T>(T(halfToFloat(h[0])), T(halfToFloat(h[1])), T(halfToFloat(h[2])));
+    }
+};
+#endif
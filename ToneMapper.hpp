@@ -1,8 +1,14 @@
 #ifndef TONEMAPPER_H
 #define TONEMAPPER_H
 #include "Vec3.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
 #include <algorithm>
 #include <cmath>
+#include <vector>
+#include <array>
+#include <cstdint>
 
 enum class ToneMappingType {
     Reinhard,
@@ -10,6 +16,24 @@ enum class ToneMappingType {
     Uncharted2
 };
 
+// 单通道色调曲线，编译期选择，内层循环无分支便于自动向量化
+template<ToneMappingType Type, typename T>
+inline T toneCurve(T v) {
+    if constexpr (Type == ToneMappingType::Reinhard) {
+        return v / (1 + v);
+    } else if constexpr (Type == ToneMappingType::ACESFilm) {
+        T a = v*(v + 0.0245786f) - 0.000090537f;
+        T b = v*(0.983729f*v + 0.4329510f) + 0.238081f;
+        return std::clamp(a/b, T(0), T(1));
+    } else {
+        // Uncharted2 / John Hable
+        const T A=0.15f, B=0.50f, C=0.10f, D=0.20f, E=0.02f, F=0.30f;
+        T num = ((v*(A*v + C*B) + D*E));
+        T den = (v*(A*v + B) + D*F);
+        return std::clamp(num/den - E/F, T(0), T(1));
+    }
+}
+
 template<typename T = float>
 class ToneMapper {
     ToneMappingType type;
@@ -39,28 +63,157 @@ public:
 
 private:
     Vec3<T> reinhard(const Vec3<T>& x) const {
-        return { x.x / (1 + x.x), x.y / (1 + x.y), x.z / (1 + x.z) };
+        auto f = toneCurve<ToneMappingType::Reinhard, T>;
+        return { f(x.x), f(x.y), f(x.z) };
     }
 
     Vec3<T> acesFilm(const Vec3<T>& x) const {
-        auto f = [](T v) {
-            T a = v*(v + 0.0245786f) - 0.000090537f;
-            T b = v*(0.983729f*v + 0.4329510f) + 0.238081f;
-            return std::clamp(a/b, T(0), T(1));
-        };
+        auto f = toneCurve<ToneMappingType::ACESFilm, T>;
         return { f(x.x), f(x.y), f(x.z) };
     }
 
     Vec3<T> uncharted2(const Vec3<T>& x) const {
-        // Uncharted2 / John Hable
-        auto tonemap = [](T v) {
-            const T A=0.15f, B=0.50f, C=0.10f, D=0.20f, E=0.02f, F=0.30f;
-            T num = ((v*(A*v + C*B) + D*E));
-            T den = (v*(A*v + B) + D*F);
-            return std::clamp(num/den - E/F, T(0), T(1));
-        };
+        auto tonemap = toneCurve<ToneMappingType::Uncharted2, T>;
         return { tonemap(x.x), tonemap(x.y), tonemap(x.z) };
     }
 };
 
+// ================================== 整帧色调映射 ==================================
+enum class ExposureMode {
+    Manual,              // 固定 L_mid
+    LogAverage,          // 对数平均亮度（Reinhard 2002）
+    HistogramPercentile  // 对数亮度直方图，去掉两端百分位后取平均
+};
+
+template<typename T>
+inline T luminance(T r, T g, T b) { return T(0.2126) * r + T(0.7152) * g + T(0.0722) * b; }
+
+// 线性 -> sRGB 传递函数
+template<typename T>
+inline T linearToSRGB(T v) {
+    v = std::clamp(v, T(0), T(1));
+    return v <= T(0.0031308) ? v * T(12.92) : T(1.055) * std::pow(v, T(1) / T(2.4)) - T(0.055);
+}
+
+template<typename T = float>
+class ToneMapPass {
+public:
+    static constexpr size_t HISTOGRAM_BINS = 256;
+    static constexpr T MIN_LOG2 = T(-16), MAX_LOG2 = T(16); // 直方图覆盖的 log2 亮度范围
+    ToneMappingType type = ToneMappingType::ACESFilm;
+    ExposureMode exposureMode = ExposureMode::HistogramPercentile;
+    T L_mid = 50;                         // Manual 模式下的中间灰亮度
+    T lowPercent = 0.5, highPercent = 0.95; // HistogramPercentile 模式保留的区间
+    T exposureBias = 1;                   // 自动曝光结果再乘的系数
+    bool srgb = true;
+    size_t threads = 0;
+    T lastMid = 0;                        // 最近一次实际使用的 L_mid
+
+    ToneMapPass(ToneMappingType __type = ToneMappingType::ACESFilm,
+                ExposureMode __mode = ExposureMode::HistogramPercentile)
+        : type(__type), exposureMode(__mode) {}
+
+    // 并行归约：亮度 > 0 的像素的 log 平均（未命中的黑色背景不参与）
+    T logAverageLuminance(const Framebuffer<T>& hdr) const {
+        const size_t rows = hdr.height(), block = 16, blocks = (rows + block - 1) / block;
+        std::vector<double> sums(blocks, 0.0);
+        std::vector<size_t> counts(blocks, 0);
+        parallelFor(0, blocks, [&](size_t b) {
+            double sum = 0; size_t count = 0;
+            for (size_t y = b * block; y < std::min(rows, (b + 1) * block); ++y) {
+                const T* p = hdr.row(y);
+                for (size_t x = 0; x < hdr.width(); ++x, p += 3) {
+                    const T L = luminance(p[0], p[1], p[2]);
+                    if (L > T(0)) { sum += std::log(double(L)); ++count; }
+                }
+            }
+            sums[b] = sum; counts[b] = count;
+        }, threads);
+        double sum = 0; size_t count = 0;
+        for (size_t b = 0; b < blocks; ++b) { sum += sums[b]; count += counts[b]; }
+        return count ? T(std::exp(sum / double(count))) : T(0);
+    }
+    // 并行构建 log2 亮度直方图（每块局部直方图再合并）
+    std::array<uint64_t, HISTOGRAM_BINS> luminanceHistogram(const Framebuffer<T>& hdr) const {
+        const size_t rows = hdr.height(), block = 16, blocks = (rows + block - 1) / block;
+        std::vector<std::array<uint64_t, HISTOGRAM_BINS>> partial(blocks);
+        parallelFor(0, blocks, [&](size_t b) {
+            auto& hist = partial[b];
+            hist.fill(0);
+            for (size_t y = b * block; y < std::min(rows, (b + 1) * block); ++y) {
+                const T* p = hdr.row(y);
+                for (size_t x = 0; x < hdr.width(); ++x, p += 3) {
+                    const T L = luminance(p[0], p[1], p[2]);
+                    if (!(L > T(0))) continue;
+                    const T t = (std::log2(L) - MIN_LOG2) / (MAX_LOG2 - MIN_LOG2);
+                    if (std::isnan(t)) continue;
+                    // 先夹到 [0, 1] 再转整数：inf 直接转 size_t 是未定义行为
+                    ++hist[std::min(HISTOGRAM_BINS - 1, size_t(std::clamp(t, T(0), T(1)) * HISTOGRAM_BINS))];
+                }
+            }
+        }, threads);
+        std::array<uint64_t, HISTOGRAM_BINS> hist{};
+        for (const auto& h : partial)
+            for (size_t i = 0; i < HISTOGRAM_BINS; ++i) hist[i] += h[i];
+        return hist;
+    }
+    // 直方图中 [lowPercent, highPercent] 区间内像素的平均 log2 亮度
+    T histogramAverageLuminance(const Framebuffer<T>& hdr) const {
+        const auto hist = luminanceHistogram(hdr);
+        uint64_t total = 0;
+        for (auto c : hist) total += c;
+        if (total == 0) return T(0);
+        const double lo = double(total) * lowPercent, hi = double(total) * highPercent;
+        double acc = 0, weight = 0, seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BINS; ++i) {
+            // 每个桶与 [lo, hi] 重叠部分计入平均
+            const double begin = seen, end = seen + double(hist[i]);
+            seen = end;
+            const double w = std::max(0.0, std::min(end, hi) - std::max(begin, lo));
+            if (w <= 0) continue;
+            const double log2L = MIN_LOG2 + (double(i) + 0.5) / HISTOGRAM_BINS * (MAX_LOG2 - MIN_LOG2);
+            acc += w * log2L; weight += w;
+        }
+        return weight > 0 ? T(std::exp2(acc / weight)) : T(0);
+    }
+    T computeMid(const Framebuffer<T>& hdr) const {
+        T mid = L_mid;
+        if (exposureMode == ExposureMode::LogAverage) mid = logAverageLuminance(hdr);
+        else if (exposureMode == ExposureMode::HistogramPercentile) mid = histogramAverageLuminance(hdr);
+        if (!(mid > T(0))) mid = L_mid;
+        return exposureMode == ExposureMode::Manual ? mid : mid / exposureBias;
+    }
+    // hdr -> ldr（显示编码后的 [0,1]），ldr 可以与 hdr 是同一个缓冲
+    void run(const Framebuffer<T>& hdr, Framebuffer<T>& ldr) {
+        QE_PROFILE_SCOPE("ToneMapPass::run");
+        if (&ldr != &hdr) ldr.resize(hdr.width(), hdr.height());
+        lastMid = computeMid(hdr);
+        parallelFor(0, hdr.height(), [&](size_t y) { mapSpan(hdr, ldr, y, 0, hdr.width(), lastMid); }, threads, 8);
+    }
+    // 只映射一个图块（单线程），mid 为整帧的中间灰亮度（如先前 computeMid 的结果）；ldr 须已是 hdr 的尺寸。
+    // 结果与 run 在该图块上的输出逐位相同，供流水线在图块完成后立即编码
+    void runTile(const Framebuffer<T>& hdr, Framebuffer<T>& ldr, const Tile& tile, T mid) const {
+        for (size_t y = tile.y0; y < tile.y1; ++y) mapSpan(hdr, ldr, y, tile.x0, tile.x1, mid);
+    }
+private:
+    void mapSpan(const Framebuffer<T>& hdr, Framebuffer<T>& ldr, size_t y, size_t x0, size_t x1, T mid) const {
+        switch (type) {
+        case ToneMappingType::Reinhard: apply<ToneMappingType::Reinhard>(hdr, ldr, y, x0, x1, mid); break;
+        case ToneMappingType::ACESFilm: apply<ToneMappingType::ACESFilm>(hdr, ldr, y, x0, x1, mid); break;
+        case ToneMappingType::Uncharted2: apply<ToneMappingType::Uncharted2>(hdr, ldr, y, x0, x1, mid); break;
+        }
+    }
+    template<ToneMappingType Type>
+    void apply(const Framebuffer<T>& hdr, Framebuffer<T>& ldr, size_t y, size_t x0, size_t x1, T mid) const {
+        const T exposure = T(0.18) / mid;
+        const size_t length = (x1 - x0) * 3;
+        const T* src = hdr.row(y) + x0 * 3;
+        T* dst = ldr.row(y) + x0 * 3;
+        // 曝光与色调曲线对每个通道独立，整段连续处理
+        for (size_t i = 0; i < length; ++i) dst[i] = toneCurve<Type, T>(src[i] * exposure);
+        if (srgb)
+            for (size_t i = 0; i < length; ++i) dst[i] = linearToSRGB(dst[i]);
+    }
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,398 @@
+#ifndef VALIDATION_H
+#define VALIDATION_H
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include "QE.cpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Random.hpp"
+/*
+加速结构差分验证：同一批光线分别走暴力参考（Object::intersectBruteForce，逐图元线性求交）与加速路径，逐条比较结果。
+    tlas：Engine::tlas.intersect（完整的 TLAS + BLAS 遍历）
+    blas：逐实例 Object::intersect 取最近（绕过 TLAS，失配只能来自 BLAS）
+    occluded：TLAS::occluded(ray, tMax) 与参考最近交点 t < tMax 比较，tMax 取参考 t 的 0.5 ~ 1.5 倍（无交点时取远距离）
+    hint：TLAS::occludedByHint 分别用本条光线与上一条光线遍历时记下的遮挡者判定，判为遮挡时参考须在 tMax 内有交点
+          （记录失效或未命中时返回 false 交给完整遍历，不算错）
+光线按种类生成（每条光线的种子由 (seed, 种类, 下标) 派生，报告里的种子可用 makeRay 单独重放）：
+    Random        场景包围盒内随机起点、随机方向
+    Grazing       几乎贴着三角形平面穿过三角形内部一点
+    Edge          从随机起点瞄准三角形的边或顶点
+    Inside        起点在实例包围盒内部或恰好在其某个面上
+    AxisParallel  方向恰为 ±坐标轴（其余分量为 ±0），另两个坐标取三角形顶点坐标，使光线落在叶子包围盒的面上，
+                  AABB::intersect 中 1 / 0 = inf 与 0 × inf 的情形都会出现
+参考与加速路径调用同一个三角形求交函数，交点 t 只允许 tTolerance 的相对误差，有无交点的差异都视为错误；
+但若把起点沿某一轴挪动几个 ulp 后参考给出的正是加速路径的结果（光线贴着共享边、顶点或在面内穿过，差别小于起点坐标的精度），
+这类失配单独计入 illConditioned，照常报告但不算失败；以 double 逐图元重算的参考与加速路径一致时同样计入
+（几乎平行的光线上 float 参考自身的 t 误差可超出容差，而加速路径的包围盒测试正确剔除了这个交点）。
+两者都不符的才是错误。
+runRenderPaths 另在给定相机下逐像素比较渲染路径：
+    visibility：可见性缓冲重建的主光线交点（Engine::primaryHit）与 TLAS::intersect，病态判定同上
+    shadowBatch：批量阴影（Engine::batchShadows）与逐像素阴影渲染同一帧，像素颜色须在 colorTolerance 内一致
+    indirectBatch：同上，但设置临时的辐照度缓存（Engine::irradianceCache）；两次渲染前各自清空缓存并单线程渲染，记录插入顺序相同
+*/
+enum class ValidationRayKind { Random, Grazing, Edge, Inside, AxisParallel, Count };
+inline const char* validationRayKindName(ValidationRayKind kind) {
+    switch (kind) {
+    case ValidationRayKind::Random: return "random";
+    case ValidationRayKind::Grazing: return "grazing";
+    case ValidationRayKind::Edge: return "edge";
+    case ValidationRayKind::Inside: return "inside";
+    case ValidationRayKind::AxisParallel: return "axisParallel";
+    default: return "unknown";
+    }
+}
+template<typename T = float>
+struct ValidationMismatch {
+    ValidationRayKind kind;
+    uint64_t raySeed;             // makeRay(engine, kind, raySeed) 重放
+    const char* path;             // "tlas" / "blas" / "occluded" / "hint"
+    const char* what;             // "hit"（有无交点不同）/ "t"（距离不同）
+    Vec3<T> origin, direction;
+    T tMax;                       // 仅 occluded / hint
+    T t, referenceT;              // 无交点为 inf；occluded 失配时为是否遮挡（0 / 1），hint 失配时 t 的两位分别为本条与上一条记录的结果
+    bool illConditioned;          // 起点的 ulp 级扰动下参考与加速路径一致，不计入失败
+};
+struct ValidationKindStats {
+    size_t rays = 0, referenceHits = 0;
+    size_t tlasMismatches = 0, blasMismatches = 0, occlusionMismatches = 0, hintMismatches = 0;
+    size_t illConditioned = 0;    // 可由起点 ulp 级扰动解释的失配（各路径合计，不计入上面几项）
+    double referenceSeconds = 0, tlasSeconds = 0, blasSeconds = 0, occludedSeconds = 0;
+    // 暴力参考相对 TLAS 的耗时倍数
+    double speedup() const { return tlasSeconds > 0 ? referenceSeconds / tlasSeconds : 0.0; }
+};
+template<typename T = float>
+struct ValidationReport {
+    uint64_t seed = 0;
+    size_t instances = 0;
+    size_t unverifiedInstances = 0; // 不提供图元、参考只能退回其自身 intersect 的实例数
+    ValidationKindStats kinds[size_t(ValidationRayKind::Count)];
+    std::vector<ValidationMismatch<T>> mismatches; // 最多 maxReported 条
+    size_t totalMismatches() const {
+        size_t n = 0;
+        for (const auto& k : kinds) n += k.tlasMismatches + k.blasMismatches + k.occlusionMismatches + k.hintMismatches;
+        return n;
+    }
+    bool passed() const { return totalMismatches() == 0; }
+};
+// 渲染路径比较的结果，失配按像素记
+struct RenderPathMismatch {
+    const char* path;             // "visibility" / "shadowBatch" / "indirectBatch"
+    size_t x, y;
+    bool illConditioned;
+};
+template<typename T = float>
+struct RenderPathReport {
+    size_t pixels = 0;
+    size_t visibilityMismatches = 0, visibilityIllConditioned = 0;
+    size_t shadowBatchMismatches = 0, indirectBatchMismatches = 0;
+    T maxShadowBatchError = 0;    // 批量与逐像素阴影之间最大的分量相对误差
+    T maxIndirectBatchError = 0;  // 同上，带辐照度缓存
+    std::vector<RenderPathMismatch> mismatches; // 最多 maxReported 条
+    bool passed() const { return visibilityMismatches == 0 && shadowBatchMismatches == 0 && indirectBatchMismatches == 0; }
+};
+
+template<typename T = float>
+class TraversalValidator {
+public:
+    size_t raysPerKind = 2000;
+    T tTolerance = T(1e-5);   // 交点距离的相对容差
+    T perturbUlps = 8;        // 判定病态时起点各轴的扰动量（按坐标量级的 ulp 数）
+    T colorTolerance = T(1e-5); // 批量阴影与逐像素阴影像素颜色的相对容差
+    size_t maxReported = 32;
+    size_t threads = 0;
+
+    ValidationReport<T> run(const Engine<T>& engine, uint64_t seed) {
+        QE_PROFILE_SCOPE("TraversalValidator::run");
+        collect(engine);
+        ValidationReport<T> report;
+        report.seed = seed;
+        report.instances = engine.instances.size();
+        for (const auto& ins : engine.instances) {
+            ins.object->prepare();
+            report.unverifiedInstances += ins.object->primitiveCount() == 0;
+        }
+        const size_t n = raysPerKind;
+        std::vector<Ray<T>> rays;
+        std::vector<uint64_t> seeds(n);
+        std::vector<T> tMax(n);
+        std::vector<std::optional<HitInfo<T>>> reference(n), tlas(n), blas(n);
+        std::vector<char> occluded(n), hinted(n);
+        for (size_t k = 0; k < size_t(ValidationRayKind::Count); ++k) {
+            const auto kind = ValidationRayKind(k);
+            ValidationKindStats& stats = report.kinds[k];
+            rays.clear();
+            for (size_t i = 0; i < n; ++i) {
+                seeds[i] = deriveSeed(deriveSeed(seed, k), i);
+                rays.push_back(makeRay(engine, kind, seeds[i]));
+            }
+            stats.rays = n;
+            stats.referenceSeconds = timed([&](size_t i) { reference[i] = referenceIntersect(engine, rays[i]); });
+            for (size_t i = 0; i < n; ++i) {
+                std::mt19937 rng(static_cast<std::mt19937::result_type>(deriveSeed(seeds[i], 1)));
+                tMax[i] = reference[i] ? reference[i]->t * std::uniform_real_distribution<T>(T(0.5), T(1.5))(rng) : FAR_DISTANCE;
+                stats.referenceHits += reference[i].has_value();
+            }
+            stats.tlasSeconds = timed([&](size_t i) { tlas[i] = engine.tlas.intersect(rays[i]); });
+            stats.blasSeconds = timed([&](size_t i) { blas[i] = blasIntersect(engine, rays[i]); });
+            stats.occludedSeconds = timed([&](size_t i) { occluded[i] = engine.tlas.occluded(rays[i], tMax[i]); });
+            // 本条光线的记录先测记下的图元，上一条光线的记录多半测不中该图元，会走缓存的 BLAS 子树入口
+            timed([&](size_t i) {
+                OccluderHint<T> own, previous;
+                engine.tlas.occluded(rays[i], tMax[i], &own);
+                if (i > 0) engine.tlas.occluded(rays[i - 1], tMax[i - 1], &previous);
+                hinted[i] = char(int(engine.tlas.occludedByHint(rays[i], tMax[i], own)) | int(engine.tlas.occludedByHint(rays[i], tMax[i], previous)) << 1);
+            });
+            for (size_t i = 0; i < n; ++i) {
+                auto record = [&](size_t& counter, const char* path, const char* what, T t, T referenceT, auto&& agrees) {
+                    const bool illConditioned = withinNoise(engine, rays[i], agrees);
+                    ++(illConditioned ? stats.illConditioned : counter);
+                    if (report.mismatches.size() < maxReported)
+                        report.mismatches.push_back(ValidationMismatch<T>{ kind, seeds[i], path, what, rays[i].origin, rays[i].direction, tMax[i], t, referenceT, illConditioned });
+                };
+                const T refT = reference[i] ? reference[i]->t : INF;
+                if (const char* what = compare(tlas[i], reference[i]))
+                    record(stats.tlasMismatches, "tlas", what, tlas[i] ? tlas[i]->t : INF, refT, [&](const auto& ref) { return !compare(tlas[i], ref); });
+                if (const char* what = compare(blas[i], reference[i]))
+                    record(stats.blasMismatches, "blas", what, blas[i] ? blas[i]->t : INF, refT, [&](const auto& ref) { return !compare(blas[i], ref); });
+                const bool expected = reference[i] && reference[i]->t < tMax[i];
+                if (bool(occluded[i]) != expected)
+                    record(stats.occlusionMismatches, "occluded", "hit", T(occluded[i]), T(expected), [&](const auto& ref) { return bool(occluded[i]) == (ref && ref->t < tMax[i]); });
+                if (hinted[i] && !expected)
+                    record(stats.hintMismatches, "hint", "hit", T(hinted[i]), T(expected), [&](const auto& ref) { return ref && ref->t < tMax[i]; });
+            }
+        }
+        return report;
+    }
+    // 同一相机下比较可见性缓冲与 TLAS 的主光线交点、批量与逐像素阴影渲染的图像；
+    // 渲染时临时切换 engine.batchShadows 与 engine.irradianceCache，返回前恢复
+    RenderPathReport<T> runRenderPaths(Engine<T>& engine, const Camera<T>& camera, uint64_t seed, int samples = 2) {
+        QE_PROFILE_SCOPE("TraversalValidator::runRenderPaths");
+        if (boxes.size() != engine.instances.size()) collect(engine);
+        const size_t width = size_t(camera.width), height = size_t(camera.height);
+        RenderPathReport<T> report;
+        report.pixels = width * height;
+        VisibilityBuffer<T> visibility;
+        engine.rasterizeVisibility(camera, visibility, threads);
+        std::vector<std::vector<RenderPathMismatch>> rowMismatches(height);
+        parallelFor(0, height, [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                const Ray<T> ray = camera.generateRay(y, x);
+                const auto hit = engine.primaryHit(ray, x, y, &visibility);
+                if (!compare(hit, engine.tlas.intersect(ray))) continue;
+                rowMismatches[y].push_back(RenderPathMismatch{ "visibility", x, y, withinNoise(engine, ray, [&](const auto& ref) { return !compare(hit, ref); }) });
+            }
+        }, threads);
+        for (size_t y = 0; y < height; ++y)
+            for (const auto& m : rowMismatches[y]) {
+                ++(m.illConditioned ? report.visibilityIllConditioned : report.visibilityMismatches);
+                if (report.mismatches.size() < maxReported) report.mismatches.push_back(m);
+            }
+        const bool batchShadows = engine.batchShadows;
+        IrradianceCache<T>* const irradianceCache = engine.irradianceCache;
+        auto compareBatching = [&](const char* path, IrradianceCache<T>* cache, size_t& mismatches, T& maxError) {
+            Framebuffer<T> batched(width, height), perPixel(width, height);
+            engine.irradianceCache = cache;
+            for (const bool batch : { true, false }) {
+                if (cache) cache->clear();
+                engine.batchShadows = batch;
+                engine.render(camera, batch ? batched : perPixel, seed, [](const Tile&) {}, T(0.05), samples, 64, cache ? 1 : threads);
+            }
+            for (size_t y = 0; y < height; ++y)
+                for (size_t x = 0; x < width; ++x) {
+                    T error = 0;
+                    for (int k = 0; k < 3; ++k) {
+                        const T a = batched.row(y)[x * 3 + k], b = perPixel.row(y)[x * 3 + k];
+                        error = std::max(error, std::abs(a - b) / std::max(T(1), std::abs(b)));
+                    }
+                    maxError = std::max(maxError, error);
+                    if (error <= colorTolerance) continue;
+                    ++mismatches;
+                    if (report.mismatches.size() < maxReported) report.mismatches.push_back(RenderPathMismatch{ path, x, y, false });
+                }
+        };
+        compareBatching("shadowBatch", nullptr, report.shadowBatchMismatches, report.maxShadowBatchError);
+        IrradianceCache<T> cache(width * height, sceneSize * T(0.04));
+        compareBatching("indirectBatch", &cache, report.indirectBatchMismatches, report.maxIndirectBatchError);
+        engine.batchShadows = batchShadows;
+        engine.irradianceCache = irradianceCache;
+        return report;
+    }
+    // 由种子确定性地生成一条光线（与 run 中同种子的光线逐位相同，需同一场景）
+    Ray<T> makeRay(const Engine<T>& engine, ValidationRayKind kind, uint64_t raySeed) {
+        if (boxes.size() != engine.instances.size()) collect(engine);
+        std::mt19937 rng(static_cast<std::mt19937::result_type>(raySeed));
+        std::uniform_real_distribution<T> uni(0, 1);
+        auto inBox = [&](const AABB<T>& box) {
+            return Vec3<T>(box.min.x + (box.max.x - box.min.x) * uni(rng), box.min.y + (box.max.y - box.min.y) * uni(rng),
+                           box.min.z + (box.max.z - box.min.z) * uni(rng));
+        };
+        auto sphere = [&] {
+            const T z = 2 * uni(rng) - 1, phi = T(2 * PI) * uni(rng), r = std::sqrt(std::max(T(0), 1 - z * z));
+            return Vec3<T>(r * std::cos(phi), r * std::sin(phi), z);
+        };
+        // 随机取一个三角形（世界坐标）；场景没有可枚举的图元时退化为随机光线
+        Vec3<T> a, b, c;
+        const bool haveTriangle = kind != ValidationRayKind::Random && kind != ValidationRayKind::Inside && randomTriangle(engine, rng, a, b, c);
+        switch (haveTriangle ? kind : (kind == ValidationRayKind::Inside ? kind : ValidationRayKind::Random)) {
+        case ValidationRayKind::Grazing: {
+            T u = uni(rng), v = uni(rng);
+            if (u + v > 1) { u = 1 - u; v = 1 - v; }
+            const Vec3<T> p = a + (b - a) * u + (c - a) * v, e1 = b - a, e2 = c - a;
+            const Vec3<T> normal = e1.cross(e2).normalized();
+            const T angle = T(2 * PI) * uni(rng);
+            const Vec3<T> tangent = (e1.normalized() * std::cos(angle) + normal.cross(e1).normalized() * std::sin(angle)).normalized();
+            const Vec3<T> direction = (tangent + normal * ((uni(rng) - T(0.5)) * T(2e-3))).normalized();
+            return Ray<T>(p - direction * (sceneSize * (T(0.01) + uni(rng))), direction);
+        }
+        case ValidationRayKind::Edge: {
+            const T u = uni(rng);
+            const int e = int(uni(rng) * 4);
+            const Vec3<T> target = e == 0 ? a : e == 1 ? a + (b - a) * u : e == 2 ? b + (c - b) * u : c + (a - c) * u; // 顶点或三条边之一
+            const Vec3<T> origin = inBox(scene);
+            if ((target - origin).length() == 0) return Ray<T>(origin, sphere());
+            return Ray<T>(origin, target - origin);
+        }
+        case ValidationRayKind::Inside: {
+            if (boxes.empty()) return Ray<T>(inBox(scene), sphere());
+            const AABB<T>& box = boxes[std::min(boxes.size() - 1, size_t(uni(rng) * T(boxes.size())))];
+            Vec3<T> origin = inBox(box);
+            if (uni(rng) < T(0.5)) { // 一半落在某个面上
+                const int axis = std::min(2, int(uni(rng) * 3));
+                origin[axis] = uni(rng) < T(0.5) ? box.min[axis] : box.max[axis];
+            }
+            return Ray<T>(origin, sphere());
+        }
+        case ValidationRayKind::AxisParallel: {
+            const int axis = std::min(2, int(uni(rng) * 3));
+            const bool negative = uni(rng) < T(0.5);
+            const Vec3<T> corner[3] = { a, b, c };
+            Vec3<T> origin = corner[std::min(2, int(uni(rng) * 3))];
+            origin[axis] = negative ? scene.max[axis] + sceneSize * T(0.1) : scene.min[axis] - sceneSize * T(0.1);
+            Vec3<T> direction(uni(rng) < T(0.5) ? T(0) : -T(0), uni(rng) < T(0.5) ? T(0) : -T(0), uni(rng) < T(0.5) ? T(0) : -T(0));
+            direction[axis] = negative ? T(-1) : T(1);
+            return Ray<T>(origin, direction);
+        }
+        default:
+            return Ray<T>(inBox(scene), sphere());
+        }
+    }
+    // 暴力参考：逐实例逐图元求交
+    static std::optional<HitInfo<T>> referenceIntersect(const Engine<T>& engine, const Ray<T>& ray) {
+        std::optional<HitInfo<T>> closest;
+        for (uint32_t index = 0; index < engine.instances.size(); ++index) {
+            const Instance<T>& ins = engine.instances[index];
+            Ray<T> localRay = ray;
+            localRay.origin -= ins.translation;
+            auto hit = ins.object->intersectBruteForce(localRay);
+            if (hit && (!closest || hit->t < closest->t)) closest = hit;
+        }
+        return closest;
+    }
+private:
+    static constexpr T INF = std::numeric_limits<T>::infinity();
+    static constexpr T FAR_DISTANCE = T(1e6);
+    std::vector<AABB<T>> boxes;   // 实例的世界包围盒
+    std::vector<size_t> triangleInstances; // 可枚举图元的实例下标
+    AABB<T> scene;                // 整个场景外扩 10%
+    T sceneSize = 1;
+
+    void collect(const Engine<T>& engine) {
+        boxes.clear();
+        triangleInstances.clear();
+        scene = AABB<T>();
+        for (size_t i = 0; i < engine.instances.size(); ++i) {
+            const Instance<T>& ins = engine.instances[i];
+            AABB<T> box = ins.object->getAABB();
+            box.min += ins.translation;
+            box.max += ins.translation;
+            boxes.push_back(box);
+            scene.expand(box);
+            if (ins.object->primitiveCount()) triangleInstances.push_back(i);
+        }
+        if (boxes.empty()) scene = AABB<T>(Vec3<T>(-1), Vec3<T>(1));
+        const Vec3<T> margin = (scene.max - scene.min) * T(0.1);
+        scene.min -= margin;
+        scene.max += margin;
+        sceneSize = std::max(T(1e-3), (scene.max - scene.min).length());
+    }
+    template<typename URNG>
+    bool randomTriangle(const Engine<T>& engine, URNG& rng, Vec3<T>& a, Vec3<T>& b, Vec3<T>& c) const {
+        if (triangleInstances.empty()) return false;
+        std::uniform_real_distribution<double> uni(0, 1);
+        const Instance<T>& ins = engine.instances[triangleInstances[std::min(triangleInstances.size() - 1, size_t(uni(rng) * double(triangleInstances.size())))]];
+        const size_t count = ins.object->primitiveCount();
+        bool doubleSided;
+        if (!ins.object->primitive(std::min(count - 1, size_t(uni(rng) * double(count))), a, b, c, doubleSided)) return false;
+        a += ins.translation; b += ins.translation; c += ins.translation;
+        return true;
+    }
+    static std::optional<HitInfo<T>> blasIntersect(const Engine<T>& engine, const Ray<T>& ray) {
+        std::optional<HitInfo<T>> closest;
+        for (const auto& ins : engine.instances) {
+            Ray<T> localRay = ray;
+            localRay.origin -= ins.translation;
+            auto hit = ins.object->intersect(localRay);
+            if (hit && (!closest || hit->t < closest->t)) closest = hit;
+        }
+        return closest;
+    }
+    // 起点沿 ±x / ±y / ±z 挪 perturbUlps 个 ulp 后，或改用 double 参考时，是否有一次参考结果满足 agrees（与加速路径一致）
+    template<typename Agrees>
+    bool withinNoise(const Engine<T>& engine, const Ray<T>& ray, Agrees&& agrees) const {
+        for (int axis = 0; axis < 3; ++axis)
+            for (T sign : { T(-1), T(1) }) {
+                Ray<T> nudged = ray;
+                nudged.origin[axis] += sign * perturbUlps * std::numeric_limits<T>::epsilon() * std::max(T(1), std::abs(ray.origin[axis]));
+                if (agrees(referenceIntersect(engine, nudged))) return true;
+            }
+        return agrees(preciseIntersect(engine, ray));
+    }
+    // double 精度的暴力参考，只填写 t；不提供图元的实例退回 T 精度的 intersectBruteForce
+    static std::optional<HitInfo<T>> preciseIntersect(const Engine<T>& engine, const Ray<T>& ray) {
+        std::optional<double> closest;
+        for (const auto& ins : engine.instances) {
+            const Vec3<T> o = ray.origin - ins.translation;
+            const Ray<double> localRay(Vec3<double>(o.x, o.y, o.z), Vec3<double>(ray.direction.x, ray.direction.y, ray.direction.z));
+            const size_t count = ins.object->primitiveCount();
+            if (count == 0) {
+                Ray<T> fallback = ray;
+                fallback.origin = o;
+                const auto hit = ins.object->intersectBruteForce(fallback);
+                if (hit && (!closest || double(hit->t) < *closest)) closest = double(hit->t);
+                continue;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                Vec3<T> a, b, c;
+                bool doubleSided;
+                if (!ins.object->primitive(i, a, b, c, doubleSided)) continue;
+                const Vec3<double> p0(a.x, a.y, a.z);
+                const auto hit = rayTriangle(localRay, p0, Vec3<double>(b.x, b.y, b.z) - p0, Vec3<double>(c.x, c.y, c.z) - p0, doubleSided);
+                if (hit && (!closest || hit->t < *closest)) closest = hit->t;
+            }
+        }
+        if (!closest) return std::nullopt;
+        HitInfo<T> hit;
+        hit.t = T(*closest);
+        return hit;
+    }
+    // 相同返回 nullptr，否则返回失配类型
+    const char* compare(const std::optional<HitInfo<T>>& hit, const std::optional<HitInfo<T>>& reference) const {
+        if (hit.has_value() != reference.has_value()) return "hit";
+        if (hit && std::abs(hit->t - reference->t) > tTolerance * std::max(T(1), reference->t)) return "t";
+        return nullptr;
+    }
+    // 逐条执行 fn(i) 并返回总耗时（秒）
+    template<typename F>
+    double timed(F&& fn) const {
+        const auto start = std::chrono::steady_clock::now();
+        parallelFor(0, raysPerKind, [&](size_t i) { fn(i); }, threads, 64);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+#endif
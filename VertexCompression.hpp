@@ -0,0 +1,51 @@
+#ifndef VERTEXCOMPRESSION_H
+#define VERTEXCOMPRESSION_H
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "Vec3.hpp"
+#include "Half.hpp"
+// ================= 位置量化 =================
+// 相对包围盒把坐标量化为 16 位无符号整数：p ≈ origin + q * step
+template<typename T>
+inline uint16_t quantizeUnorm16(T v, T origin, T step) {
+    if (!(step > T(0))) return 0;
+    return uint16_t(std::clamp(std::lround((v - origin) / step), 0L, 65535L));
+}
+// ================= 八面体法线编码 =================
+// 单位向量投影到八面体再展开到 [-1,1]^2，每分量 16 位 snorm，共 4 字节
+template<typename T>
+inline int16_t toSnorm16(T v) { return int16_t(std::lround(std::clamp(v, T(-1), T(1)) * T(32767))); }
+template<typename T>
+inline T fromSnorm16(int16_t v) { return std::max(T(v) / T(32767), T(-1)); }
+template<typename T>
+inline uint32_t octEncode(const Vec3<T>& n) {
+    const T l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (!(l1 > T(0))) return 0;
+    T u = n.x / l1, v = n.y / l1;
+    if (n.z < 0) { // 下半球折叠到外侧三角形
+        const T pu = (T(1) - std::abs(v)) * (u >= 0 ? T(1) : T(-1));
+        const T pv = (T(1) - std::abs(u)) * (v >= 0 ? T(1) : T(-1));
+        u = pu; v = pv;
+    }
+    return uint32_t(uint16_t(toSnorm16(u))) | (uint32_t(uint16_t(toSnorm16(v))) << 16);
+}
+template<typename T>
+inline Vec3<T> octDecode(uint32_t packed) {
+    const T u = fromSnorm16<T>(int16_t(packed & 0xFFFFu)), v = fromSnorm16<T>(int16_t(packed >> 16));
+    Vec3<T> n(u, v, T(1) - std::abs(u) - std::abs(v));
+    if (n.z < 0) {
+        const T x = (T(1) - std::abs(n.y)) * (n.x >= 0 ? T(1) : T(-1));
+        const T y = (T(1) - std::abs(n.x)) * (n.y >= 0 ? T(1) : T(-1));
+        n.x = x; n.y = y;
+    }
+    return n.normalized();
+}
+// ================= 半精度 UV =================
+template<typename T>
+inline uint32_t packHalf2(T u, T v) { return uint32_t(floatToHalf(float(u))) | (uint32_t(floatToHalf(float(v))) << 16); }
+template<typename T>
+inline std::pair<T, T> unpackHalf2(uint32_t packed) {
+    return { T(halfToFloat(uint16_t(packed & 0xFFFFu))), T(halfToFloat(uint16_t(packed >> 16))) };
+}
+#endif
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include "QE.cpp"
+#include "SceneGen.hpp"
+#include "ToneMapper.hpp"
+#include "Denoiser.hpp"
+#include "ReSTIR.hpp"
+#include "Framebuffer.hpp"
+#include "Parallel.hpp"
+using namespace std;
+/*
+基准测试：程序化场景 + 固定种子，输出 JSON 便于做回归门禁
+    ./bench [--preset small|medium|large] [--threads N] [--spp N] [--out result.json] [--trace trace.json] [--raster-primary] [--denoise] [--lod N] [--irradiance-cache]
+测量项：BLAS / TLAS 构建时间、主光线（追踪与可见性缓冲光栅化）与阴影光线吞吐、着色吞吐、ReSTIR 单帧直接光照、内存、端到端帧时间
+*/
+struct Stopwatch {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double seconds() const { return chrono::duration<double>(chrono::steady_clock::now() - start).count(); }
+};
+
+int main(int argc, char** argv) {
+    string presetName = "medium", outPath, tracePath;
+    size_t threads = 0;
+    int spp = 4;
+    bool rasterPrimary = false, denoise = false, irradiance = false;
+    size_t lodLevels = 0;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        auto next = [&]() -> string { if (i + 1 >= argc) throw runtime_error("missing value for " + arg); return argv[++i]; };
+        if (arg == "--preset") presetName = next();
+        else if (arg == "--threads") threads = stoul(next());
+        else if (arg == "--spp") spp = stoi(next());
+        else if (arg == "--out") outPath = next();
+        else if (arg == "--trace") tracePath = next(); // 需以 -DQE_ENABLE_PROFILER 编译
+        else if (arg == "--raster-primary") rasterPrimary = true; // 端到端帧的主光线改用可见性缓冲
+        else if (arg == "--denoise") denoise = true; // 输出 AOV，色调映射前做边缘感知降噪
+        else if (arg == "--lod") lodLevels = stoul(next()); // 球体实例使用 N 级 LOD 链
+        else if (arg == "--irradiance-cache") irradiance = true; // 端到端帧加上经辐照度缓存的间接漫反射
+        else { cerr << "unknown argument " << arg << "\n"; return 1; }
+    }
+    if (threads == 0) threads = defaultThreadCount();
+    auto config = SceneGen::preset(presetName);
+    config.lodLevels = lodLevels;
+
+    // ================= 场景生成与构建 =================
+    Stopwatch total;
+    SceneGen::Scene<float> scene;
+    Stopwatch genTimer;
+    SceneGen::buildScene(scene, config, false);
+    const double sceneGenSeconds = genTimer.seconds();
+    size_t triangleCount = 0;
+    Stopwatch blasTimer;
+    for (auto& mesh : scene.meshes) { mesh->init(); triangleCount += mesh->triangles.size(); }
+    for (auto& chain : scene.lods)
+        for (auto& level : chain->owned) level->init();
+    const double blasSeconds = blasTimer.seconds();
+    Stopwatch tlasTimer;
+    scene.engine.init();
+    const double tlasSeconds = tlasTimer.seconds();
+    auto& engine = scene.engine;
+    const auto& camera = scene.camera;
+    size_t instanceTriangles = 0; // 按所选 LOD 计的实例三角形总数
+    for (const auto& ins : engine.instances) instanceTriangles += ins.object->primitiveCount();
+
+    // ================= 主光线 =================
+    const size_t pixels = config.width * config.height;
+    std::vector<std::optional<HitInfo<float>>> primary(pixels);
+    Stopwatch primaryTimer;
+    parallelFor(0, config.height, [&](size_t y) {
+        for (size_t x = 0; x < config.width; ++x)
+            primary[y * config.width + x] = engine.tlas.intersect(camera.generateRay(y, x));
+    }, threads);
+    const double primarySeconds = primaryTimer.seconds();
+    size_t primaryHits = 0;
+    for (const auto& h : primary) primaryHits += h.has_value();
+    // 同一组主光线改由可见性缓冲得到：光栅化 + 逐像素重建交点
+    VisibilityBuffer<float> visibility;
+    Stopwatch rasterTimer;
+    engine.rasterizeVisibility(camera, visibility, threads);
+    const double rasterSeconds = rasterTimer.seconds();
+    size_t rasterMismatches = 0;
+    std::vector<size_t> mismatchPerRow(config.height, 0);
+    Stopwatch reconstructTimer;
+    parallelFor(0, config.height, [&](size_t y) {
+        for (size_t x = 0; x < config.width; ++x) {
+            const auto hit = engine.primaryHit(camera.generateRay(y, x), x, y, &visibility);
+            const auto& ref = primary[y * config.width + x];
+            mismatchPerRow[y] += hit.has_value() != ref.has_value() || (hit && hit->t != ref->t);
+        }
+    }, threads);
+    const double reconstructSeconds = reconstructTimer.seconds();
+    for (auto c : mismatchPerRow) rasterMismatches += c;
+
+    // ================= 阴影光线：每个主光线交点向每个点光源各发一条 =================
+    vector<const PointLight<float>*> pointLights;
+    for (auto light : engine.lights)
+        if (light->getType() == LightType::Point) pointLights.push_back(static_cast<const PointLight<float>*>(light));
+    std::vector<size_t> occludedPerRow(config.height, 0);
+    Stopwatch shadowTimer;
+    parallelFor(0, config.height, [&](size_t y) {
+        for (size_t x = 0; x < config.width; ++x) {
+            const auto& hit = primary[y * config.width + x];
+            if (!hit) continue;
+            for (auto light : pointLights) {
+                const Vec3<float> toLight = light->position - hit->position;
+                const float len = toLight.length();
+                const Ray<float> shadowRay(hit->position + hit->normal * EPSILON, toLight / len);
+                occludedPerRow[y] += engine.traceOcclusion(shadowRay, len);
+            }
+        }
+    }, threads);
+    const double shadowSeconds = shadowTimer.seconds();
+    const size_t shadowRays = primaryHits * pointLights.size();
+    size_t occluded = 0;
+    for (auto c : occludedPerRow) occluded += c;
+
+    // ================= ReSTIR 直接光照（单帧，无历史）：阴影光线数与光源数无关 =================
+    Framebuffer<float> restirImage(config.width, config.height);
+    ReSTIRPass<float> restir;
+    restir.threads = threads;
+    Stopwatch restirTimer;
+    restir.run(engine, camera, restirImage, config.seed);
+    const double restirSeconds = restirTimer.seconds();
+
+    // ================= 着色（完整 renderPixel，端到端帧） =================
+    Framebuffer<float> image(config.width, config.height), ldr;
+    engine.resetOccluderCacheStats();
+    engine.rasterPrimary = rasterPrimary;
+    IrradianceCache<float> irradianceCache(pixels, 4.0f, 0.05f); // 半径按程序化场景的尺度（地形 60 × 60）取
+    if (irradiance) engine.irradianceCache = &irradianceCache;
+    Stopwatch shadeTimer;
+    AOVBuffer<float> aovs;
+    if (denoise) engine.render(camera, image, aovs, config.seed, [](const Tile&) {}, 0.05f, spp, 32, threads);
+    else engine.render(camera, image, config.seed, [](const Tile&) {}, 0.05f, spp, 32, threads);
+    const double shadeSeconds = shadeTimer.seconds();
+    Stopwatch denoiseTimer;
+    if (denoise) {
+        DenoisePass<float> denoiser;
+        denoiser.threads = threads;
+        denoiser.run(image, aovs, image);
+    }
+    const double denoiseSeconds = denoise ? denoiseTimer.seconds() : 0.0;
+    Stopwatch toneTimer;
+    ToneMapPass<float> tonemap;
+    tonemap.threads = threads;
+    tonemap.run(image, ldr);
+    const double toneSeconds = toneTimer.seconds();
+    const double frameSeconds = blasSeconds + tlasSeconds + shadeSeconds + denoiseSeconds + toneSeconds;
+    double checksum = 0;
+    for (size_t i = 0; i < pixels * 3; ++i) checksum += ldr.data()[i];
+    const auto memory = engine.memoryStats();
+    const auto occluder = engine.occluderCacheStats();
+
+    // ================= JSON 报告 =================
+    ostringstream json;
+    json.precision(6);
+    json << "{\n"
+         << "  \"preset\": \"" << presetName << "\",\n"
+         << "  \"seed\": " << config.seed << ",\n"
+         << "  \"threads\": " << threads << ",\n"
+         << "  \"resolution\": [" << config.width << ", " << config.height << "],\n"
+         << "  \"spp\": " << spp << ",\n"
+         << "  \"scene\": {\"triangles\": " << triangleCount << ", \"instances\": " << engine.instances.size()
+         << ", \"instanceTriangles\": " << instanceTriangles << ", \"lodLevels\": " << config.lodLevels
+         << ", \"pointLights\": " << config.pointLights << ", \"triangleLights\": " << config.triangleLights << "},\n"
+         << "  \"build\": {\"sceneGenSeconds\": " << sceneGenSeconds << ", \"blasSeconds\": " << blasSeconds
+         << ", \"tlasSeconds\": " << tlasSeconds << "},\n"
+         << "  \"primary\": {\"rays\": " << pixels << ", \"hits\": " << primaryHits << ", \"seconds\": " << primarySeconds
+         << ", \"raysPerSecond\": " << pixels / primarySeconds << "},\n"
+         << "  \"primaryRaster\": {\"rasterSeconds\": " << rasterSeconds << ", \"reconstructSeconds\": " << reconstructSeconds
+         << ", \"binnedTriangles\": " << visibility.binnedTriangles << ", \"mismatches\": " << rasterMismatches
+         << ", \"usedForFrame\": " << (rasterPrimary ? "true" : "false") << "},\n"
+         << "  \"shadow\": {\"rays\": " << shadowRays << ", \"occluded\": " << occluded << ", \"seconds\": " << shadowSeconds
+         << ", \"raysPerSecond\": " << (shadowSeconds > 0 ? shadowRays / shadowSeconds : 0) << "},\n"
+         << "  \"restir\": {\"seconds\": " << restirSeconds << ", \"shadowRays\": " << restir.lastShadowRays
+         << ", \"shadowRaysPerPixel\": " << double(restir.lastShadowRays) / pixels << "},\n"
+         << "  \"shading\": {\"seconds\": " << shadeSeconds << ", \"pixelsPerSecond\": " << pixels / shadeSeconds << "},\n"
+         << "  \"irradianceCache\": {\"enabled\": " << (irradiance ? "true" : "false") << ", \"records\": " << irradianceCache.size()
+         << ", \"bytes\": " << (irradiance ? irradianceCache.memoryBytes() : 0) << "},\n"
+         << "  \"occluderCache\": {\"queries\": " << occluder.queries << ", \"occluded\": " << occluder.occluded
+         << ", \"hits\": " << occluder.hits << ", \"hitRate\": " << occluder.hitRate() << ", \"occludedHitRate\": " << occluder.occludedHitRate() << "},\n"
+         << "  \"denoiseSeconds\": " << denoiseSeconds << ",\n"
+         << "  \"toneMapSeconds\": " << toneSeconds << ",\n"
+         << "  \"frameSeconds\": " << frameSeconds << ",\n"
+         << "  \"totalSeconds\": " << total.seconds() << ",\n"
+         << "  \"imageChecksum\": " << checksum << ",\n"
+         << "  \"memory\": " << memory.toJSON() << "\n"
+         << "}\n";
+    cout << json.str();
+    if (!outPath.empty()) ofstream(outPath) << json.str();
+#ifdef QE_ENABLE_PROFILER
+    if (!tracePath.empty()) Profiler::writeChromeTrace(tracePath);
+    cerr << Profiler::summaryText();
+#endif
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include "QE.cpp"
+#include "SceneGen.hpp"
+#include "Distributed.hpp"
+#include "ImageWriter.hpp"
+#include "ToneMapper.hpp"
+using namespace std;
+/*
+分布式单帧渲染：
+    ./distributed [--preset small|medium|large] [--workers N] [--threads N] [--out image.pfm] [--verify]
+        本机 fork N 个 worker（共享已构建的场景）
+    ./distributed --listen path --expect N ...        等待 N 个远端 worker 连接
+    ./distributed --connect path [--threads N] ...    作为 worker 连接协调者（需用相同 preset 加载同一场景）
+--verify 额外做一次单机渲染并逐像素比较
+*/
+int main(int argc, char** argv) {
+    string presetName = "small", listenPath, connectPath, outPath;
+    size_t workers = 4, expect = 0, threads = 1;
+    bool verify = false;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        auto next = [&]() -> string { if (i + 1 >= argc) throw runtime_error("missing value for " + arg); return argv[++i]; };
+        if (arg == "--preset") presetName = next();
+        else if (arg == "--workers") workers = stoul(next());
+        else if (arg == "--threads") threads = stoul(next());
+        else if (arg == "--listen") listenPath = next();
+        else if (arg == "--expect") expect = stoul(next());
+        else if (arg == "--connect") connectPath = next();
+        else if (arg == "--out") outPath = next();
+        else if (arg == "--verify") verify = true;
+        else { cerr << "unknown argument " << arg << "\n"; return 1; }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    const auto config = SceneGen::preset(presetName);
+    SceneGen::Scene<float> scene;
+    SceneGen::buildScene(scene, config);
+
+    if (!connectPath.empty()) {
+        const int fd = connectUnixSocket(connectPath);
+        FdConnection conn(fd, fd);
+        TileWorker<float>(scene.engine, threads).serve(conn);
+        close(fd);
+        return 0;
+    }
+    TileCoordinator<float> coordinator;
+    if (!listenPath.empty()) coordinator.acceptWorkers(listenPath, expect);
+    else {
+        scene.engine.prewarm(); // fork 前建好全部 BLAS，子进程写时复制共享
+        coordinator.spawnLocal(scene.engine, workers, threads);
+    }
+
+    Framebuffer<float> image(config.width, config.height);
+    const auto start = chrono::steady_clock::now();
+    coordinator.render(scene.camera, image, config.seed);
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const auto& stats = coordinator.getStats();
+    cerr << "workers " << coordinator.aliveWorkers() << ", tiles " << stats.tilesRendered << ", reassigned " << stats.tilesReassigned
+         << ", duplicates " << stats.duplicateTiles << ", lost " << stats.workersLost << ", " << seconds << " s\n";
+    coordinator.shutdown();
+    if (verify) {
+        Framebuffer<float> local(config.width, config.height);
+        scene.engine.render(scene.camera, local, config.seed, [](const Tile&) {}, 0.05f, 5, 32);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < image.pixelCount() * 3; ++i) mismatches += image.data()[i] != local.data()[i];
+        cerr << "verify: " << mismatches << " mismatching channels\n";
+        if (mismatches) return 2;
+    }
+    if (!outPath.empty()) ImageIO::save(outPath, image);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include "QE.cpp"
+#include "SceneGen.hpp"
+#include "Progressive.hpp"
+#include "ImageWriter.hpp"
+using namespace std;
+/*
+可中断的渐进渲染：
+    ./progressive [--preset small|medium|large] [--passes N] [--spp N] [--threads N] [--checkpoint file] [--interval seconds] [--out image.pfm]
+累加结果保存在检查点文件中（默认 progressive.acc）；收到 SIGINT / SIGTERM 时做完最后一次检查点后退出，
+用相同参数再次运行即从中断处继续，最终图像与不中断一次跑完逐位相同。退出码 3 表示尚未完成。
+*/
+static ProgressivePass<float> progressive;
+extern "C" void handleStop(int) { progressive.requestStop(); }
+
+int main(int argc, char** argv) {
+    string presetName = "small", checkpointPath = "progressive.acc", outPath;
+    uint64_t passes = 16;
+    int spp = 5;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        auto next = [&]() -> string { if (i + 1 >= argc) throw runtime_error("missing value for " + arg); return argv[++i]; };
+        if (arg == "--preset") presetName = next();
+        else if (arg == "--passes") passes = stoull(next());
+        else if (arg == "--spp") spp = stoi(next());
+        else if (arg == "--threads") progressive.threads = stoul(next());
+        else if (arg == "--checkpoint") checkpointPath = next();
+        else if (arg == "--interval") progressive.checkpointSeconds = stod(next());
+        else if (arg == "--out") outPath = next();
+        else { cerr << "unknown argument " << arg << "\n"; return 1; }
+    }
+    const auto config = SceneGen::preset(presetName);
+    SceneGen::Scene<float> scene;
+    SceneGen::buildScene(scene, config);
+
+    AccumulationBuffer<float> acc(checkpointPath, config.width, config.height, 32, config.seed, 0.05f, spp);
+    const uint64_t resumed = acc.minPasses();
+    signal(SIGINT, handleStop);
+    signal(SIGTERM, handleStop);
+    const auto start = chrono::steady_clock::now();
+    const bool complete = progressive.run(scene.engine, scene.camera, acc, passes);
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "passes " << resumed << " -> " << acc.minPasses() << " / " << passes << ", checkpoints " << progressive.lastCheckpoints
+         << ", " << seconds << " s" << (complete ? "" : " (interrupted)") << "\n";
+    if (!outPath.empty()) {
+        Framebuffer<float> image;
+        acc.resolve(image);
+        ImageIO::save(outPath, image);
+    }
+    return complete ? 0 : 3;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include "QE.cpp"
+#include "SceneGen.hpp"
+#include "MeshLoader.hpp"
+#include "RenderServer.hpp"
+using namespace std;
+/*
+常驻渲染服务入口：场景只加载、构建一次，之后反复接收任务
+    ./server [--preset small|medium|large] [--mesh file ...] [--socket path] [--threads N]
+未指定 --socket 时从 stdin 读命令、向 stdout 写应答（便于管道驱动）。协议见 RenderServer.hpp。
+指定 --mesh 时加载这些网格（各作为一个实例放在原点），否则使用程序化场景。
+*/
+int main(int argc, char** argv) {
+    string presetName = "medium", socketPath;
+    vector<string> meshFiles;
+    size_t threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        auto next = [&]() -> string { if (i + 1 >= argc) throw runtime_error("missing value for " + arg); return argv[++i]; };
+        if (arg == "--preset") presetName = next();
+        else if (arg == "--mesh") meshFiles.push_back(next());
+        else if (arg == "--socket") socketPath = next();
+        else if (arg == "--threads") threads = stoul(next());
+        else { cerr << "unknown argument " << arg << "\n"; return 1; }
+    }
+    signal(SIGPIPE, SIG_IGN); // 客户端断开时 write 返回错误而不是结束进程
+
+    const auto config = SceneGen::preset(presetName);
+    SceneGen::Scene<float> scene;
+    vector<Object<float>*> objects;
+    if (meshFiles.empty()) {
+        SceneGen::buildScene(scene, config);
+    } else {
+        auto& engine = scene.engine;
+        auto diffuse = engine.make<CookTorranceMaterial<float>>(Vec3<float>(0.6f), Vec3<float>(0.04f), 0.6f, 0.0f);
+        auto materials = engine.make<MaterialSet<float>>(vector<pair<Material<float>*, float>>{ { diffuse, 1.0f } }, false);
+        for (const auto& file : meshFiles) {
+            scene.meshes.push_back(MeshLoader::loadTriangleMesh<float>(file, materials));
+            engine.insertInstance(Instance<float>(scene.meshes.back().get(), Vec3<float>(0, 0, 0)));
+        }
+        engine.insertLight(engine.make<PointLight<float>>(Vec3<float>(0, 20, 20), Vec3<float>(2000)));
+        engine.init();
+    }
+    scene.engine.prewarm(scene.camera); // 默认视角下可见的网格先构建 BLAS，其余按需构建
+    for (auto& mesh : scene.meshes) objects.push_back(mesh.get());
+    cerr << "scene ready: " << scene.engine.instances.size() << " instances, " << objects.size() << " objects\n";
+
+    RenderServer<float> server(scene.engine, objects, threads);
+    if (socketPath.empty()) {
+        FdConnection conn(0, 1);
+        server.serve(conn);
+    } else {
+        cerr << "listening on " << socketPath << "\n";
+        server.serveUnixSocket(socketPath);
+    }
+    return 0;
+}
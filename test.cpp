@@ -4,9 +4,11 @@
 #include <vector>
 #include "QE.cpp"
 #include "BMP.cpp"
+#include "ImageWriter.hpp"
 #include "Camera.hpp"
 #include <algorithm>
 #include "ToneMapper.hpp"
+#include "Pipeline.hpp"
 #include <random>
 using namespace std;
 /*
@@ -33,15 +35,8 @@ Vec3<float> mapped = colorOpt.value() / (colorOpt.value() + Vec3<float>(1.0f))
 */
 
 
-ToneMapper<float> tmx(ToneMappingType::ACESFilm, 100);
-
-Pixel toPixel(const std::optional<Vec3<float>>& colorOpt) {
-    if (!colorOpt) return Pixel(0, 0, 0);
-    // auto output = tmx.map(colorOpt.value());
-    // return Pixel(std::min(255, (int)(output.x * 255)), std::min(255, (int)(output.y * 255)), std::min(255, (int)(output.z * 255)));
-    const int mx = 150;
-    return Pixel(std::min(255, (int)(colorOpt->x / mx * 255)),std::min(255, (int)(colorOpt->y / mx * 255)),std::min(255, (int)(colorOpt->z / mx * 255)));
-}
+// 整帧自动曝光 + ACES + sRGB，取代原先 toPixel 里写死的 mx = 150
+ToneMapPass<float> tonemap(ToneMappingType::ACESFilm, ExposureMode::HistogramPercentile);
 /*
 Vec3<T> albedo;      // 漫反射颜色
 Vec3<T> F0;          // 基反射率 (non-metal: ~0.04, metal: 根据材质)
@@ -96,51 +91,48 @@ int main() {
             make_pair(mat.get(), 1)
         }
     ), false);
-    auto mesh = make_unique<TriangleMesh<float>>(vector<Vec3<float>>({p0, p1, p2, p3, p4, p5, p6, p7}));
-    
-    mesh->insertTriangle(0, 1, 3, matv.get());
-    mesh->insertTriangle(0, 3, 2, matv.get());
-
-    mesh->insertTriangle(1, 4, 5, matv.get());
-    mesh->insertTriangle(1, 5, 3, matv.get());
-
-    mesh->insertTriangle(3, 5, 6, matv.get());
-    mesh->insertTriangle(3, 6, 2, matv.get());
-
-    mesh->insertTriangle(0, 4, 1, matv.get());
-    mesh->insertTriangle(0, 7, 4, matv.get());
-
-    mesh->insertTriangle(7, 5, 4, matv.get());
-    mesh->insertTriangle(7, 6, 5, matv.get());
-
-    mesh->insertTriangle(0, 2, 6, matv.get());
-    mesh->insertTriangle(0, 6, 7, matv.get());
-
-    auto light1 = make_unique<PointLight<float>>(Vec3<float>(2, 2, 2), Vec3<float>(5000, 5000, 5000));
-    auto light2 = make_unique<PointLight<float>>(Vec3<float>(-3, 2, -3), Vec3<float>(5000, 5000, 5000));
-    auto light3 = make_unique<TriangleLight<float>>(Vec3<float>(2, 0, 2), Vec3<float>(0, 2, 3), Vec3<float>(3, 2, 0), Vec3<float>(5000, 5000, 5000));
     Engine<float> engine;
-    mesh->init();
-    engine.insertInstance(Instance<float>(mesh.get(), Vec3<float>(0, 0, 0)));
-    engine.insertInstance(Instance<float>(mesh.get(), Vec3<float>(-0.5, 0.1, 0.5)));
-    engine.insertLight(light1.get());
-    engine.insertLight(light2.get());
-    engine.insertLight(light3.get());
+    auto light1 = engine.make<PointLight<float>>(Vec3<float>(2, 2, 2), Vec3<float>(5000, 5000, 5000));
+    auto light2 = engine.make<PointLight<float>>(Vec3<float>(-3, 2, -3), Vec3<float>(5000, 5000, 5000));
+    auto light3 = engine.make<TriangleLight<float>>(Vec3<float>(2, 0, 2), Vec3<float>(0, 2, 3), Vec3<float>(3, 2, 0), Vec3<float>(5000, 5000, 5000));
+    engine.insertLight(light1);
+    engine.insertLight(light2);
+    engine.insertLight(light3);
     const size_t width = 1920, height = 1080;
     Camera<float> camera(Vec3<float>(2, 2, 2), Vec3<float>(-0.5, 0.5, -0.5), Vec3<float>(0, 1, 0), 90.0f * acos(-1) / 180.0f, width, height);
-    engine.init();
-    vector<vector<Pixel>> image(height, vector<Pixel>(width));
     uint64_t seed = 99832;
-    mt19937 rng(static_cast<std::mt19937::result_type>(seed));
-    for (size_t i = 0; i < height; i++) {
-        for (size_t j = 0; j < width; j++) {
-            Ray<float> ray = camera.generateRay(i, j);
-            auto colorOpt = engine.renderPixel(rng, ray, 0.05, 50);
-            if (colorOpt)
-                image[i][j] = toPixel(colorOpt);
-        }
-    }
-    saveBMP("output.bmp", image);
+    // 网格加载、BLAS 构建、渲染与写盘由流水线重叠执行：HDR 图块渲染完立即写盘，BMP 在整帧曝光确定后逐图块映射写出
+    FramePipeline<float> pipeline(engine);
+    pipeline.spp = 50;
+    pipeline.tonemap = tonemap;
+    unique_ptr<TriangleMesh<float>> mesh;
+    pipeline.addMesh([&] {
+        mesh = make_unique<TriangleMesh<float>>(vector<Vec3<float>>({p0, p1, p2, p3, p4, p5, p6, p7}));
+        mesh->insertTriangle(0, 1, 3, matv.get());
+        mesh->insertTriangle(0, 3, 2, matv.get());
+
+        mesh->insertTriangle(1, 4, 5, matv.get());
+        mesh->insertTriangle(1, 5, 3, matv.get());
+
+        mesh->insertTriangle(3, 5, 6, matv.get());
+        mesh->insertTriangle(3, 6, 2, matv.get());
+
+        mesh->insertTriangle(0, 4, 1, matv.get());
+        mesh->insertTriangle(0, 7, 4, matv.get());
+
+        mesh->insertTriangle(7, 5, 4, matv.get());
+        mesh->insertTriangle(7, 6, 5, matv.get());
+
+        mesh->insertTriangle(0, 2, 6, matv.get());
+        mesh->insertTriangle(0, 6, 7, matv.get());
+        return mesh.get();
+    }, { Vec3<float>(0, 0, 0), Vec3<float>(-0.5, 0.1, 0.5) });
+    Framebuffer<float> image, ldr;
+    pipeline.run(camera, seed, image, ldr, "output.pfm", "output.bmp");
+#ifdef QE_ENABLE_PROFILER
+    Profiler::writeChromeTrace("trace.json");
+    cout << Profiler::summaryText();
+#endif
     return 0;
 }
 /*
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <filesystem>
+#include "QE.cpp"
+#include "SceneGen.hpp"
+#include "PagedMesh.hpp"
+#include "CompactMesh.hpp"
+#include "Validation.hpp"
+using namespace std;
+/*
+加速结构差分验证：暴力参考与 BLAS / TLAS 遍历逐条比较，有失配时返回 1，可作为启用新遍历或求交路径前的门禁
+    ./validate [--preset tiny|small] [--rays N] [--seed S] [--threads N] [--lod N] [--out report.json]
+场景为程序化场景外加一个轴对齐立方体和一块水平面片（叶子包围盒在某一轴上厚度为 0），
+以及由主球体切簇写盘得到的分页网格（缓存预算只够容纳少数簇页，求交过程中反复换页）和主球体的 16 位量化紧凑网格。
+分页网格另外用同一批光线比较 intersectBatch 与逐条 intersect，失配数记在报告的 paged.batchMismatches；
+renderPaths 在场景相机下比较可见性缓冲的主光线交点与 TLAS、批量与逐像素阴影的渲染结果（不带与带辐照度缓存各一次）（见 TraversalValidator::runRenderPaths）；
+报告中每条失配带光线种子，相同场景与种子下用 TraversalValidator::makeRay 可重放
+*/
+int main(int argc, char** argv) {
+    string presetName = "tiny", outPath;
+    size_t threads = 0, rays = 2000, lodLevels = 0;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        auto next = [&]() -> string { if (i + 1 >= argc) throw runtime_error("missing value for " + arg); return argv[++i]; };
+        if (arg == "--preset") presetName = next();
+        else if (arg == "--rays") rays = stoul(next()); // 每种光线的条数
+        else if (arg == "--seed") seed = stoull(next());
+        else if (arg == "--threads") threads = stoul(next());
+        else if (arg == "--lod") lodLevels = stoul(next());
+        else if (arg == "--out") outPath = next();
+        else { cerr << "unknown argument " << arg << "\n"; return 1; }
+    }
+    // 暴力参考的代价与三角形总数成正比，场景比基准测试小
+    SceneGen::SceneConfig config;
+    if (presetName == "tiny") { config.terrainResolution = 32; config.sphereSegments = 16; config.instanceCount = 50; }
+    else if (presetName == "small") { config.terrainResolution = 128; config.sphereSegments = 64; config.instanceCount = 200; }
+    else { cerr << "unknown preset " << presetName << "\n"; return 1; }
+    config.width = 320; config.height = 180;
+    config.lodLevels = lodLevels;
+    SceneGen::Scene<float> scene;
+    SceneGen::buildScene(scene, config, false);
+    auto& engine = scene.engine;
+    // 对抗几何：轴对齐立方体（六个面各自的叶子包围盒是扁的）与水平面片
+    auto flat = engine.make<CookTorranceMaterial<float>>(Vec3<float>(0.5, 0.5, 0.5), Vec3<float>(0.04, 0.04, 0.04), 0.5f, 0.0f);
+    auto flatSet = engine.make<MaterialSet<float>>(std::vector<std::pair<Material<float>*, float>>{ { flat, 1.0f } }, true);
+    auto cube = make_unique<TriangleMesh<float>>(std::vector<Vec3<float>>{
+        { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } });
+    cube->insertTriangles(std::vector<uint32_t>{ 0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4, 3, 7, 6, 3, 6, 2, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5 }, flatSet);
+    auto plane = make_unique<TriangleMesh<float>>(std::vector<Vec3<float>>{ { -4, 0, -4 }, { 4, 0, -4 }, { 4, 0, 4 }, { -4, 0, 4 } });
+    plane->insertTriangles(std::vector<uint32_t>{ 0, 2, 1, 0, 3, 2 }, flatSet);
+    engine.insertInstance(Instance<float>(cube.get(), Vec3<float>(6, 1, 6)));
+    engine.insertInstance(Instance<float>(plane.get(), Vec3<float>(-8, 3, -6)));
+    // 分页网格：主球体转成 .qpg 后以实例插入
+    MeshData<float> sphere;
+    sphere.points = scene.meshes[1]->points;
+    for (const auto& tri : scene.meshes[1]->triangles)
+        sphere.indices.insert(sphere.indices.end(), { uint32_t(tri.v0), uint32_t(tri.v1), uint32_t(tri.v2) });
+    const string pagedPath = (filesystem::temp_directory_path() / ("validate-" + to_string(getpid()) + ".qpg")).string();
+    PagedMesh::write(pagedPath, sphere, 16);
+    TextureTileCache pageCache(size_t(4) << 10, 2); // 每个分片大约只放得下一个簇页
+    PagedTriangleMesh<float> paged(pagedPath, pageCache, flatSet);
+    filesystem::remove(pagedPath); // 映射在对象生命期内保持有效
+    const Vec3<float> pagedOffset(-6, 4, 8);
+    engine.insertInstance(Instance<float>(&paged, pagedOffset));
+    // 量化紧凑网格：参考与加速路径都用反量化后的顶点
+    CompactTriangleMesh<float> compact(sphere.points, sphere.indices, flatSet);
+    compact.quantizePositions();
+    engine.insertInstance(Instance<float>(&compact, Vec3<float>(8, 4, -8)));
+    engine.init();
+
+    TraversalValidator<float> validator;
+    validator.raysPerKind = rays;
+    validator.threads = threads;
+    const auto report = validator.run(engine, seed);
+    const auto renderPaths = validator.runRenderPaths(engine, scene.camera, seed);
+    // 分页网格的批量求交与逐条求交一致（光线转到网格局部坐标，从空缓存开始，缺页走后台加载）。
+    // 两者访问簇的顺序不同：光线几乎平行地擦过三角形时单精度 t 误差很大，先命中哪个簇会影响结果；
+    // 结果不同但批量结果与双精度暴力求交一致的计入 batchIllConditioned，不算失败
+    pageCache.clear();
+    vector<Ray<float>> pagedRays;
+    for (size_t k = 0; k < size_t(ValidationRayKind::Count); ++k)
+        for (size_t i = 0; i < rays; ++i) {
+            Ray<float> ray = validator.makeRay(engine, ValidationRayKind(k), deriveSeed(deriveSeed(seed, k), i));
+            ray.origin -= pagedOffset;
+            pagedRays.push_back(ray);
+        }
+    vector<optional<HitInfo<float>>> batchHits;
+    paged.intersectBatch(pagedRays, batchHits);
+    auto sameHit = [&](const optional<double>& a, const optional<double>& b) {
+        return a.has_value() == b.has_value() && (!a || std::abs(*a - *b) <= validator.tTolerance * std::max(1.0, *b));
+    };
+    auto preciseT = [&](const Ray<float>& ray) {
+        const Ray<double> r(Vec3<double>(ray.origin.x, ray.origin.y, ray.origin.z), Vec3<double>(ray.direction.x, ray.direction.y, ray.direction.z));
+        optional<double> closest;
+        for (size_t t = 0; t < paged.primitiveCount(); ++t) {
+            Vec3<float> a, b, c;
+            bool doubleSided;
+            paged.primitive(t, a, b, c, doubleSided);
+            const Vec3<double> p0(a.x, a.y, a.z);
+            const auto hit = rayTriangle(r, p0, Vec3<double>(b.x, b.y, b.z) - p0, Vec3<double>(c.x, c.y, c.z) - p0, doubleSided);
+            if (hit && (!closest || hit->t < *closest)) closest = hit->t;
+        }
+        return closest;
+    };
+    auto hitT = [](const optional<HitInfo<float>>& h) { return h ? optional<double>(h->t) : nullopt; };
+    size_t pagedBatchMismatches = 0, pagedBatchIllConditioned = 0, pagedHits = 0;
+    for (size_t i = 0; i < pagedRays.size(); ++i) {
+        const auto single = hitT(paged.intersect(pagedRays[i])), batch = hitT(batchHits[i]);
+        pagedHits += single.has_value();
+        if (sameHit(batch, single)) continue;
+        if (sameHit(batch, preciseT(pagedRays[i]))) ++pagedBatchIllConditioned;
+        else ++pagedBatchMismatches;
+    }
+    const auto pageStats = paged.stats();
+    const bool passed = report.passed() && renderPaths.passed() && pagedBatchMismatches == 0;
+
+    // ================= JSON 报告 =================
+    ostringstream json;
+    json.precision(9);
+    json << "{\n"
+         << "  \"preset\": \"" << presetName << "\",\n"
+         << "  \"seed\": " << report.seed << ",\n"
+         << "  \"instances\": " << report.instances << ",\n"
+         << "  \"unverifiedInstances\": " << report.unverifiedInstances << ",\n"
+         << "  \"kinds\": {\n";
+    for (size_t k = 0; k < size_t(ValidationRayKind::Count); ++k) {
+        const auto& s = report.kinds[k];
+        json << "    \"" << validationRayKindName(ValidationRayKind(k)) << "\": {\"rays\": " << s.rays << ", \"referenceHits\": " << s.referenceHits
+             << ", \"tlasMismatches\": " << s.tlasMismatches << ", \"blasMismatches\": " << s.blasMismatches
+             << ", \"occlusionMismatches\": " << s.occlusionMismatches << ", \"hintMismatches\": " << s.hintMismatches << ", \"illConditioned\": " << s.illConditioned << ", \"referenceSeconds\": " << s.referenceSeconds
+             << ", \"tlasSeconds\": " << s.tlasSeconds << ", \"blasSeconds\": " << s.blasSeconds << ", \"occludedSeconds\": " << s.occludedSeconds
+             << ", \"speedup\": " << s.speedup() << "}" << (k + 1 < size_t(ValidationRayKind::Count) ? "," : "") << "\n";
+    }
+    json << "  },\n"
+         << "  \"paged\": {\"clusters\": " << paged.clusterCount() << ", \"rays\": " << pagedRays.size() << ", \"hits\": " << pagedHits
+         << ", \"batchMismatches\": " << pagedBatchMismatches << ", \"batchIllConditioned\": " << pagedBatchIllConditioned << ", \"pageLoads\": " << pageStats.pageLoads << ", \"deferredRays\": " << pageStats.deferredRays << "},\n"
+         << "  \"renderPaths\": {\"pixels\": " << renderPaths.pixels << ", \"visibilityMismatches\": " << renderPaths.visibilityMismatches
+         << ", \"visibilityIllConditioned\": " << renderPaths.visibilityIllConditioned << ", \"shadowBatchMismatches\": " << renderPaths.shadowBatchMismatches
+         << ", \"maxShadowBatchError\": " << renderPaths.maxShadowBatchError << ", \"indirectBatchMismatches\": " << renderPaths.indirectBatchMismatches
+         << ", \"maxIndirectBatchError\": " << renderPaths.maxIndirectBatchError << ", \"mismatches\": [";
+    for (size_t i = 0; i < renderPaths.mismatches.size(); ++i) {
+        const auto& m = renderPaths.mismatches[i];
+        json << (i ? ", " : "") << "{\"path\": \"" << m.path << "\", \"x\": " << m.x << ", \"y\": " << m.y << ", \"illConditioned\": " << (m.illConditioned ? "true" : "false") << "}";
+    }
+    json << "]},\n"
+         << "  \"totalMismatches\": " << report.totalMismatches() << ",\n"
+         << "  \"mismatches\": [";
+    for (size_t i = 0; i < report.mismatches.size(); ++i) {
+        const auto& m = report.mismatches[i];
+        auto t = [](float v) { return std::isinf(v) ? string("null") : to_string(v); };
+        json << (i ? "," : "") << "\n    {\"kind\": \"" << validationRayKindName(m.kind) << "\", \"raySeed\": " << m.raySeed
+             << ", \"path\": \"" << m.path << "\", \"what\": \"" << m.what << "\", \"origin\": [" << m.origin.x << ", " << m.origin.y << ", " << m.origin.z
+             << "], \"direction\": [" << m.direction.x << ", " << m.direction.y << ", " << m.direction.z << "], \"tMax\": " << m.tMax
+             << ", \"t\": " << t(m.t) << ", \"referenceT\": " << t(m.referenceT) << ", \"illConditioned\": " << (m.illConditioned ? "true" : "false") << "}";
+    }
+    json << (report.mismatches.empty() ? "" : "\n  ") << "],\n"
+         << "  \"passed\": " << (passed ? "true" : "false") << "\n"
+         << "}\n";
+    cout << json.str();
+    if (!outPath.empty()) ofstream(outPath) << json.str();
+    return passed ? 0 : 1;
+}